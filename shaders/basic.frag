@@ -3,6 +3,8 @@
 in vec3 vNormal;
 out vec4 FragColor;
 
+uniform vec4 highlight; // alpha > 0: flat colour for the picked triangle
+
 void main() {
     // color = absolute value of normal to visualize direction as color
     vec3 n = normalize(vNormal);
@@ -10,5 +12,6 @@ void main() {
     // optional small ambient base so darkest parts aren't pure black
     col = col * 0.9 + vec3(0.05);
     FragColor = vec4(col, 1.0);
+    if (highlight.a > 0.0) FragColor = highlight;
 }
 
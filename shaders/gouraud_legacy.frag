@@ -1,7 +0,0 @@
-#version 130
-in vec3 vertexColor;
-out vec4 FragColor;
-void main() {
-    FragColor = vec4(vertexColor, 1.0);
-}
-
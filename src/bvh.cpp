@@ -0,0 +1,323 @@
+#include "bvh.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+namespace {
+
+const int kBins = 16;
+const uint32_t kMaxLeaf = 8;        // SAH may stop splitting at this size or below
+const size_t kMaxDepth = 60;        // traversal stacks are sized from this
+const float kTraversalCost = 1.0f;  // one box test relative to one triangle test
+const size_t kParallelBinning = 1 << 16;
+const size_t kSpawnTriangles = 4096;
+const float kInf = std::numeric_limits<float>::infinity();
+
+struct Box {
+    glm::vec3 lo = glm::vec3(kInf), hi = glm::vec3(-kInf);
+    // Spelled out per component: these run a few hundred times per node during binning.
+    void grow(const glm::vec3& p) { grow(p, p); }
+    void grow(const Box& b) { grow(b.lo, b.hi); }
+    void grow(const glm::vec3& l, const glm::vec3& h) {
+        lo.x = std::min(lo.x, l.x); lo.y = std::min(lo.y, l.y); lo.z = std::min(lo.z, l.z);
+        hi.x = std::max(hi.x, h.x); hi.y = std::max(hi.y, h.y); hi.z = std::max(hi.z, h.z);
+    }
+    float area() const {
+        float dx = hi.x - lo.x, dy = hi.y - lo.y, dz = hi.z - lo.z;
+        return dx < 0.0f ? 0.0f : 2.0f * (dx * dy + dy * dz + dz * dx);
+    }
+};
+
+struct Bin { Box box, cbox; uint32_t count = 0; }; // triangle and centroid bounds
+struct Bins { Bin bin[3][kBins]; };
+
+struct Builder {
+    const std::vector<Box>& box;            // per triangle
+    const std::vector<glm::vec3>& centroid; // per triangle
+    std::vector<uint32_t>& order;           // triangle ids, partitioned in place
+    std::vector<BvhNode, CacheLineAllocator<BvhNode>>& nodes;
+    std::atomic<uint32_t> next_node{2};
+    std::atomic<size_t> leaves{0}, max_depth{0};
+    size_t spawn_depth = 0;
+
+    Builder(const std::vector<Box>& b, const std::vector<glm::vec3>& c, std::vector<uint32_t>& o,
+            std::vector<BvhNode, CacheLineAllocator<BvhNode>>& n) : box(b), centroid(c), order(o), nodes(n) {}
+
+    void make_leaf(BvhNode& node, size_t begin, size_t end, size_t depth) {
+        node.first = (uint32_t)begin;
+        node.count = (uint32_t)(end - begin);
+        leaves.fetch_add(1, std::memory_order_relaxed);
+        size_t d = max_depth.load(std::memory_order_relaxed);
+        while(depth > d && !max_depth.compare_exchange_weak(d, depth, std::memory_order_relaxed)) {}
+    }
+
+    // Triangle and centroid bounds of order[begin, end).
+    void range_bounds(size_t begin, size_t end, Box& bounds, Box& cbounds) const {
+        bounds = cbounds = Box();
+        const size_t n = end - begin;
+        if(n >= kParallelBinning) {
+            std::vector<Box> b(worker_count()), c(worker_count());
+            unsigned used = parallel_chunks(n, [&](unsigned k, size_t cb, size_t ce){
+                for(size_t i=begin+cb; i<begin+ce; ++i) { b[k].grow(box[order[i]]); c[k].grow(centroid[order[i]]); }
+            });
+            for(unsigned k=0;k<used;++k) { bounds.grow(b[k]); cbounds.grow(c[k]); }
+        } else {
+            for(size_t i=begin; i<end; ++i) { bounds.grow(box[order[i]]); cbounds.grow(centroid[order[i]]); }
+        }
+    }
+
+    // Children get their bounds from the parent's bins, so each level reads the
+    // triangles only to bin and partition them.
+    void build(uint32_t index, size_t begin, size_t end, size_t depth, const Box& bounds, const Box& cbounds) {
+        const size_t n = end - begin;
+        BvhNode& node = nodes[index];
+        node.lo = bounds.lo;
+        node.hi = bounds.hi;
+        if(n <= 2 || depth >= kMaxDepth) { make_leaf(node, begin, end, depth); return; }
+
+        // Bin centroids into kBins slabs per axis.
+        glm::vec3 extent = cbounds.hi - cbounds.lo, scale(0.0f);
+        for(int a=0;a<3;++a) if(extent[a] > 0.0f) scale[a] = kBins * (1.0f - 1e-6f) / extent[a];
+        auto bin_of = [&](const glm::vec3& c, int a){
+            return std::min(kBins - 1, (int)((c[a] - cbounds.lo[a]) * scale[a]));
+        };
+        auto bin_range = [&](Bins& bins, size_t b, size_t e){
+            for(size_t i=b; i<e; ++i) {
+                uint32_t t = order[i];
+                for(int a=0;a<3;++a) {
+                    if(scale[a] == 0.0f) continue;
+                    Bin& bin = bins.bin[a][bin_of(centroid[t], a)];
+                    bin.box.grow(box[t]);
+                    bin.cbox.grow(centroid[t]);
+                    ++bin.count;
+                }
+            }
+        };
+        Bins bins;
+        if(n >= kParallelBinning) {
+            std::vector<Bins> partial(worker_count());
+            unsigned used = parallel_chunks(n, [&](unsigned k, size_t cb, size_t ce){ bin_range(partial[k], begin + cb, begin + ce); });
+            for(unsigned k=0;k<used;++k)
+                for(int a=0;a<3;++a)
+                    for(int i=0;i<kBins;++i) {
+                        Bin &to = bins.bin[a][i], &from = partial[k].bin[a][i];
+                        to.box.grow(from.box);
+                        to.cbox.grow(from.cbox);
+                        to.count += from.count;
+                    }
+        } else {
+            bin_range(bins, begin, end);
+        }
+
+        // SAH sweep: cost of splitting after bin i on axis a.
+        float best_cost = kInf;
+        int best_axis = -1, best_split = 0;
+        const float inv_area = 1.0f / std::max(bounds.area(), 1e-30f);
+        for(int a=0;a<3;++a) {
+            if(scale[a] == 0.0f) continue;
+            float right_area[kBins];
+            uint32_t right_count[kBins];
+            Box acc;
+            uint32_t cnt = 0;
+            for(int i=kBins-1;i>0;--i) {
+                acc.grow(bins.bin[a][i].box);
+                cnt += bins.bin[a][i].count;
+                right_area[i] = acc.area();
+                right_count[i] = cnt;
+            }
+            acc = Box();
+            cnt = 0;
+            for(int i=0;i<kBins-1;++i) {
+                acc.grow(bins.bin[a][i].box);
+                cnt += bins.bin[a][i].count;
+                if(cnt == 0 || right_count[i+1] == 0) continue;
+                float cost = kTraversalCost + (acc.area() * cnt + right_area[i+1] * right_count[i+1]) * inv_area;
+                if(cost < best_cost) { best_cost = cost; best_axis = a; best_split = i + 1; }
+            }
+        }
+
+        size_t mid;
+        Box lb, lc, rb, rc;
+        if(best_axis < 0) {
+            // All centroids coincide: no spatial split exists, so halve the range.
+            if(n <= kMaxLeaf) { make_leaf(node, begin, end, depth); return; }
+            mid = begin + n / 2;
+        } else {
+            if(best_cost >= (float)n && n <= kMaxLeaf) { make_leaf(node, begin, end, depth); return; }
+            auto it = std::partition(order.begin() + begin, order.begin() + end,
+                                     [&](uint32_t t){ return bin_of(centroid[t], best_axis) < best_split; });
+            mid = (size_t)(it - order.begin());
+            for(int i=0;i<kBins;++i) {
+                const Bin& bin = bins.bin[best_axis][i];
+                (i < best_split ? lb : rb).grow(bin.box);
+                (i < best_split ? lc : rc).grow(bin.cbox);
+            }
+        }
+        if(best_axis < 0 || mid == begin || mid == end) {
+            mid = begin + n / 2;
+            range_bounds(begin, mid, lb, lc);
+            range_bounds(mid, end, rb, rc);
+        }
+
+        uint32_t left = next_node.fetch_add(2, std::memory_order_relaxed);
+        node.first = left;
+        node.count = 0;
+        if(depth < spawn_depth && n >= kSpawnTriangles) {
+            std::thread t([&, left, begin, mid, depth]{ build(left, begin, mid, depth + 1, lb, lc); });
+            build(left + 1, mid, end, depth + 1, rb, rc);
+            t.join();
+        } else {
+            build(left, begin, mid, depth + 1, lb, lc);
+            build(left + 1, mid, end, depth + 1, rb, rc);
+        }
+    }
+};
+
+// Entry distance of the ray into the node's box, or infinity when it misses [t_min, t_max].
+inline float slab_test(const BvhNode& node, const glm::vec3& origin, const glm::vec3& inv_dir, float t_min, float t_max) {
+    glm::vec3 t0 = (node.lo - origin) * inv_dir, t1 = (node.hi - origin) * inv_dir;
+    glm::vec3 tn = glm::min(t0, t1), tf = glm::max(t0, t1);
+    float enter = std::max(std::max(tn.x, tn.y), std::max(tn.z, t_min));
+    float exit = std::min(std::min(tf.x, tf.y), std::min(tf.z, t_max));
+    return enter <= exit ? enter : kInf;
+}
+
+// Moeller-Trumbore, double-sided. Writes t/u/v only on a hit inside (t_min, t_max).
+inline bool hit_triangle(const BvhTriangle& tri, const Ray& ray, float t_max, float& t, float& u, float& v) {
+    glm::vec3 p = glm::cross(ray.dir, tri.e2);
+    float det = glm::dot(tri.e1, p);
+    if(det == 0.0f) return false;
+    float inv_det = 1.0f / det;
+    glm::vec3 s = ray.origin - tri.v0;
+    float uu = glm::dot(s, p) * inv_det;
+    if(uu < 0.0f || uu > 1.0f) return false;
+    glm::vec3 q = glm::cross(s, tri.e1);
+    float vv = glm::dot(ray.dir, q) * inv_det;
+    if(vv < 0.0f || uu + vv > 1.0f) return false;
+    float tt = glm::dot(tri.e2, q) * inv_det;
+    if(!(tt >= ray.t_min && tt < t_max)) return false;
+    t = tt; u = uu; v = vv;
+    return true;
+}
+
+// Shared closest/any-hit traversal: nearer child first, far child pushed with its entry
+// distance so it can be dropped once a closer hit is known.
+template<bool AnyHit>
+bool traverse(const std::vector<BvhNode, CacheLineAllocator<BvhNode>>& nodes, const std::vector<BvhTriangle>& tris,
+              const Ray& ray, RayHit& hit) {
+    if(tris.empty()) return false;
+    const glm::vec3 inv_dir = 1.0f / ray.dir;
+    float best = ray.t_max;
+    if(slab_test(nodes[0], ray.origin, inv_dir, ray.t_min, best) == kInf) return false;
+    struct Entry { uint32_t node; float t; };
+    Entry stack[kMaxDepth + 2];
+    int sp = 0;
+    uint32_t index = 0;
+    bool found = false;
+    while(true) {
+        const BvhNode& node = nodes[index];
+        if(node.count) {
+            for(uint32_t i=node.first; i<node.first+node.count; ++i) {
+                float t, u, v;
+                if(!hit_triangle(tris[i], ray, best, t, u, v)) continue;
+                if(AnyHit) return true;
+                best = t;
+                hit.face = tris[i].face; hit.t = t; hit.u = u; hit.v = v;
+                found = true;
+            }
+        } else {
+            uint32_t c0 = node.first, c1 = node.first + 1;
+            float d0 = slab_test(nodes[c0], ray.origin, inv_dir, ray.t_min, best);
+            float d1 = slab_test(nodes[c1], ray.origin, inv_dir, ray.t_min, best);
+            if(d1 < d0) { std::swap(c0, c1); std::swap(d0, d1); }
+            if(d0 != kInf) {
+                if(d1 != kInf) stack[sp++] = {c1, d1};
+                index = c0;
+                continue;
+            }
+        }
+        do {
+            if(sp == 0) return found;
+            --sp;
+        } while(stack[sp].t >= best);
+        index = stack[sp].node;
+    }
+}
+
+} // namespace
+
+BvhStats Bvh::build(const std::vector<glm::vec3>& positions, const std::vector<glm::ivec3>& faces) {
+    auto t0 = std::chrono::steady_clock::now();
+    BvhStats st;
+    nodes.clear();
+    tris.clear();
+    const size_t nv = positions.size(), nf = faces.size();
+    if(nf >= 0x7FFFFFFFu) return st;
+
+    // Per-triangle bounds and centroids; invalid faces get an empty box and are dropped.
+    std::vector<Box> box(nf);
+    std::vector<glm::vec3> centroid(nf);
+    std::vector<uint8_t> valid(nf);
+    parallel_for(nf, [&](size_t f){
+        const glm::ivec3 t = faces[f];
+        bool ok = t.x >= 0 && t.y >= 0 && t.z >= 0 && (size_t)t.x < nv && (size_t)t.y < nv && (size_t)t.z < nv;
+        valid[f] = ok;
+        if(!ok) return;
+        Box b;
+        for(int k=0;k<3;++k) b.grow(positions[t[k]]);
+        box[f] = b;
+        centroid[f] = 0.5f * (b.lo + b.hi);
+    });
+    std::vector<uint32_t> order;
+    order.reserve(nf);
+    for(size_t f=0; f<nf; ++f) if(valid[f]) order.push_back((uint32_t)f);
+    const size_t n = order.size();
+    st.triangles = n;
+    if(n == 0) return st;
+
+    nodes.resize(2 * n + 2);
+    Builder b(box, centroid, order, nodes);
+    for(unsigned w = worker_count(); w > 1; w >>= 1) ++b.spawn_depth;
+    b.spawn_depth += 1;
+    Box bounds, cbounds;
+    b.range_bounds(0, n, bounds, cbounds);
+    b.build(0, 0, n, 0, bounds, cbounds);
+    nodes.resize(b.next_node.load());
+    nodes.shrink_to_fit();
+    nodes[1] = nodes[0]; // slot 1 is padding; keep it initialised
+
+    tris.resize(n);
+    parallel_for(n, [&](size_t i){
+        const glm::ivec3 t = faces[order[i]];
+        glm::vec3 v0 = positions[t.x];
+        tris[i] = BvhTriangle{v0, positions[t.y] - v0, positions[t.z] - v0, order[i]};
+    });
+
+    st.nodes = nodes.size() - 1;
+    st.leaves = b.leaves.load();
+    st.max_depth = b.max_depth.load();
+    auto area = [](const BvhNode& node){ Box bx; bx.lo = node.lo; bx.hi = node.hi; return bx.area(); };
+    double cost = 0.0;
+    for(size_t i=0; i<nodes.size(); ++i) {
+        if(i == 1) continue;
+        cost += area(nodes[i]) * (nodes[i].count ? (double)nodes[i].count : (double)kTraversalCost);
+    }
+    float root_area = area(nodes[0]);
+    st.sah_cost = root_area > 0.0f ? (float)(cost / root_area) : 0.0f;
+    st.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    return st;
+}
+
+bool Bvh::intersect(const Ray& ray, RayHit& hit) const {
+    hit = RayHit();
+    return traverse<false>(nodes, tris, ray, hit);
+}
+
+bool Bvh::occluded(const Ray& ray) const {
+    RayHit unused;
+    return traverse<true>(nodes, tris, ray, unused);
+}
@@ -0,0 +1,80 @@
+#pragma once
+// Bounding volume hierarchy over mesh triangles for ray queries.
+//
+// Top-down build with a binned surface area heuristic (16 bins per axis). Large nodes
+// bin in parallel and independent subtrees are built on separate threads. Nodes are
+// 32 bytes and siblings are allocated as an aligned pair, so one 64-byte cache line
+// holds both child boxes a traversal step tests. Triangles are copied into leaf order
+// as (v0, e1, e2) for Moeller-Trumbore.
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <limits>
+#include <new>
+#include <cstddef>
+#include <cstdint>
+
+struct Ray {
+    glm::vec3 origin = glm::vec3(0.0f);
+    glm::vec3 dir = glm::vec3(0.0f, 0.0f, -1.0f); // need not be normalised; t is in units of dir
+    float t_min = 0.0f;
+    float t_max = std::numeric_limits<float>::infinity();
+};
+
+struct RayHit {
+    static constexpr uint32_t kNone = 0xFFFFFFFFu;
+    uint32_t face = kNone; // index into the faces the BVH was built from
+    float t = std::numeric_limits<float>::infinity();
+    float u = 0.0f, v = 0.0f; // barycentrics of corners 1 and 2
+    bool hit() const { return face != kNone; }
+};
+
+struct BvhStats {
+    size_t triangles = 0;
+    size_t nodes = 0;
+    size_t leaves = 0;
+    size_t max_depth = 0;
+    float sah_cost = 0.0f; // expected traversal + intersection cost relative to the root area
+    double ms = 0.0;
+};
+
+struct alignas(32) BvhNode {
+    glm::vec3 lo;
+    uint32_t first; // leaf: first triangle; inner: left child (the right child follows it)
+    glm::vec3 hi;
+    uint32_t count; // triangles in a leaf, 0 for inner nodes
+};
+
+struct BvhTriangle {
+    glm::vec3 v0, e1, e2;
+    uint32_t face;
+};
+
+// Keeps node pairs on cache-line boundaries.
+template<class T> struct CacheLineAllocator {
+    using value_type = T;
+    CacheLineAllocator() = default;
+    template<class U> CacheLineAllocator(const CacheLineAllocator<U>&) {}
+    T* allocate(size_t n) { return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(64))); }
+    void deallocate(T* p, size_t) { ::operator delete(p, std::align_val_t(64)); }
+    template<class U> bool operator==(const CacheLineAllocator<U>&) const { return true; }
+    template<class U> bool operator!=(const CacheLineAllocator<U>&) const { return false; }
+};
+
+class Bvh {
+public:
+    // Faces with out-of-range indices are skipped.
+    BvhStats build(const std::vector<glm::vec3>& positions, const std::vector<glm::ivec3>& faces);
+    // Closest hit in [t_min, t_max]; false when nothing is hit.
+    bool intersect(const Ray& ray, RayHit& hit) const;
+    // Any hit in [t_min, t_max]; cheaper than intersect() for shadow and visibility rays.
+    bool occluded(const Ray& ray) const;
+
+    bool empty() const { return tris.empty(); }
+    const BvhNode& root() const { return nodes[0]; }
+
+private:
+    std::vector<BvhNode, CacheLineAllocator<BvhNode>> nodes; // root at 0, slot 1 unused, then sibling pairs
+    std::vector<BvhTriangle> tris;
+};
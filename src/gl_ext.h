@@ -0,0 +1,99 @@
+#pragma once
+// Optional GL entry points beyond the 3.3 core that glad loads.
+//
+// load_gl_extensions() runs once after gladLoadGLLoader with the same loader. Each
+// feature is enabled only when the context's version or extension list provides it,
+// and callers test the flag before using the matching function pointer.
+
+#include <glad/glad.h>
+
+#include <cstring>
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#define GL_DYNAMIC_STORAGE_BIT 0x0100
+#define GL_CLIENT_STORAGE_BIT 0x0200
+#endif
+
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+#ifndef GL_FRAGMENT_SHADER_INVOCATIONS
+#define GL_FRAGMENT_SHADER_INVOCATIONS 0x82F4
+#endif
+
+typedef void (APIENTRYP PFN_glBufferStorage)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+typedef void (APIENTRYP PFN_glGetProgramBinary)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+typedef void (APIENTRYP PFN_glProgramBinary)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+typedef void (APIENTRYP PFN_glProgramParameteri)(GLuint program, GLenum pname, GLint value);
+typedef void (APIENTRYP PFN_glMaxShaderCompilerThreads)(GLuint count);
+
+struct GlExtensions {
+    int major = 0, minor = 0;
+    bool buffer_storage = false; // GL 4.4 or GL_ARB_buffer_storage
+    PFN_glBufferStorage BufferStorage = nullptr;
+    bool program_binary = false; // GL 4.1 or GL_ARB_get_program_binary, with at least one binary format
+    PFN_glGetProgramBinary GetProgramBinary = nullptr;
+    PFN_glProgramBinary ProgramBinary = nullptr;
+    PFN_glProgramParameteri ProgramParameteri = nullptr;
+    // GL_KHR_parallel_shader_compile (or the ARB version): compiles and links run on driver
+    // threads and GL_COMPLETION_STATUS_KHR can be polled without blocking.
+    bool parallel_shader_compile = false;
+    PFN_glMaxShaderCompilerThreads MaxShaderCompilerThreads = nullptr;
+    // GL 4.6 or GL_ARB_pipeline_statistics_query: glBeginQuery accepts counters such as
+    // GL_FRAGMENT_SHADER_INVOCATIONS. No new entry points.
+    bool pipeline_statistics = false;
+};
+
+inline GlExtensions gl_ext;
+
+inline bool gl_has_extension(const char* name) {
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for(GLint i=0;i<count;++i) {
+        const char* e = (const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+        if(e && std::strcmp(e, name) == 0) return true;
+    }
+    return false;
+}
+
+inline bool gl_version_at_least(int major, int minor) {
+    return gl_ext.major > major || (gl_ext.major == major && gl_ext.minor >= minor);
+}
+
+inline void load_gl_extensions(GLADloadproc load) {
+    gl_ext = GlExtensions();
+    glGetIntegerv(GL_MAJOR_VERSION, &gl_ext.major);
+    glGetIntegerv(GL_MINOR_VERSION, &gl_ext.minor);
+    if(gl_version_at_least(4, 4) || gl_has_extension("GL_ARB_buffer_storage")) {
+        gl_ext.BufferStorage = (PFN_glBufferStorage)load("glBufferStorage");
+        gl_ext.buffer_storage = gl_ext.BufferStorage != nullptr;
+    }
+    if(gl_version_at_least(4, 1) || gl_has_extension("GL_ARB_get_program_binary")) {
+        gl_ext.GetProgramBinary = (PFN_glGetProgramBinary)load("glGetProgramBinary");
+        gl_ext.ProgramBinary = (PFN_glProgramBinary)load("glProgramBinary");
+        gl_ext.ProgramParameteri = (PFN_glProgramParameteri)load("glProgramParameteri");
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        gl_ext.program_binary = gl_ext.GetProgramBinary && gl_ext.ProgramBinary && gl_ext.ProgramParameteri && formats > 0;
+    }
+    if(gl_has_extension("GL_KHR_parallel_shader_compile"))
+        gl_ext.MaxShaderCompilerThreads = (PFN_glMaxShaderCompilerThreads)load("glMaxShaderCompilerThreadsKHR");
+    else if(gl_has_extension("GL_ARB_parallel_shader_compile"))
+        gl_ext.MaxShaderCompilerThreads = (PFN_glMaxShaderCompilerThreads)load("glMaxShaderCompilerThreadsARB");
+    gl_ext.parallel_shader_compile = gl_ext.MaxShaderCompilerThreads != nullptr;
+    // The extension's default thread count is implementation-defined; ask for as many as the driver likes.
+    if(gl_ext.parallel_shader_compile) gl_ext.MaxShaderCompilerThreads(0xFFFFFFFFu);
+    gl_ext.pipeline_statistics = gl_version_at_least(4, 6) || gl_has_extension("GL_ARB_pipeline_statistics_query");
+    // glad loads the core entry point from 3.3 on; older contexts may have the ARB one.
+    if(!glVertexAttribDivisor && gl_has_extension("GL_ARB_instanced_arrays"))
+        glad_glVertexAttribDivisor = (PFNGLVERTEXATTRIBDIVISORPROC)load("glVertexAttribDivisorARB");
+}
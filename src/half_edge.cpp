@@ -0,0 +1,156 @@
+#include "half_edge.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace {
+
+const uint32_t kNone = HalfEdgeMesh::kNone;
+const ptrdiff_t kInsertionSortMax = 32;
+
+} // namespace
+
+HalfEdgeStats build_half_edge_mesh(size_t vertex_count, const std::vector<glm::ivec3>& faces, HalfEdgeMesh& mesh) {
+    auto t0 = std::chrono::steady_clock::now();
+    HalfEdgeStats st;
+    const size_t nf = faces.size(), nv = vertex_count, nh = 3*faces.size();
+    st.faces = nf;
+    mesh = HalfEdgeMesh();
+    if(nh >= kNone || nv >= kNone) return st;
+
+    mesh.origin.resize(nh);
+    mesh.twin.assign(nh, kNone);
+    std::vector<size_t> skipped(worker_count(), 0);
+    parallel_chunks(nf, [&](unsigned c, size_t b, size_t e){
+        for(size_t f=b;f<e;++f) {
+            const glm::ivec3 t = faces[f];
+            bool ok = t.x >= 0 && t.y >= 0 && t.z >= 0 && (size_t)t.x < nv && (size_t)t.y < nv && (size_t)t.z < nv
+                   && t.x != t.y && t.y != t.z && t.x != t.z;
+            for(int k=0;k<3;++k) mesh.origin[3*f+k] = ok ? (uint32_t)t[k] : kNone;
+            skipped[c] += !ok;
+        }
+    });
+    for(size_t s: skipped) st.skipped_faces += s;
+
+    // Radix sort of the directed edges on their undirected key (lo, hi) with lo as one
+    // counting-sort digit: bucket by lo, then sort each bucket (a vertex's few edges)
+    // by (hi, half-edge). Sorting by half-edge index as well keeps the pairing deterministic.
+    // Buckets are usually a handful of edges and insertion-sorted; hub vertices with
+    // more than kInsertionSortMax edges fall back to std::sort so they stay O(d log d).
+    // Counting and scattering follow parallel_radix_sort: each chunk of half-edges keeps
+    // its own per-vertex counts, which become that chunk's private scatter cursors, so
+    // no counter is shared and each bucket stays in half-edge order. A chunk covers at
+    // least nv/2 half-edges, which keeps the per-chunk tables within the bucket's size.
+    auto lo_hi = [&](size_t h, uint32_t& lo, uint32_t& hi){
+        uint32_t a = mesh.origin[h], b = mesh.origin[HalfEdgeMesh::next((uint32_t)h)];
+        lo = std::min(a, b); hi = std::max(a, b);
+    };
+    const size_t grain = std::max<size_t>(65536, nv / 2);
+    std::vector<std::vector<uint32_t>> cursor(worker_count());
+    unsigned chunks = parallel_chunks(nh, [&](unsigned c, size_t b, size_t e){
+        std::vector<uint32_t> &count = cursor[c];
+        count.assign(nv, 0);
+        for(size_t h=b; h<e; ++h) {
+            uint32_t lo, hi;
+            lo_hi(h, lo, hi);
+            if(lo != kNone) ++count[lo];
+        }
+    }, grain);
+    std::vector<uint32_t> start(nv + 1, 0);
+    parallel_chunks(nv, [&](unsigned, size_t b, size_t e){
+        for(size_t v=b; v<e; ++v)
+            for(unsigned c=0; c<chunks; ++c) start[v+1] += cursor[c][v];
+    });
+    for(size_t v=0; v<nv; ++v) start[v+1] += start[v];
+    parallel_chunks(nv, [&](unsigned, size_t b, size_t e){
+        for(size_t v=b; v<e; ++v) {
+            uint32_t at = start[v];
+            for(unsigned c=0; c<chunks; ++c) { uint32_t n = cursor[c][v]; cursor[c][v] = at; at += n; }
+        }
+    });
+    std::vector<uint64_t> bucket(start[nv]); // hi << 32 | half-edge
+    parallel_chunks(nh, [&](unsigned c, size_t b, size_t e){
+        std::vector<uint32_t> &at = cursor[c];
+        for(size_t h=b; h<e; ++h) {
+            uint32_t lo, hi;
+            lo_hi(h, lo, hi);
+            if(lo != kNone) bucket[at[lo]++] = (uint64_t)hi << 32 | h;
+        }
+    }, grain);
+    std::vector<std::vector<uint32_t>>().swap(cursor);
+
+    // One pass over the runs of equal (lo, hi): two opposite half-edges are twins;
+    // anything else stays unpaired.
+    std::vector<uint8_t> boundary(nh, 0);
+    struct Counts { size_t edges = 0, boundary = 0, nonmanifold = 0, inconsistent = 0; };
+    std::vector<Counts> counts(worker_count());
+    parallel_chunks(nv, [&](unsigned c, size_t b, size_t e){
+        Counts &n = counts[c];
+        for(size_t v=b; v<e; ++v) {
+            uint64_t *first = bucket.data() + start[v], *last = bucket.data() + start[v+1];
+            if(last - first > kInsertionSortMax) std::sort(first, last);
+            else for(uint64_t *i = first + 1; i < last; ++i)
+                for(uint64_t *j = i; j > first && j[-1] > j[0]; --j) std::swap(j[-1], j[0]);
+            for(uint64_t *i = first; i < last;) {
+                uint64_t *run = i + 1;
+                while(run < last && (*run >> 32) == (*i >> 32)) ++run;
+                ++n.edges;
+                uint32_t h0 = (uint32_t)*i;
+                if(run - i == 1) { ++n.boundary; boundary[h0] = 1; }
+                else if(run - i > 2) ++n.nonmanifold;
+                else {
+                    uint32_t h1 = (uint32_t)i[1];
+                    if(mesh.origin[h0] == mesh.origin[h1]) ++n.inconsistent;
+                    else { mesh.twin[h0] = h1; mesh.twin[h1] = h0; }
+                }
+                i = run;
+            }
+        }
+    }, 4096);
+    for(const Counts &n: counts) {
+        st.edges += n.edges;
+        st.boundary_edges += n.boundary;
+        st.nonmanifold_edges += n.nonmanifold;
+        st.inconsistent_edges += n.inconsistent;
+    }
+    std::vector<uint64_t>().swap(bucket);
+
+    // Outgoing half-edge per vertex, preferring boundary ones so a walk around the
+    // vertex starting there covers the whole fan.
+    mesh.outgoing.assign(nv, kNone);
+    for(size_t h=0; h<nh; ++h) {
+        uint32_t v = mesh.origin[h];
+        if(v != kNone && (mesh.outgoing[v] == kNone || boundary[h])) mesh.outgoing[v] = (uint32_t)h;
+    }
+
+    // Boundary loops: boundary half-edges bucketed by origin, then chained dest -> origin.
+    std::vector<uint32_t> bstart(nv + 1, 0), blist;
+    for(size_t h=0; h<nh; ++h) if(boundary[h]) ++bstart[mesh.origin[h] + 1];
+    for(size_t v=0; v<nv; ++v) bstart[v+1] += bstart[v];
+    blist.resize(bstart[nv]);
+    {
+        std::vector<uint32_t> fill(bstart.begin(), bstart.end() - 1);
+        for(size_t h=0; h<nh; ++h) if(boundary[h]) blist[fill[mesh.origin[h]]++] = (uint32_t)h;
+    }
+    mesh.loop_start.push_back(0);
+    for(uint32_t h0: blist) {
+        if(boundary[h0] != 1) continue; // already walked
+        uint32_t h = h0;
+        bool closed = false;
+        while(true) {
+            boundary[h] = 2;
+            mesh.loop_half_edges.push_back(h);
+            uint32_t v = mesh.dest(h), nxt = kNone;
+            if(v == mesh.origin[h0]) { closed = true; break; }
+            for(uint32_t i=bstart[v]; i<bstart[v+1]; ++i) if(boundary[blist[i]] == 1) { nxt = blist[i]; break; }
+            if(nxt == kNone) break;
+            h = nxt;
+        }
+        mesh.loop_start.push_back((uint32_t)mesh.loop_half_edges.size());
+        if(closed) ++st.boundary_loops; else ++st.open_chains;
+    }
+
+    st.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    return st;
+}
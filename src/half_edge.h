@@ -0,0 +1,52 @@
+#pragma once
+// Index-based half-edge mesh: SoA arrays of 32-bit indices, no pointers.
+//
+// Half-edge h belongs to face h / 3 and runs from corner h % 3 to corner h % 3 + 1,
+// so face, next and prev are arithmetic and only origin and twin are stored. Twins
+// are paired by a parallel radix sort of the directed edges on their undirected key.
+// The lower vertex is a single counting-sort digit and the short per-vertex buckets are
+// then sorted in place.
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+struct HalfEdgeMesh {
+    static constexpr uint32_t kNone = 0xFFFFFFFFu;
+
+    std::vector<uint32_t> origin;   // per half-edge; kNone for all three of a skipped face
+    std::vector<uint32_t> twin;     // per half-edge; kNone on boundary, non-manifold and inconsistent edges
+    std::vector<uint32_t> outgoing; // per vertex; a boundary half-edge when there is one, kNone if unused
+    // Boundary loops (and open chains) in CSR form: loop i is
+    // loop_half_edges[loop_start[i] .. loop_start[i+1]), in walking order.
+    std::vector<uint32_t> loop_start;
+    std::vector<uint32_t> loop_half_edges;
+
+    size_t half_edge_count() const { return origin.size(); }
+    size_t face_count() const { return origin.size() / 3; }
+    size_t vertex_count() const { return outgoing.size(); }
+    size_t loop_count() const { return loop_start.empty() ? 0 : loop_start.size() - 1; }
+
+    static uint32_t face(uint32_t h) { return h / 3; }
+    static uint32_t next(uint32_t h) { return h % 3 == 2 ? h - 2 : h + 1; }
+    static uint32_t prev(uint32_t h) { return h % 3 == 0 ? h + 2 : h - 1; }
+    uint32_t dest(uint32_t h) const { return origin[next(h)]; }
+    bool is_boundary(uint32_t h) const { return twin[h] == kNone; }
+};
+
+struct HalfEdgeStats {
+    size_t faces = 0;
+    size_t skipped_faces = 0;      // out-of-range or repeated indices
+    size_t edges = 0;              // undirected
+    size_t boundary_edges = 0;     // used by one face
+    size_t nonmanifold_edges = 0;  // used by more than two faces
+    size_t inconsistent_edges = 0; // two faces walking the edge in the same direction
+    size_t boundary_loops = 0;
+    size_t open_chains = 0;        // boundary walks cut short by non-manifold vertices
+    double ms = 0.0;
+};
+
+// Builds `mesh` from `faces`; face i of the input is face i of the mesh.
+HalfEdgeStats build_half_edge_mesh(size_t vertex_count, const std::vector<glm::ivec3>& faces, HalfEdgeMesh& mesh);
@@ -0,0 +1,144 @@
+#include "light_clusters.h"
+
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+namespace {
+
+inline float hash_unit(uint32_t x) {
+    x ^= x >> 16; x *= 0x7feb352dU; x ^= x >> 15; x *= 0x846ca68bU; x ^= x >> 16;
+    return (x >> 8) * (1.0f / 16777216.0f);
+}
+
+// Fully saturated colour of hue h in [0,1).
+inline glm::vec3 hue_color(float h) {
+    auto channel = [h](float shift) {
+        float k = std::fmod(h * 6.0f + shift, 6.0f);
+        return std::min(std::max(std::fabs(k - 3.0f) - 1.0f, 0.0f), 1.0f);
+    };
+    return glm::vec3(channel(0.0f), channel(4.0f), channel(2.0f));
+}
+
+} // namespace
+
+std::vector<PointLight> make_point_lights(size_t count, float spread, float radius, uint32_t seed) {
+    std::vector<PointLight> lights(count);
+    float gain = std::min(1.0f, 16.0f / (float)std::max<size_t>(count, 1));
+    for(size_t i=0;i<count;++i) {
+        uint32_t s = seed * 0x9E3779B9u + (uint32_t)i * 4u;
+        float z = 2.0f * hash_unit(s) - 1.0f, phi = 6.2831853f * hash_unit(s + 1);
+        float ring = std::sqrt(std::max(0.0f, 1.0f - z * z));
+        float r = spread * std::cbrt(hash_unit(s + 2)); // uniform in the ball
+        PointLight& l = lights[i];
+        l.position = r * glm::vec3(ring * std::cos(phi), ring * std::sin(phi), z);
+        l.radius = radius;
+        l.color = gain * hue_color(hash_unit(s + 3));
+    }
+    return lights;
+}
+
+void LightClusters::build(const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& proj,
+                          int width, int height, float z_near, float z_far) {
+    auto t0 = std::chrono::steady_clock::now();
+    stats = LightClusterStats();
+    stats.lights = lights.size();
+    width = std::max(width, 1);
+    height = std::max(height, 1);
+    int tile = std::max(tile_pixels, 1);
+    dims = glm::ivec3((width + tile - 1) / tile, (height + tile - 1) / tile, std::max(slices, 1));
+    z_near = std::max(z_near, 1e-4f);
+    z_far = std::max(z_far, z_near * 1.001f);
+    float log_ratio = std::log(z_far / z_near);
+    scale = (float)dims.z / log_ratio;
+    bias = -(float)dims.z * std::log(z_near) / log_ratio;
+
+    // Tile corners at every slice boundary: each corner's NDC ray (near to far plane)
+    // cut at view depth d. Works for perspective and orthographic projections alike.
+    const size_t cx = (size_t)dims.x + 1, cy = (size_t)dims.y + 1;
+    corners.resize(cx * cy * ((size_t)dims.z + 1));
+    glm::mat4 inv = glm::inverse(proj);
+    for(size_t j=0;j<cy;++j) for(size_t i=0;i<cx;++i) {
+        float nx = std::min(2.0f * (float)(i * tile) / (float)width - 1.0f, 1.0f);
+        float ny = std::min(2.0f * (float)(j * tile) / (float)height - 1.0f, 1.0f);
+        glm::vec4 a = inv * glm::vec4(nx, ny, -1.0f, 1.0f), b = inv * glm::vec4(nx, ny, 1.0f, 1.0f);
+        glm::vec3 pa = glm::vec3(a.x, a.y, a.z) / a.w, pb = glm::vec3(b.x, b.y, b.z) / b.w;
+        for(int k=0;k<=dims.z;++k) {
+            float d = z_near * std::pow(z_far / z_near, (float)k / (float)dims.z);
+            float t = (-d - pa.z) / (pb.z - pa.z);
+            corners[((size_t)k * cy + j) * cx + i] = pa + (pb - pa) * t;
+        }
+    }
+    auto corner = [&](int i, int j, int k) -> const glm::vec3& { return corners[((size_t)k * cy + (size_t)j) * cx + (size_t)i]; };
+    boxes.resize(2 * cluster_count());
+    for(int k=0;k<dims.z;++k) for(int j=0;j<dims.y;++j) for(int i=0;i<dims.x;++i) {
+        glm::vec3 bmin = corner(i, j, k), bmax = bmin;
+        for(int m=1;m<8;++m) {
+            const glm::vec3& q = corner(i + (m & 1), j + ((m >> 1) & 1), k + (m >> 2));
+            bmin = glm::min(bmin, q);
+            bmax = glm::max(bmax, q);
+        }
+        size_t cl = ((size_t)k * dims.y + j) * dims.x + i;
+        boxes[2 * cl] = bmin;
+        boxes[2 * cl + 1] = bmax;
+    }
+    auto slice_of = [&](float d) { return std::min(std::max((int)std::floor(std::log(d) * scale + bias), 0), dims.z - 1); };
+    auto tile_of = [&](float ndc, int pixels, int dim) {
+        return std::min(std::max((int)std::floor((ndc + 1.0f) * 0.5f * (float)pixels / (float)tile), 0), dim - 1);
+    };
+
+    cell_data.assign(2 * cluster_count(), 0u);
+    hits.clear();
+    for(size_t li=0; li<lights.size(); ++li) {
+        const PointLight& light = lights[li];
+        float r = light.radius;
+        glm::vec4 c4 = view * glm::vec4(light.position, 1.0f);
+        glm::vec3 c(c4.x, c4.y, c4.z);
+        float dmin = -c.z - r, dmax = -c.z + r;
+        if(r <= 0.0f || dmax <= z_near || dmin >= z_far) continue;
+        int k0 = slice_of(std::max(dmin, z_near)), k1 = slice_of(std::min(dmax, z_far));
+
+        // Screen rectangle of the sphere's box, with the box clipped to the depth range
+        // so every corner projects in front of the eye.
+        float zs[2] = { std::max(c.z - r, -z_far), std::min(c.z + r, -z_near) };
+        glm::vec2 lo(1.0f), hi(-1.0f);
+        for(int m=0;m<8;++m) {
+            glm::vec4 p = proj * glm::vec4(c.x + ((m & 1) ? r : -r), c.y + ((m & 2) ? r : -r), zs[m >> 2], 1.0f);
+            glm::vec2 ndc(p.x / p.w, p.y / p.w);
+            lo = glm::min(lo, ndc);
+            hi = glm::max(hi, ndc);
+        }
+        if(hi.x < -1.0f || hi.y < -1.0f || lo.x > 1.0f || lo.y > 1.0f) continue;
+        int i0 = tile_of(lo.x, width, dims.x), i1 = tile_of(hi.x, width, dims.x);
+        int j0 = tile_of(lo.y, height, dims.y), j1 = tile_of(hi.y, height, dims.y);
+
+        size_t before = hits.size();
+        for(int k=k0;k<=k1;++k) for(int j=j0;j<=j1;++j) for(int i=i0;i<=i1;++i) {
+            uint32_t cluster = (uint32_t)(((size_t)k * dims.y + j) * dims.x + i);
+            glm::vec3 d = glm::clamp(c, boxes[2 * cluster], boxes[2 * cluster + 1]) - c;
+            if(glm::dot(d, d) > r * r) continue;
+            hits.push_back(cluster);
+            hits.push_back((uint32_t)li);
+            ++cell_data[2 * cluster + 1];
+        }
+        if(hits.size() > before) ++stats.visible_lights;
+    }
+
+    // Offsets by prefix sum; the counts are rebuilt while scattering.
+    uint32_t total = 0;
+    for(size_t cl=0; cl<cluster_count(); ++cl) {
+        uint32_t n = cell_data[2 * cl + 1];
+        cell_data[2 * cl] = total;
+        cell_data[2 * cl + 1] = 0;
+        total += n;
+        if(n) ++stats.nonempty_clusters;
+        stats.max_per_cluster = std::max<size_t>(stats.max_per_cluster, n);
+    }
+    index_data.resize(total);
+    for(size_t h=0; h<hits.size(); h+=2) {
+        uint32_t* cell = &cell_data[2 * (size_t)hits[h]];
+        index_data[cell[0] + cell[1]++] = hits[h + 1];
+    }
+    stats.references = total;
+    stats.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
@@ -0,0 +1,71 @@
+#pragma once
+// Clustered light lists for forward shading with many point lights.
+//
+// The view frustum is split into screen tiles of `tile_pixels` and `slices` depth
+// slices spaced exponentially between the near and far planes. build() finds the
+// clusters each light's bounding sphere can touch (its projected screen rectangle and
+// depth range, then a sphere/box test per cluster) and writes every cluster's lights
+// as an (offset, count) pair into one shared index list. A fragment shader finds its
+// cluster from gl_FragCoord and its view depth and shades only those lights:
+//
+//     tile  = gl_FragCoord.xy / tile_pixels
+//     slice = log(depth) * slice_scale + slice_bias
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Two RGBA32F texels per light.
+struct PointLight {
+    glm::vec3 position;
+    float radius;      // no contribution beyond this distance
+    glm::vec3 color;
+    float pad = 0.0f;
+};
+
+// `count` lights scattered through a ball of radius `spread` at the origin, with random
+// hues scaled down as the count grows so the sum stays in range. Deterministic per seed.
+std::vector<PointLight> make_point_lights(size_t count, float spread, float radius, uint32_t seed = 1);
+
+struct LightClusterStats {
+    size_t lights = 0;
+    size_t visible_lights = 0;    // touching at least one cluster
+    size_t references = 0;        // entries in the index list
+    size_t nonempty_clusters = 0;
+    size_t max_per_cluster = 0;
+    double ms = 0.0;
+};
+
+class LightClusters {
+public:
+    int tile_pixels = 64;
+    int slices = 24;
+
+    // `view` and `proj` as used for drawing, `z_near`/`z_far` the projection's planes
+    // (positive distances; perspective or orthographic).
+    void build(const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& proj,
+               int width, int height, float z_near, float z_far);
+
+    int dim_x() const { return dims.x; }
+    int dim_y() const { return dims.y; }
+    int dim_z() const { return dims.z; }
+    size_t cluster_count() const { return (size_t)dims.x * dims.y * dims.z; }
+    float slice_scale() const { return scale; }
+    float slice_bias() const { return bias; }
+
+    // Per cluster, index (z*dim_y + y)*dim_x + x: first entry in indices() and count.
+    const std::vector<uint32_t>& cells() const { return cell_data; }
+    const std::vector<uint32_t>& indices() const { return index_data; }
+
+    LightClusterStats stats;
+
+private:
+    glm::ivec3 dims = glm::ivec3(0);
+    float scale = 0.0f, bias = 0.0f;
+    std::vector<glm::vec3> corners;  // view-space tile corners at slice boundaries
+    std::vector<glm::vec3> boxes;    // per cluster: view-space bounds (min, max)
+    std::vector<uint32_t> cell_data, index_data;
+    std::vector<uint32_t> hits;      // (cluster, light) pairs, flattened
+};
@@ -0,0 +1,142 @@
+#include "mesh_ao.h"
+#include "mesh_cache.h"
+#include "bvh.h"
+#include "parallel.h"
+
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+namespace {
+
+const uint32_t kAoMagic = 0x4F414653; // "SFAO"
+const uint32_t kAoVersion = 1;
+
+struct AoHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    uint64_t vertex_count;
+};
+
+// Hammersley point i of n: stratified in the first coordinate, radical inverse in the second.
+inline glm::vec2 hammersley(uint32_t i, uint32_t n) {
+    uint32_t b = i;
+    b = (b << 16) | (b >> 16);
+    b = ((b & 0x55555555u) << 1) | ((b & 0xAAAAAAAAu) >> 1);
+    b = ((b & 0x33333333u) << 2) | ((b & 0xCCCCCCCCu) >> 2);
+    b = ((b & 0x0F0F0F0Fu) << 4) | ((b & 0xF0F0F0F0u) >> 4);
+    b = ((b & 0x00FF00FFu) << 8) | ((b & 0xFF00FF00u) >> 8);
+    return glm::vec2((i + 0.5f) / n, b * (1.0f / 4294967296.0f));
+}
+
+inline float hash_unit(uint32_t x) {
+    x ^= x >> 16; x *= 0x7feb352dU; x ^= x >> 15; x *= 0x846ca68bU; x ^= x >> 16;
+    return (x >> 8) * (1.0f / 16777216.0f);
+}
+
+// Orthonormal basis around unit n (Duff et al. 2017).
+inline void tangent_frame(const glm::vec3& n, glm::vec3& t, glm::vec3& b) {
+    float s = std::copysign(1.0f, n.z);
+    float a = -1.0f / (s + n.z);
+    float c = n.x * n.y * a;
+    t = glm::vec3(1.0f + s * n.x * n.x * a, s * c, -s * n.x);
+    b = glm::vec3(c, s + n.y * n.y * a, -n.y);
+}
+
+} // namespace
+
+std::vector<float> bake_vertex_occlusion(const std::vector<glm::vec3>& positions, const std::vector<glm::ivec3>& faces,
+                                         const std::vector<glm::vec3>& normals, const AoOptions& options, AoStats* stats) {
+    auto t0 = std::chrono::steady_clock::now();
+    const size_t nv = positions.size();
+    const uint32_t rays = (uint32_t)std::max(options.rays, 1);
+    std::vector<float> occlusion(nv, 0.0f);
+    AoStats st;
+    st.vertices = nv;
+    st.rays = (size_t)rays * nv;
+
+    Bvh bvh;
+    BvhStats bs = bvh.build(positions, faces);
+    st.bvh_ms = bs.ms;
+    if(!bvh.empty() && normals.size() == nv) {
+        const BvhNode& root = bvh.root();
+        float diagonal = glm::length(root.hi - root.lo);
+        float max_distance = options.max_distance > 0.0f ? options.max_distance : 0.5f * diagonal;
+        float offset = 1e-4f * diagonal; // keeps rays off the surface they start on
+        st.max_distance = max_distance;
+
+        // One shared sample set, turned by a per-vertex angle so neighbouring vertices
+        // do not alias the same directions.
+        std::vector<glm::vec3> local(rays);
+        for(uint32_t i=0;i<rays;++i) {
+            glm::vec2 u = hammersley(i, rays);
+            float r = std::sqrt(u.x), phi = 6.2831853f * u.y;
+            local[i] = glm::vec3(r * std::cos(phi), r * std::sin(phi), std::sqrt(std::max(0.0f, 1.0f - u.x)));
+        }
+        parallel_chunks(nv, [&](unsigned, size_t b, size_t e){
+            for(size_t v=b; v<e; ++v) {
+                float len = glm::length(normals[v]);
+                if(!(len > 0.0f)) continue;
+                glm::vec3 n = normals[v] / len, t, bt;
+                tangent_frame(n, t, bt);
+                float turn = 6.2831853f * hash_unit((uint32_t)v);
+                float cs = std::cos(turn), sn = std::sin(turn);
+                Ray ray;
+                ray.origin = positions[v] + offset * n;
+                ray.t_min = 0.0f;
+                ray.t_max = max_distance;
+                uint32_t hits = 0;
+                for(uint32_t i=0;i<rays;++i) {
+                    const glm::vec3& d = local[i];
+                    float x = cs * d.x - sn * d.y, y = sn * d.x + cs * d.y;
+                    ray.dir = x * t + y * bt + d.z * n;
+                    hits += bvh.occluded(ray);
+                }
+                occlusion[v] = (float)hits / (float)rays;
+            }
+        }, 256);
+    }
+    st.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    if(stats) *stats = st;
+    return occlusion;
+}
+
+uint64_t occlusion_cache_key(const std::vector<glm::vec3>& positions, const std::vector<glm::ivec3>& faces, const AoOptions& options) {
+    uint64_t h = hash_bytes(positions.data(), positions.size() * sizeof(glm::vec3), kAoVersion);
+    h = hash_bytes(faces.data(), faces.size() * sizeof(glm::ivec3), h);
+    h = hash_bytes(&options.rays, sizeof(options.rays), h);
+    return hash_bytes(&options.max_distance, sizeof(options.max_distance), h);
+}
+
+bool load_cached_occlusion(uint64_t key, size_t vertex_count, std::vector<float>& occlusion) {
+    std::ifstream in(mesh_cache_path(key, ".ao"), std::ios::binary);
+    if(!in) return false;
+    AoHeader h;
+    if(!in.read((char*)&h, sizeof(h)) || h.magic != kAoMagic || h.version != kAoVersion || h.key != key
+       || h.vertex_count != vertex_count) return false;
+    occlusion.resize(vertex_count);
+    in.read((char*)occlusion.data(), (std::streamsize)(occlusion.size()*sizeof(float)));
+    if(!in) { occlusion.clear(); return false; }
+    return true;
+}
+
+bool save_cached_occlusion(uint64_t key, const std::vector<float>& occlusion) {
+    std::string path = mesh_cache_path(key, ".ao");
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if(!out) { std::cerr << "Cannot write AO cache: " << tmp << std::endl; return false; }
+        AoHeader h = { kAoMagic, kAoVersion, key, occlusion.size() };
+        out.write((const char*)&h, sizeof(h));
+        out.write((const char*)occlusion.data(), (std::streamsize)(occlusion.size()*sizeof(float)));
+        if(!out) { std::cerr << "Cannot write AO cache: " << tmp << std::endl; return false; }
+    }
+    std::filesystem::rename(tmp, path, ec);
+    return !ec;
+}
@@ -0,0 +1,34 @@
+#pragma once
+// Baked per-vertex ambient occlusion.
+//
+// Each vertex casts a fixed set of cosine-weighted hemisphere rays around its normal
+// through a BVH of the mesh, in parallel over vertices. The result is the occluded
+// fraction, 0 for open sky and 1 for fully enclosed. Bakes are cached on disk as
+// cache/<key>.ao, keyed by a hash of the mesh and the bake options.
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+struct AoOptions {
+    int rays = 64;             // per vertex
+    float max_distance = 0.0f; // hits beyond this do not occlude; 0: half the bounding-box diagonal
+};
+
+struct AoStats {
+    size_t vertices = 0;
+    size_t rays = 0;
+    float max_distance = 0.0f;
+    double bvh_ms = 0.0;
+    double ms = 0.0; // total, including the BVH
+};
+
+// `normals` are per-vertex and need not be normalised; zero normals get no occlusion.
+std::vector<float> bake_vertex_occlusion(const std::vector<glm::vec3>& positions, const std::vector<glm::ivec3>& faces,
+                                         const std::vector<glm::vec3>& normals, const AoOptions& options, AoStats* stats = nullptr);
+
+uint64_t occlusion_cache_key(const std::vector<glm::vec3>& positions, const std::vector<glm::ivec3>& faces, const AoOptions& options);
+bool load_cached_occlusion(uint64_t key, size_t vertex_count, std::vector<float>& occlusion);
+bool save_cached_occlusion(uint64_t key, const std::vector<float>& occlusion);
@@ -0,0 +1,206 @@
+// Offline timing of the mesh passes on stress meshes. The input model is
+// Loop-subdivided level by level and each pass runs on a fresh copy of every level;
+// level 0 also reports the half-edge topology of the input. Ray throughput is
+// closest-hit queries against the level's BVH from points around its bounds. The
+// codec columns give the compression ratio of the cache encoding and its decode
+// speed (raw float/int bytes produced per second) on one core and on all of them.
+// --lights adds a sweep of the clustered light binning over light counts and screen
+// sizes, with the average number of lights in a non-empty cluster.
+//
+// Usage: ./mesh_bench <model.smf> [--levels=N] [--rays=N] [--codec-bits=N] [--simplify] [--lights]
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cmath>
+#include <atomic>
+#include <algorithm>
+
+#include "smf_io.h"
+#include "mesh_clean.h"
+#include "mesh_simplify.h"
+#include "mesh_subdivide.h"
+#include "half_edge.h"
+#include "bvh.h"
+#include "mesh_codec.h"
+#include "light_clusters.h"
+#include "parallel.h"
+
+using Clock = std::chrono::steady_clock;
+
+static double ms_since(Clock::time_point t0) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+}
+
+// Matches "--name" or "--name=value"; value is left untouched when absent.
+static bool parse_flag(const std::string& arg, const char* name, std::string& value) {
+    size_t n = std::char_traits<char>::length(name);
+    if(arg.compare(0, n, name) != 0) return false;
+    if(arg.size() == n) return true;
+    if(arg[n] != '=') return false;
+    value = arg.substr(n + 1);
+    return true;
+}
+
+// Uniform float in [0,1) from a counter; keeps parallel ray generation reproducible.
+static float hash_unit(uint32_t x) {
+    x ^= x >> 16; x *= 0x7feb352dU; x ^= x >> 15; x *= 0x846ca68bU; x ^= x >> 16;
+    return (x >> 8) * (1.0f / 16777216.0f);
+}
+
+static glm::vec3 unit_vector(uint32_t seed) {
+    float z = 2.0f * hash_unit(seed) - 1.0f, phi = 6.2831853f * hash_unit(seed ^ 0x9e3779b9U);
+    float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+    return glm::vec3(r * std::cos(phi), r * std::sin(phi), z);
+}
+
+// Rays start on a sphere twice the size of the bounds and aim at points inside them.
+// Returns million rays per second; `hits` gets the fraction that hit.
+static double ray_throughput(const Bvh& bvh, size_t count, double& hits) {
+    const BvhNode& root = bvh.root();
+    glm::vec3 center = 0.5f * (root.lo + root.hi);
+    float radius = 0.5f * glm::length(root.hi - root.lo);
+    std::atomic<size_t> hit_count{0};
+    auto t0 = Clock::now();
+    parallel_chunks(count, [&](unsigned, size_t b, size_t e){
+        size_t n = 0;
+        for(size_t i=b; i<e; ++i) {
+            uint32_t seed = (uint32_t)i * 4u;
+            Ray ray;
+            ray.origin = center + 2.0f * radius * unit_vector(seed);
+            glm::vec3 target = center + 0.5f * radius * hash_unit(seed + 2) * unit_vector(seed + 1);
+            ray.dir = target - ray.origin;
+            RayHit hit;
+            n += bvh.intersect(ray, hit);
+        }
+        hit_count += n;
+    }, 4096);
+    double ms = ms_since(t0);
+    hits = count ? (double)hit_count.load() / count : 0.0;
+    return ms > 0.0 ? count / (ms * 1000.0) : 0.0;
+}
+
+// Decode speed in GB/s of raw output, best of a few runs to skip first-touch page faults.
+static double decode_speed(const std::vector<uint8_t>& packed, bool parallel) {
+    std::vector<glm::vec3> p;
+    std::vector<glm::ivec3> f;
+    double best = 0.0;
+    for(int run=0; run<3; ++run) {
+        MeshCodecStats st;
+        if(!decode_mesh(packed.data(), packed.size(), p, f, parallel, &st)) return 0.0;
+        if(st.ms > 0.0) best = std::max(best, st.raw_bytes / (st.ms * 1e6));
+    }
+    return best;
+}
+
+// Bins lights around a unit model seen from the shading_demo default camera. "per
+// cluster" averages the non-empty clusters, a proxy for the lights a shaded pixel loops over.
+static void light_cluster_sweep() {
+    const size_t counts[] = { 64, 256, 1024, 4096 };
+    const int sizes[][2] = { { 1280, 720 }, { 1920, 1080 }, { 3840, 2160 } };
+    std::printf("%7s %11s %10s %10s %12s %9s %9s\n", "lights", "resolution", "clusters", "refs", "per cluster", "max", "bin ms");
+    for(size_t count: counts) {
+        std::vector<PointLight> lights = make_point_lights(count, 1.3f, 0.35f);
+        for(const auto& size: sizes) {
+            float aspect = (float)size[0] / (float)size[1];
+            glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 3.5f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+            glm::mat4 proj = glm::perspective(glm::radians(45.0f), aspect, 2.49f, 4.51f);
+            LightClusters clusters;
+            double best = 1e30;
+            for(int rep=0; rep<5; ++rep) {
+                clusters.build(lights, view, proj, size[0], size[1], 2.49f, 4.51f);
+                best = std::min(best, clusters.stats.ms);
+            }
+            const LightClusterStats& cs = clusters.stats;
+            char res[32];
+            std::snprintf(res, sizeof(res), "%dx%d", size[0], size[1]);
+            std::printf("%7zu %11s %10zu %10zu %12.1f %9zu %9.2f\n", count, res, clusters.cluster_count(), cs.references,
+                        cs.nonempty_clusters ? (double)cs.references / cs.nonempty_clusters : 0.0, cs.max_per_cluster, best);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    const char* usage = "Usage: ./mesh_bench <model.smf> [--levels=N] [--rays=N] [--codec-bits=N] [--simplify] [--lights]\n";
+    std::string modelPath;
+    int levels = 5;
+    size_t rays = 1 << 20;
+    MeshCodecOptions codec;
+    bool simplify = false;
+    bool lights = false;
+    for(int i=1;i<argc;++i) {
+        std::string arg = argv[i], val;
+        if(parse_flag(arg, "--levels", val)) levels = std::atoi(val.c_str());
+        else if(parse_flag(arg, "--rays", val)) rays = (size_t)std::atoll(val.c_str());
+        else if(parse_flag(arg, "--codec-bits", val)) codec.position_bits = std::atoi(val.c_str());
+        else if(arg == "--simplify") simplify = true;
+        else if(arg == "--lights") lights = true;
+        else if(arg.rfind("--", 0) == 0) { std::cerr << "Unknown option " << arg << "\n" << usage; return 1; }
+        else modelPath = arg;
+    }
+    if(modelPath.empty()) { std::cerr << usage; return 1; }
+
+    std::vector<glm::vec3> positions;
+    std::vector<glm::ivec3> faces;
+    if(!load_smf(modelPath, positions, faces)) return 1;
+    std::cout << modelPath << ": " << positions.size() << " vertices, " << faces.size() << " faces, "
+              << worker_count() << " threads\n";
+
+    std::printf("%5s %10s %10s %10s %10s %10s %10s %10s %10s %10s %6s %7s %9s %9s%s\n", "level", "faces", "loop ms", "hedge ms", "weld ms",
+                "clean ms", "orient ms", "Mfaces/s", "bvh ms", "Mrays/s", "hit %", "z ratio", "dec GB/s", "par GB/s",
+                simplify ? "    lod ms" : "");
+    for(int level=0; level<=levels; ++level) {
+        std::vector<glm::vec3> p = positions;
+        std::vector<glm::ivec3> f = faces;
+        SubdivideStats ss = loop_subdivide(p, f, level);
+        if(ss.levels < level) { std::cout << "Stopped at level " << ss.levels << " (32-bit index limit)\n"; break; }
+
+        HalfEdgeMesh he;
+        HalfEdgeStats hs = build_half_edge_mesh(p.size(), f, he);
+        if(level == 0)
+            std::cout << "Topology: " << hs.edges << " edges, " << hs.boundary_edges << " boundary in " << hs.boundary_loops
+                      << " loops (" << hs.open_chains << " open chains), " << hs.nonmanifold_edges << " non-manifold, "
+                      << hs.inconsistent_edges << " inconsistently wound\n";
+        he = HalfEdgeMesh();
+
+        auto t0 = Clock::now();
+        std::vector<glm::vec3> wp = p;
+        std::vector<glm::ivec3> wf = f;
+        WeldStats ws = weld_vertices(wp, wf, 0.0f);
+        CleanStats cs = clean_faces(wp, wf);
+        OrientStats os = orient_faces(wp, wf);
+        double passes = ms_since(t0);
+
+        Bvh bvh;
+        BvhStats bs = bvh.build(p, f);
+        if(level == 0)
+            std::cout << "BVH: " << bs.nodes << " nodes, " << bs.leaves << " leaves, depth " << bs.max_depth
+                      << ", SAH cost " << bs.sah_cost << "\n";
+        double hit_rate = 0.0, mrays = bvh.empty() ? 0.0 : ray_throughput(bvh, rays, hit_rate);
+
+        std::vector<uint8_t> packed;
+        MeshCodecStats zs;
+        bool encoded = encode_mesh(p, f, codec, packed, &zs);
+        double decode_one = encoded ? decode_speed(packed, false) : 0.0;
+        double decode_all = encoded ? decode_speed(packed, true) : 0.0;
+
+        std::printf("%5d %10zu %10.1f %10.1f %10.1f %10.1f %10.1f %10.2f %10.1f %10.2f %6.1f %7.2f %9.2f %9.2f", level, f.size(), ss.ms,
+                    hs.ms, ws.ms, cs.ms, os.ms, passes > 0.0 ? f.size() / (passes * 1000.0) : 0.0, bs.ms, mrays, 100.0 * hit_rate,
+                    zs.ratio(), decode_one, decode_all);
+        if(simplify) {
+            SimplifyStats qs;
+            build_lod_chain(p, f, {0.5f, 0.25f, 0.1f, 0.02f}, &qs);
+            std::printf(" %10.1f", qs.ms);
+        }
+        std::printf("\n");
+    }
+    if(lights) light_cluster_sweep();
+    return 0;
+}
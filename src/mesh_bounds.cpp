@@ -0,0 +1,245 @@
+#include "mesh_bounds.h"
+#include "parallel.h"
+
+#include <chrono>
+#include <limits>
+
+namespace {
+
+// Extreme-point directions of EPOS-14: the coordinate axes and the cube diagonals.
+const glm::vec3 kDirs[7] = {
+    glm::vec3(1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, 0, 1),
+    glm::vec3(1, 1, 1), glm::vec3(1, 1, -1), glm::vec3(1, -1, 1), glm::vec3(1, -1, -1),
+};
+
+struct Sphere {
+    glm::dvec3 c = glm::dvec3(0.0);
+    double r = -1.0; // empty
+    bool contains(const glm::dvec3& p) const { return r >= 0.0 && glm::length(p - c) <= r * (1.0 + 1e-9) + 1e-12; }
+};
+
+// Smallest sphere through up to four points on its boundary; degenerate sets fall
+// back to the sphere over their farthest pair.
+Sphere sphere_through(const glm::dvec3* p, int n) {
+    Sphere s;
+    if(n == 0) return s;
+    if(n == 1) { s.c = p[0]; s.r = 0.0; return s; }
+    auto pair = [&](const glm::dvec3& a, const glm::dvec3& b){ Sphere t; t.c = 0.5 * (a + b); t.r = 0.5 * glm::length(b - a); return t; };
+    auto widest_pair = [&](){
+        Sphere best = pair(p[0], p[1]);
+        for(int i=0;i<n;++i) for(int j=i+1;j<n;++j) { Sphere t = pair(p[i], p[j]); if(t.r > best.r) best = t; }
+        return best;
+    };
+    if(n == 2) return pair(p[0], p[1]);
+    glm::dvec3 ab = p[1] - p[0], ac = p[2] - p[0];
+    if(n == 3) {
+        glm::dvec3 nrm = glm::cross(ab, ac);
+        double d = 2.0 * glm::dot(nrm, nrm);
+        if(d <= 1e-24 * glm::dot(ab, ab) * glm::dot(ac, ac)) return widest_pair();
+        glm::dvec3 o = (glm::cross(nrm, ab) * glm::dot(ac, ac) + glm::cross(ac, nrm) * glm::dot(ab, ab)) / d;
+        s.c = p[0] + o; s.r = glm::length(o);
+        return s;
+    }
+    glm::dvec3 ad = p[3] - p[0];
+    double d = 2.0 * glm::dot(ab, glm::cross(ac, ad));
+    if(std::abs(d) <= 1e-12 * glm::length(ab) * glm::length(ac) * glm::length(ad)) return widest_pair();
+    glm::dvec3 o = (glm::cross(ac, ad) * glm::dot(ab, ab) + glm::cross(ad, ab) * glm::dot(ac, ac) + glm::cross(ab, ac) * glm::dot(ad, ad)) / d;
+    s.c = p[0] + o; s.r = glm::length(o);
+    return s;
+}
+
+// Welzl's recursion; only used on the handful of extreme points.
+Sphere welzl(glm::dvec3* pts, int n, glm::dvec3* boundary, int nb) {
+    if(n == 0 || nb == 4) return sphere_through(boundary, nb);
+    Sphere s = welzl(pts, n - 1, boundary, nb);
+    if(s.contains(pts[n-1])) return s;
+    boundary[nb] = pts[n-1];
+    return welzl(pts, n - 1, boundary, nb + 1);
+}
+
+Sphere merge(const Sphere& a, const Sphere& b) {
+    if(a.r < 0.0) return b;
+    if(b.r < 0.0) return a;
+    glm::dvec3 d = b.c - a.c;
+    double dist = glm::length(d);
+    if(dist + b.r <= a.r) return a;
+    if(dist + a.r <= b.r) return b;
+    Sphere s;
+    s.r = 0.5 * (dist + a.r + b.r);
+    s.c = a.c + d * ((s.r - a.r) / dist);
+    return s;
+}
+
+// Eigenvectors of a symmetric 3x3 matrix by cyclic Jacobi rotations (columns of v).
+void jacobi_eigen(double a[3][3], double v[3][3]) {
+    for(int i=0;i<3;++i) for(int j=0;j<3;++j) v[i][j] = i == j ? 1.0 : 0.0;
+    for(int sweep=0; sweep<32; ++sweep) {
+        double off = a[0][1]*a[0][1] + a[0][2]*a[0][2] + a[1][2]*a[1][2];
+        if(off <= 1e-30 * (a[0][0]*a[0][0] + a[1][1]*a[1][1] + a[2][2]*a[2][2]) + 1e-300) break;
+        for(int p=0;p<2;++p) for(int q=p+1;q<3;++q) {
+            if(a[p][q] == 0.0) continue;
+            double theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+            double t = (theta >= 0.0 ? 1.0 : -1.0) / (std::abs(theta) + std::sqrt(theta*theta + 1.0));
+            double c = 1.0 / std::sqrt(t*t + 1.0), s = t * c;
+            for(int k=0;k<3;++k) {
+                double akp = a[k][p], akq = a[k][q];
+                a[k][p] = c*akp - s*akq; a[k][q] = s*akp + c*akq;
+            }
+            for(int k=0;k<3;++k) {
+                double apk = a[p][k], aqk = a[q][k];
+                a[p][k] = c*apk - s*aqk; a[q][k] = s*apk + c*aqk;
+            }
+            for(int k=0;k<3;++k) {
+                double vkp = v[k][p], vkq = v[k][q];
+                v[k][p] = c*vkp - s*vkq; v[k][q] = s*vkp + c*vkq;
+            }
+        }
+    }
+}
+
+struct PassOne {
+    size_t count = 0;
+    glm::vec3 lo = glm::vec3(std::numeric_limits<float>::max());
+    glm::vec3 hi = glm::vec3(-std::numeric_limits<float>::max());
+    glm::dvec3 sum = glm::dvec3(0.0);
+    double xx = 0, xy = 0, xz = 0, yy = 0, yz = 0, zz = 0; // relative to the reference point
+    float ext_lo[7], ext_hi[7];
+    size_t arg_lo[7], arg_hi[7];
+    PassOne() {
+        for(int k=0;k<7;++k) {
+            ext_lo[k] = std::numeric_limits<float>::max(); ext_hi[k] = -std::numeric_limits<float>::max();
+            arg_lo[k] = arg_hi[k] = 0;
+        }
+    }
+};
+
+bool finite(const glm::vec3& p) { return std::isfinite(p.x) && std::isfinite(p.y) && std::isfinite(p.z); }
+
+} // namespace
+
+MeshBounds compute_bounds(const std::vector<glm::vec3>& positions) {
+    auto t0 = std::chrono::steady_clock::now();
+    MeshBounds out;
+    const size_t n = positions.size();
+    size_t first = 0;
+    while(first < n && !finite(positions[first])) ++first;
+    if(first == n) return out;
+    const glm::dvec3 ref(positions[first]);
+
+    // Pass 1: AABB, moments and extreme points, fused.
+    std::vector<PassOne> parts(worker_count());
+    parallel_chunks(n, [&](unsigned c, size_t b, size_t e){
+        PassOne &r = parts[c];
+        for(size_t i=b;i<e;++i) {
+            const glm::vec3 p = positions[i];
+            if(!finite(p)) continue;
+            ++r.count;
+            r.lo = glm::min(r.lo, p);
+            r.hi = glm::max(r.hi, p);
+            glm::dvec3 d = glm::dvec3(p) - ref;
+            r.sum += d;
+            r.xx += d.x*d.x; r.xy += d.x*d.y; r.xz += d.x*d.z;
+            r.yy += d.y*d.y; r.yz += d.y*d.z; r.zz += d.z*d.z;
+            for(int k=0;k<7;++k) {
+                float s = glm::dot(p, kDirs[k]);
+                if(s < r.ext_lo[k]) { r.ext_lo[k] = s; r.arg_lo[k] = i; }
+                if(s > r.ext_hi[k]) { r.ext_hi[k] = s; r.arg_hi[k] = i; }
+            }
+        }
+    });
+    PassOne all;
+    for(const PassOne &r: parts) {
+        if(r.count == 0) continue;
+        all.count += r.count;
+        all.lo = glm::min(all.lo, r.lo); all.hi = glm::max(all.hi, r.hi);
+        all.sum += r.sum;
+        all.xx += r.xx; all.xy += r.xy; all.xz += r.xz; all.yy += r.yy; all.yz += r.yz; all.zz += r.zz;
+        for(int k=0;k<7;++k) {
+            if(r.ext_lo[k] < all.ext_lo[k]) { all.ext_lo[k] = r.ext_lo[k]; all.arg_lo[k] = r.arg_lo[k]; }
+            if(r.ext_hi[k] > all.ext_hi[k]) { all.ext_hi[k] = r.ext_hi[k]; all.arg_hi[k] = r.arg_hi[k]; }
+        }
+    }
+    out.box.lo = all.lo;
+    out.box.hi = all.hi;
+    const glm::dvec3 mean = all.sum / (double)all.count;
+    out.centroid = glm::vec3(ref + mean);
+
+    // Principal axes of the covariance.
+    double inv = 1.0 / (double)all.count;
+    double cov[3][3] = {
+        { all.xx*inv - mean.x*mean.x, all.xy*inv - mean.x*mean.y, all.xz*inv - mean.x*mean.z },
+        { all.xy*inv - mean.x*mean.y, all.yy*inv - mean.y*mean.y, all.yz*inv - mean.y*mean.z },
+        { all.xz*inv - mean.x*mean.z, all.yz*inv - mean.y*mean.z, all.zz*inv - mean.z*mean.z },
+    };
+    double vec[3][3];
+    jacobi_eigen(cov, vec);
+    glm::vec3 axis[3];
+    for(int k=0;k<3;++k) axis[k] = glm::normalize(glm::vec3((float)vec[0][k], (float)vec[1][k], (float)vec[2][k]));
+    axis[2] = glm::normalize(glm::cross(axis[0], axis[1]));
+    axis[1] = glm::cross(axis[2], axis[0]);
+
+    // Seed sphere: exact minimal sphere of the 14 extreme points.
+    glm::dvec3 extremes[14], boundary[4];
+    for(int k=0;k<7;++k) {
+        extremes[2*k] = glm::dvec3(positions[all.arg_lo[k]]);
+        extremes[2*k+1] = glm::dvec3(positions[all.arg_hi[k]]);
+    }
+    const Sphere seed = welzl(extremes, 14, boundary, 0);
+
+    // Pass 2: Ritter growth per chunk (merged afterwards), OBB extents and centroid radius.
+    struct PassTwo {
+        Sphere sphere;
+        glm::vec3 lo = glm::vec3(std::numeric_limits<float>::max()), hi = glm::vec3(-std::numeric_limits<float>::max());
+        float centroid_d2 = 0.0f;
+    };
+    std::vector<PassTwo> grown(worker_count());
+    parallel_chunks(n, [&](unsigned c, size_t b, size_t e){
+        PassTwo &r = grown[c];
+        r.sphere = seed;
+        double r2 = seed.r * seed.r;
+        for(size_t i=b;i<e;++i) {
+            const glm::vec3 p = positions[i];
+            if(!finite(p)) continue;
+            glm::dvec3 d = glm::dvec3(p) - r.sphere.c;
+            double d2 = glm::dot(d, d);
+            if(d2 > r2) {
+                double dist = std::sqrt(d2);
+                double nr = 0.5 * (r.sphere.r + dist);
+                r.sphere.c += d * ((dist - nr) / dist);
+                r.sphere.r = nr;
+                r2 = nr * nr;
+            }
+            glm::vec3 q(glm::dot(p, axis[0]), glm::dot(p, axis[1]), glm::dot(p, axis[2]));
+            r.lo = glm::min(r.lo, q);
+            r.hi = glm::max(r.hi, q);
+            glm::vec3 dc = p - out.centroid;
+            r.centroid_d2 = std::max(r.centroid_d2, glm::dot(dc, dc));
+        }
+    });
+    Sphere sphere = seed;
+    glm::vec3 qlo(std::numeric_limits<float>::max()), qhi(-std::numeric_limits<float>::max());
+    float centroid_d2 = 0.0f;
+    for(const PassTwo &r: grown) {
+        if(r.sphere.r < 0.0 || r.lo.x > r.hi.x) continue;
+        sphere = merge(sphere, r.sphere);
+        qlo = glm::min(qlo, r.lo); qhi = glm::max(qhi, r.hi);
+        centroid_d2 = std::max(centroid_d2, r.centroid_d2);
+    }
+    out.sphere.center = glm::vec3(sphere.c);
+    // Pad for the float rounding of the center.
+    out.sphere.radius = (float)sphere.r * (1.0f + 1e-6f) + glm::length(out.sphere.center) * 1e-6f;
+    out.centroid_radius = std::sqrt(centroid_d2);
+    for(int k=0;k<3;++k) out.obb.axis[k] = axis[k];
+    glm::vec3 mid = 0.5f * (qlo + qhi);
+    out.obb.center = axis[0] * mid.x + axis[1] * mid.y + axis[2] * mid.z;
+    out.obb.half_extent = 0.5f * (qhi - qlo);
+    // A PCA box can come out larger than the AABB (e.g. for cubes); keep the smaller one.
+    if(out.obb.volume() > out.box.volume()) {
+        out.obb = Obb();
+        out.obb.center = out.box.center();
+        out.obb.half_extent = out.box.half_extent();
+    }
+    out.valid = true;
+    out.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    return out;
+}
@@ -0,0 +1,80 @@
+#pragma once
+// Bounding volumes for camera framing, depth range and culling.
+//
+// A first parallel pass gathers the AABB, the extreme points along seven directions
+// and the covariance. The exact minimal sphere of those fourteen points (Welzl)
+// seeds the sphere (Larsson's EPOS-14). A second pass then grows it Ritter-style
+// over all points and measures the extents along the PCA axes for the OBB.
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+struct Aabb {
+    glm::vec3 lo = glm::vec3(0.0f), hi = glm::vec3(0.0f);
+    glm::vec3 center() const { return 0.5f * (lo + hi); }
+    glm::vec3 half_extent() const { return 0.5f * (hi - lo); }
+    float volume() const { glm::vec3 d = hi - lo; return d.x * d.y * d.z; }
+};
+
+struct BoundingSphere {
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = 0.0f;
+};
+
+struct Obb {
+    glm::vec3 center = glm::vec3(0.0f);
+    glm::vec3 axis[3] = { glm::vec3(1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, 0, 1) }; // right-handed
+    glm::vec3 half_extent = glm::vec3(0.0f);
+    float volume() const { return 8.0f * half_extent.x * half_extent.y * half_extent.z; }
+};
+
+struct MeshBounds {
+    bool valid = false;          // false when there is no finite position
+    Aabb box;
+    BoundingSphere sphere;
+    Obb obb;
+    glm::vec3 centroid = glm::vec3(0.0f);
+    float centroid_radius = 0.0f; // max distance from the centroid, for comparison
+    double ms = 0.0;
+};
+
+// Non-finite positions are ignored.
+MeshBounds compute_bounds(const std::vector<glm::vec3>& positions);
+
+// Camera distance at which a sphere of `radius` fits a perspective view with vertical
+// field of view `fov_y` (radians) and `aspect`, leaving `margin` around it.
+inline float framing_distance(float radius, float fov_y, float aspect, float margin = 1.1f) {
+    float half = 0.5f * fov_y;
+    if(aspect < 1.0f) half = std::atan(std::tan(half) * aspect);
+    return margin * radius / std::sin(half);
+}
+
+// Tightest near/far planes enclosing a sphere whose center is `distance` in front of the
+// camera. Near is clamped to `min_near` (a fraction of the radius) once the camera is inside.
+inline void sphere_depth_range(float distance, float radius, float& z_near, float& z_far, float min_near = 1e-3f) {
+    z_near = std::max(distance - radius * 1.01f, radius * min_near);
+    z_far = distance + radius * 1.01f;
+}
+
+// The six planes (xyz, w) of the frustum of `clip` (projection * view [* model]), with unit
+// normals pointing inwards, so dot(xyz, p) + w is a signed distance.
+inline void frustum_planes(const glm::mat4& clip, glm::vec4 planes[6]) {
+    for(int row=0; row<3; ++row) {
+        for(int side=0; side<2; ++side) {
+            float sign = side ? -1.0f : 1.0f;
+            glm::vec4 p(clip[0][3] + sign * clip[0][row], clip[1][3] + sign * clip[1][row],
+                        clip[2][3] + sign * clip[2][row], clip[3][3] + sign * clip[3][row]);
+            float len = std::sqrt(p.x * p.x + p.y * p.y + p.z * p.z);
+            planes[2*row + side] = len > 0.0f ? p / len : p;
+        }
+    }
+}
+
+// False only when the sphere is wholly outside one of the planes.
+inline bool sphere_in_frustum(const glm::vec4 planes[6], const glm::vec3& center, float radius) {
+    for(int i=0;i<6;++i) if(glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius) return false;
+    return true;
+}
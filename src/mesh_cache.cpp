@@ -0,0 +1,171 @@
+#include "mesh_cache.h"
+#include "mesh_codec.h"
+#include "mesh_clean.h"
+#include "smf_io.h"
+
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+#include <cstring>
+#include <cstdio>
+
+namespace {
+
+const char kCacheDir[] = "cache";
+const uint32_t kMeshMagic = 0x434D4653; // "SFMC"
+const uint32_t kMeshVersion = 1;
+const uint32_t kPackedMagic = 0x5A434653; // "SFCZ"
+
+struct MeshHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    uint64_t vertex_count;
+    uint64_t face_count;
+};
+
+inline uint64_t mix64(uint64_t h) {
+    h ^= h >> 33; h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33; h *= 0xC4CEB9FE1A85EC53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+} // namespace
+
+uint64_t hash_bytes(const void* data, size_t size, uint64_t seed) {
+    const unsigned char* p = (const unsigned char*)data;
+    uint64_t h = mix64(seed ^ (size * 0x9E3779B97F4A7C15ull));
+    size_t i = 0;
+    for(; i + 8 <= size; i += 8) {
+        uint64_t w; std::memcpy(&w, p + i, 8);
+        h = (h ^ mix64(w)) * 0x9E3779B97F4A7C15ull + 0x632BE59BD9B4E019ull;
+    }
+    uint64_t tail = 0;
+    for(size_t k=0; i + k < size; ++k) tail |= (uint64_t)p[i + k] << (8*k);
+    return mix64(h ^ mix64(tail));
+}
+
+int64_t stream_bytes_left(std::istream& in) {
+    std::streamoff pos = in.tellg();
+    if(pos < 0 || !in.seekg(0, std::ios::end)) return -1;
+    std::streamoff end = in.tellg();
+    in.seekg(pos);
+    return (!in || end < pos) ? -1 : (int64_t)(end - pos);
+}
+
+bool mesh_cache_key(const std::string& source_path, const std::string& options, uint64_t& key) {
+    std::ifstream in(source_path, std::ios::binary);
+    if(!in) return false;
+    uint64_t h = hash_bytes(options.data(), options.size());
+    std::vector<char> buf(1 << 20);
+    while(in) {
+        in.read(buf.data(), (std::streamsize)buf.size());
+        std::streamsize got = in.gcount();
+        if(got <= 0) break;
+        h = hash_bytes(buf.data(), (size_t)got, h);
+    }
+    key = h;
+    return true;
+}
+
+std::string mesh_cache_path(uint64_t key, const char* extension) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+    return std::string(kCacheDir) + "/" + name + extension;
+}
+
+const char* mesh_cache_extension(int compress_bits) {
+    return compress_bits > 0 ? ".meshz" : ".mesh";
+}
+
+bool load_cached_mesh(uint64_t key, std::vector<glm::vec3>& positions, std::vector<glm::ivec3>& faces, int compress_bits) {
+    std::ifstream in(mesh_cache_path(key, mesh_cache_extension(compress_bits)), std::ios::binary);
+    if(!in) return false;
+    MeshHeader h;
+    if(!in.read((char*)&h, sizeof(h)) || h.version != kMeshVersion || h.key != key) return false;
+    const int64_t left = stream_bytes_left(in);
+    if(left < 0) return false;
+    if(compress_bits > 0) {
+        if(h.magic != kPackedMagic) return false;
+        std::vector<uint8_t> packed((size_t)left);
+        if(!in.read((char*)packed.data(), (std::streamsize)packed.size())) return false;
+        if(!decode_mesh(packed.data(), packed.size(), positions, faces)
+           || positions.size() != h.vertex_count || faces.size() != h.face_count) { positions.clear(); faces.clear(); return false; }
+        return !positions.empty() && !faces.empty();
+    }
+    if(h.magic != kMeshMagic || h.vertex_count > (uint64_t)left / sizeof(glm::vec3)
+       || h.face_count != ((uint64_t)left - h.vertex_count * sizeof(glm::vec3)) / sizeof(glm::ivec3)) return false;
+    positions.resize(h.vertex_count);
+    faces.resize(h.face_count);
+    in.read((char*)positions.data(), (std::streamsize)(positions.size()*sizeof(glm::vec3)));
+    in.read((char*)faces.data(), (std::streamsize)(faces.size()*sizeof(glm::ivec3)));
+    if(!in) { positions.clear(); faces.clear(); return false; }
+    return !positions.empty() && !faces.empty();
+}
+
+bool save_cached_mesh(uint64_t key, const std::vector<glm::vec3>& positions, const std::vector<glm::ivec3>& faces,
+                      int compress_bits) {
+    std::vector<uint8_t> packed;
+    if(compress_bits > 0) {
+        MeshCodecOptions options;
+        options.position_bits = compress_bits;
+        if(!encode_mesh(positions, faces, options, packed)) {
+            std::cerr << "Cannot compress mesh cache (" << compress_bits << " bits)" << std::endl;
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::create_directories(kCacheDir, ec);
+    std::string path = mesh_cache_path(key, mesh_cache_extension(compress_bits));
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if(!out) { std::cerr << "Cannot write mesh cache: " << tmp << std::endl; return false; }
+        MeshHeader h = { compress_bits > 0 ? kPackedMagic : kMeshMagic, kMeshVersion, key, positions.size(), faces.size() };
+        out.write((const char*)&h, sizeof(h));
+        if(compress_bits > 0) {
+            out.write((const char*)packed.data(), (std::streamsize)packed.size());
+        } else {
+            out.write((const char*)positions.data(), (std::streamsize)(positions.size()*sizeof(glm::vec3)));
+            out.write((const char*)faces.data(), (std::streamsize)(faces.size()*sizeof(glm::ivec3)));
+        }
+        if(!out) { std::cerr << "Cannot write mesh cache: " << tmp << std::endl; return false; }
+    }
+    // Rename so a concurrent reader never sees a partially written file.
+    std::filesystem::rename(tmp, path, ec);
+    return !ec;
+}
+
+std::string mesh_prepare_key(const MeshPrepareOptions& options) {
+    std::string key = "v1";
+    if(options.weld) key += ";weld=" + std::to_string(options.weld_epsilon);
+    if(options.clean) key += ";clean";
+    if(options.compress_bits > 0) key += ";z" + std::to_string(options.compress_bits);
+    return key;
+}
+
+bool load_prepared_mesh(const std::string& path, const MeshPrepareOptions& options,
+                        std::vector<glm::vec3>& positions, std::vector<glm::ivec3>& faces) {
+    uint64_t key = 0;
+    bool cacheable = options.clean && options.use_cache && mesh_cache_key(path, mesh_prepare_key(options), key);
+    if(cacheable && load_cached_mesh(key, positions, faces, options.compress_bits)) {
+        std::cout << "Mesh cache hit: " << mesh_cache_path(key, mesh_cache_extension(options.compress_bits)) << "\n";
+        return true;
+    }
+
+    if(!load_smf(path, positions, faces)) return false;
+    if(options.weld) {
+        WeldStats ws = weld_vertices(positions, faces, options.weld_epsilon);
+        std::cout << "Weld: merged " << ws.merged << " of " << ws.input_vertices << " vertices (eps " << ws.epsilon << ", " << ws.ms << " ms)\n";
+    }
+    if(options.clean) {
+        CleanStats cs = clean_faces(positions, faces);
+        std::cout << "Clean: removed " << cs.removed() << " of " << cs.input_faces << " faces ("
+                  << cs.invalid << " invalid, " << cs.degenerate << " degenerate, " << cs.duplicate << " duplicate, "
+                  << cs.flipped_duplicate << " opposite-wound duplicate; " << cs.ms << " ms)\n";
+        if(faces.empty()) { std::cerr << "No faces left after cleaning\n"; return false; }
+    }
+    if(cacheable) save_cached_mesh(key, positions, faces, options.compress_bits);
+    return true;
+}
@@ -0,0 +1,49 @@
+#pragma once
+// On-disk cache of load results (positions + faces after the clean-up passes),
+// stored as cache/<key>.mesh, or compressed with mesh_codec as cache/<key>.meshz.
+// The key hashes the source file contents together with a string describing the
+// passes that produced the data.
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <string>
+#include <iosfwd>
+#include <cstdint>
+#include <cstddef>
+
+uint64_t hash_bytes(const void* data, size_t size, uint64_t seed = 0);
+
+// Bytes from the read position of `in` to the end of the file, leaving the position where
+// it was; -1 on failure. Loaders check the sizes their headers claim against it before
+// allocating, so a corrupt header cannot request an arbitrary amount of memory.
+int64_t stream_bytes_left(std::istream& in);
+
+// False if the source file cannot be read.
+bool mesh_cache_key(const std::string& source_path, const std::string& options, uint64_t& key);
+std::string mesh_cache_path(uint64_t key, const char* extension = ".mesh");
+
+// `compress_bits` > 0 selects the compressed file, with positions quantised to that
+// many bits per axis (lossy; include it in the key options).
+const char* mesh_cache_extension(int compress_bits);
+bool load_cached_mesh(uint64_t key, std::vector<glm::vec3>& positions, std::vector<glm::ivec3>& faces, int compress_bits = 0);
+bool save_cached_mesh(uint64_t key, const std::vector<glm::vec3>& positions, const std::vector<glm::ivec3>& faces,
+                      int compress_bits = 0);
+
+// The load-time passes run by load_prepared_mesh.
+struct MeshPrepareOptions {
+    bool weld = false;
+    float weld_epsilon = 0.0f; // <= 0: derived from the bounding box
+    bool clean = false;
+    bool use_cache = true;     // only cleaned meshes are cached
+    int compress_bits = 0;     // > 0: compressed cache entry, see mesh_cache_extension
+};
+
+// Cache key options describing the passes; extend it for data derived from the result.
+std::string mesh_prepare_key(const MeshPrepareOptions& options);
+
+// Loads the SMF at `path` and runs the enabled passes, printing their statistics.
+// Cleaned results are read from and written to the cache. False if the file cannot be
+// read or cleaning leaves no faces.
+bool load_prepared_mesh(const std::string& path, const MeshPrepareOptions& options,
+                        std::vector<glm::vec3>& positions, std::vector<glm::ivec3>& faces);
@@ -0,0 +1,396 @@
+#include "mesh_clean.h"
+#include "parallel.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+
+namespace {
+
+double ms_since(std::chrono::steady_clock::time_point t0) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+inline uint32_t hash_cell(int64_t x, int64_t y, int64_t z) {
+    uint64_t h = (uint64_t)x * 0x9E3779B97F4A7C15ull ^ (uint64_t)y * 0xC2B2AE3D27D4EB4Full ^ (uint64_t)z * 0x165667B19E3779F9ull;
+    h ^= h >> 31; h *= 0xBF58476D1CE4E5B9ull; h ^= h >> 32;
+    return (uint32_t)h;
+}
+
+// Open-addressed map from a cell hash to the start of its run in the sorted
+// (hash, vertex) array. Entries pack (hash << 32 | start) so probes never touch the array.
+struct CellTable {
+    static constexpr uint64_t kEmpty = ~0ull;
+    std::unique_ptr<std::atomic<uint64_t>[]> slots;
+    size_t mask = 0;
+
+    explicit CellTable(size_t cells) {
+        size_t cap = 16;
+        while(cap < cells + cells/2) cap <<= 1;
+        mask = cap - 1;
+        slots.reset(new std::atomic<uint64_t>[cap]);
+        parallel_for(cap, [&](size_t i){ slots[i].store(kEmpty, std::memory_order_relaxed); });
+    }
+    void insert(uint32_t h, uint32_t start) {
+        const uint64_t entry = ((uint64_t)h << 32) | start;
+        for(size_t s = h & mask;; s = (s + 1) & mask) {
+            uint64_t cur = kEmpty;
+            if(slots[s].compare_exchange_strong(cur, entry, std::memory_order_relaxed)) return;
+        }
+    }
+    int64_t find(uint32_t h) const {
+        for(size_t s = h & mask;; s = (s + 1) & mask) {
+            uint64_t e = slots[s].load(std::memory_order_relaxed);
+            if(e == kEmpty) return -1;
+            if((uint32_t)(e >> 32) == h) return (int64_t)(uint32_t)e;
+        }
+    }
+};
+
+} // namespace
+
+WeldStats weld_vertices(std::vector<glm::vec3>& positions, std::vector<glm::ivec3>& faces, float epsilon) {
+    auto t0 = std::chrono::steady_clock::now();
+    WeldStats st;
+    const size_t n = positions.size();
+    st.input_vertices = n;
+    if(n < 2 || n >= 0xFFFFFFFFu) return st;
+
+    auto finite = [](const glm::vec3& p){ return std::isfinite(p.x) && std::isfinite(p.y) && std::isfinite(p.z); };
+    if(epsilon <= 0.0f) {
+        glm::vec3 lo(0.0f), hi(0.0f);
+        bool any = false;
+        for(auto &p: positions) {
+            if(!finite(p)) continue;
+            lo = any ? glm::min(lo, p) : p;
+            hi = any ? glm::max(hi, p) : p;
+            any = true;
+        }
+        double diagonal = glm::length(glm::dvec3(hi) - glm::dvec3(lo));
+        epsilon = (float)std::min(std::max(1e-6 * diagonal, 1e-12), (double)std::numeric_limits<float>::max());
+    }
+    st.epsilon = epsilon;
+
+    // Cells are 4*eps wide, so a vertex only needs a neighbour cell along an axis when it
+    // lies within eps of that face: on average ~3.4 cell probes instead of 27.
+    const float inv = 1.0f / (4.0f * epsilon);
+    const float eps2 = epsilon * epsilon;
+
+    // Non-finite positions, and cells too far out for int64, are never welded: casting
+    // them is undefined. They are hashed as cell 0 but skipped when scanning.
+    auto hashable = [&](const glm::vec3& p){
+        glm::vec3 s = p * inv;
+        return finite(s) && std::abs(s.x) < 4e18f && std::abs(s.y) < 4e18f && std::abs(s.z) < 4e18f;
+    };
+    std::vector<uint64_t> items(n);
+    parallel_for(n, [&](size_t i){
+        glm::vec3 g = hashable(positions[i]) ? glm::floor(positions[i] * inv) : glm::vec3(0.0f);
+        items[i] = ((uint64_t)hash_cell((int64_t)g.x, (int64_t)g.y, (int64_t)g.z) << 32) | (uint64_t)i;
+    });
+    // Stable, so each run of equal hashes stays in ascending vertex order.
+    parallel_radix_sort(items, [](uint64_t v){ return v >> 32; }, 32);
+
+    auto run_start = [&](size_t k){ return k == 0 || (items[k] >> 32) != (items[k-1] >> 32); };
+    std::vector<size_t> run_counts(worker_count(), 0);
+    parallel_chunks(n, [&](unsigned c, size_t b, size_t e){
+        size_t cnt = 0;
+        for(size_t k=b;k<e;++k) cnt += run_start(k);
+        run_counts[c] = cnt;
+    });
+    size_t runs = 0;
+    for(size_t c: run_counts) runs += c;
+
+    CellTable table(runs);
+    parallel_for(n, [&](size_t k){ if(run_start(k)) table.insert((uint32_t)(items[k] >> 32), (uint32_t)k); });
+
+    // Positions in sorted order, so scanning a cell run reads contiguous memory.
+    std::vector<glm::vec3> sorted_pos(n);
+    parallel_for(n, [&](size_t k){ sorted_pos[k] = positions[(uint32_t)items[k]]; });
+
+    // rep[i] = lowest vertex index within epsilon of i (possibly i itself). Runs are in
+    // ascending vertex order, so a scan stops at its first match or at the first index
+    // that could not improve on `best`: a cell of k duplicates costs O(k), not O(k^2).
+    std::vector<uint32_t> rep(n);
+    parallel_for(n, [&](size_t k){
+        const uint32_t i = (uint32_t)items[k];
+        const uint32_t own = (uint32_t)(items[k] >> 32);
+        const glm::vec3 p = sorted_pos[k];
+        uint32_t best = i;
+        if(!hashable(p)) { rep[i] = i; return; }
+        auto scan = [&](size_t q, uint32_t h){
+            for(; q<n && (uint32_t)(items[q] >> 32) == h; ++q) {
+                uint32_t j = (uint32_t)items[q];
+                if(j >= best) return;
+                glm::vec3 d = sorted_pos[q] - p;
+                if(glm::dot(d, d) < eps2) { best = j; return; }
+            }
+        };
+        scan((size_t)table.find(own), own);
+
+        glm::vec3 s = p * inv;
+        glm::vec3 g = glm::floor(s);
+        glm::vec3 f = s - g;
+        auto side = [](float t) -> int64_t { return t < 0.25f ? -1 : (t > 0.75f ? 1 : 0); };
+        int64_t dx = side(f.x), dy = side(f.y), dz = side(f.z);
+        int64_t gx = (int64_t)g.x, gy = (int64_t)g.y, gz = (int64_t)g.z;
+        for(int m=1;m<8;++m) {
+            if(((m & 1) && !dx) || ((m & 2) && !dy) || ((m & 4) && !dz)) continue;
+            uint32_t h = hash_cell(gx + ((m & 1) ? dx : 0), gy + ((m & 2) ? dy : 0), gz + ((m & 4) ? dz : 0));
+            int64_t start = table.find(h);
+            if(start >= 0) scan((size_t)start, h);
+        }
+        rep[i] = best;
+    });
+    std::vector<uint64_t>().swap(items);
+    std::vector<glm::vec3>().swap(sorted_pos);
+
+    // rep[i] <= i, so one ascending pass collapses chains to their root and numbers the survivors.
+    std::vector<int> remap(n);
+    int out = 0;
+    for(size_t i=0;i<n;++i) {
+        uint32_t r = rep[rep[i]];
+        rep[i] = r;
+        remap[i] = (r == i) ? out++ : remap[r];
+    }
+
+    std::vector<glm::vec3> compact((size_t)out);
+    parallel_for(n, [&](size_t i){ if(rep[i] == i) compact[remap[i]] = positions[i]; });
+    positions.swap(compact);
+
+    parallel_for(faces.size(), [&](size_t fi){
+        glm::ivec3 &f = faces[fi];
+        for(int c=0;c<3;++c) f[c] = (f[c] >= 0 && (size_t)f[c] < n) ? remap[f[c]] : -1;
+    });
+
+    st.merged = n - (size_t)out;
+    st.ms = ms_since(t0);
+    return st;
+}
+
+namespace {
+
+// Keeps faces[i] where keep[i] != 0, preserving order (parallel count, prefix, scatter).
+void compact_faces(std::vector<glm::ivec3>& faces, const std::vector<uint8_t>& keep) {
+    const size_t n = faces.size();
+    std::vector<size_t> offsets(worker_count() + 1, 0);
+    parallel_chunks(n, [&](unsigned c, size_t b, size_t e){
+        size_t cnt = 0;
+        for(size_t i=b;i<e;++i) cnt += keep[i];
+        offsets[c + 1] = cnt;
+    });
+    for(size_t c=1;c<offsets.size();++c) offsets[c] += offsets[c-1];
+    std::vector<glm::ivec3> out(offsets.back());
+    parallel_chunks(n, [&](unsigned c, size_t b, size_t e){
+        size_t o = offsets[c];
+        for(size_t i=b;i<e;++i) if(keep[i]) out[o++] = faces[i];
+    });
+    faces.swap(out);
+}
+
+struct FaceKey {
+    uint32_t a, b, c; // sorted vertex indices
+    uint32_t face;    // original index << 1 | winding parity
+};
+
+} // namespace
+
+CleanStats clean_faces(const std::vector<glm::vec3>& positions, std::vector<glm::ivec3>& faces) {
+    auto t0 = std::chrono::steady_clock::now();
+    CleanStats st;
+    const size_t n = faces.size();
+    st.input_faces = n;
+    if(n == 0 || n >= 0x7FFFFFFFu) return st;
+    const size_t nv = positions.size();
+
+    // 0 = keep, 1 = invalid, 2 = degenerate, 3 = duplicate, 4 = flipped duplicate
+    std::vector<uint8_t> reason(n, 0);
+    parallel_for(n, [&](size_t i){
+        const glm::ivec3 f = faces[i];
+        if(f.x < 0 || f.y < 0 || f.z < 0 || (size_t)f.x >= nv || (size_t)f.y >= nv || (size_t)f.z >= nv) { reason[i] = 1; return; }
+        if(f.x == f.y || f.y == f.z || f.x == f.z) { reason[i] = 2; return; }
+        glm::vec3 e0 = positions[f.y] - positions[f.x];
+        glm::vec3 e1 = positions[f.z] - positions[f.x];
+        glm::vec3 e2 = positions[f.z] - positions[f.y];
+        glm::vec3 cr = glm::cross(e0, e1);
+        float longest = std::max(glm::dot(e0, e0), std::max(glm::dot(e1, e1), glm::dot(e2, e2)));
+        // |cross| / longest^2 is the height-to-length ratio; NaN compares false and is dropped too.
+        if(!(glm::dot(cr, cr) > 1e-14f * longest * longest)) reason[i] = 2;
+    });
+
+    // Group identical vertex triples with an LSD radix sort over (c, b, a).
+    std::vector<FaceKey> keys;
+    keys.reserve(n);
+    for(size_t i=0;i<n;++i) {
+        if(reason[i]) continue;
+        uint32_t v[3] = { (uint32_t)faces[i].x, (uint32_t)faces[i].y, (uint32_t)faces[i].z };
+        // The winding is even when the smallest index is followed by the middle one.
+        int m = (v[0] < v[1]) ? (v[0] < v[2] ? 0 : 2) : (v[1] < v[2] ? 1 : 2);
+        uint32_t next = v[(m + 1) % 3], prev = v[(m + 2) % 3];
+        uint32_t parity = next < prev ? 0u : 1u;
+        keys.push_back({ v[m], std::min(next, prev), std::max(next, prev), (uint32_t)(i << 1) | parity });
+    }
+    int bits = 8;
+    while(bits < 32 && (nv >> bits)) bits += 8;
+    parallel_radix_sort(keys, [](const FaceKey& k){ return (uint64_t)k.c; }, bits);
+    parallel_radix_sort(keys, [](const FaceKey& k){ return (uint64_t)k.b; }, bits);
+    parallel_radix_sort(keys, [](const FaceKey& k){ return (uint64_t)k.a; }, bits);
+
+    // Stable sorts keep the earliest face first in each run; later ones are dropped.
+    // Each chunk finds the start of the run it begins in once, then carries it forward.
+    auto same = [&](size_t x, size_t y){ return keys[x].a == keys[y].a && keys[x].b == keys[y].b && keys[x].c == keys[y].c; };
+    parallel_chunks(keys.size(), [&](unsigned, size_t b, size_t e){
+        size_t first = b;
+        while(first > 0 && same(first, first-1)) --first;
+        for(size_t k=b;k<e;++k) {
+            if(k != b && !same(k, k-1)) first = k;
+            if(k != first) reason[keys[k].face >> 1] = ((keys[k].face ^ keys[first].face) & 1u) ? 4 : 3;
+        }
+    });
+
+    std::vector<size_t> counts(5, 0);
+    for(uint8_t r: reason) counts[r]++;
+    st.invalid = counts[1]; st.degenerate = counts[2]; st.duplicate = counts[3]; st.flipped_duplicate = counts[4];
+
+    std::vector<uint8_t> keep(n);
+    parallel_for(n, [&](size_t i){ keep[i] = reason[i] == 0; });
+    compact_faces(faces, keep);
+    st.ms = ms_since(t0);
+    return st;
+}
+
+namespace {
+
+struct EdgeRef {
+    uint32_t lo, hi;  // undirected edge, lo < hi
+    uint32_t face;    // face index << 1 | 1 when the face walks the edge lo -> hi
+};
+
+} // namespace
+
+OrientStats orient_faces(const std::vector<glm::vec3>& positions, std::vector<glm::ivec3>& faces) {
+    auto t0 = std::chrono::steady_clock::now();
+    OrientStats st;
+    const size_t n = faces.size();
+    const size_t nv = positions.size();
+    if(n == 0 || n >= 0x7FFFFFFFu) return st;
+
+    // Faces with bad indices are skipped entirely (they have no edges).
+    auto valid = [&](const glm::ivec3& f){
+        return f.x >= 0 && f.y >= 0 && f.z >= 0 && (size_t)f.x < nv && (size_t)f.y < nv && (size_t)f.z < nv;
+    };
+    // Edges of invalid faces get the out-of-range vertex nv, so they sort last and link nothing.
+    const uint32_t kNone = (uint32_t)nv;
+    std::vector<EdgeRef> edges(3*n);
+    parallel_for(n, [&](size_t i){
+        const glm::ivec3 f = faces[i];
+        for(int k=0;k<3;++k) {
+            uint32_t a = (uint32_t)f[k], b = (uint32_t)f[(k+1)%3];
+            if(!valid(f)) { edges[3*i+k] = { kNone, kNone, (uint32_t)(i << 1) }; continue; }
+            edges[3*i+k] = { std::min(a, b), std::max(a, b), (uint32_t)(i << 1) | (a < b ? 1u : 0u) };
+        }
+    });
+    int bits = 8;
+    while(bits < 32 && (nv >> bits)) bits += 8;
+    parallel_radix_sort(edges, [](const EdgeRef& e){ return (uint64_t)e.hi; }, bits);
+    parallel_radix_sort(edges, [](const EdgeRef& e){ return (uint64_t)e.lo; }, bits);
+
+    // Face adjacency in CSR form across manifold edges. `flip` on a link is set when the two
+    // faces traverse the shared edge in the same direction, i.e. their windings disagree.
+    std::vector<uint32_t> degree(n + 1, 0);
+    std::vector<uint8_t> open_face(n, 0);
+    struct Link { uint32_t a, b; uint8_t flip; };
+    std::vector<Link> links;
+    links.reserve(3*n/2);
+    for(size_t k=0;k<edges.size();) {
+        size_t e = k + 1;
+        while(e < edges.size() && edges[e].lo == edges[k].lo && edges[e].hi == edges[k].hi) ++e;
+        if(edges[k].lo != kNone) {
+            size_t count = e - k;
+            if(count == 2) {
+                uint32_t fa = edges[k].face >> 1, fb = edges[k+1].face >> 1;
+                uint8_t same = ((edges[k].face ^ edges[k+1].face) & 1u) == 0;
+                links.push_back({ fa, fb, same });
+                degree[fa]++; degree[fb]++;
+            } else {
+                if(count == 1) st.boundary_edges++; else st.nonmanifold_edges++;
+                for(size_t q=k;q<e;++q) open_face[edges[q].face >> 1] = 1;
+            }
+        } else {
+            for(size_t q=k;q<e;++q) open_face[edges[q].face >> 1] = 1;
+        }
+        k = e;
+    }
+    std::vector<EdgeRef>().swap(edges);
+
+    std::vector<uint32_t> start(n + 1, 0);
+    for(size_t i=0;i<n;++i) start[i+1] = start[i] + degree[i];
+    std::vector<uint32_t> adj(start[n]);
+    std::vector<uint8_t> adj_flip(start[n]);
+    std::vector<uint32_t> fill(start.begin(), start.end() - 1);
+    for(const Link &l: links) {
+        adj[fill[l.a]] = l.b; adj_flip[fill[l.a]++] = l.flip;
+        adj[fill[l.b]] = l.a; adj_flip[fill[l.b]++] = l.flip;
+    }
+    std::vector<Link>().swap(links);
+
+    // BFS per component: flip[g] = flip[f] ^ link.flip keeps every shared edge opposed.
+    const uint32_t kUnvisited = 0xFFFFFFFFu;
+    std::vector<uint32_t> component(n, kUnvisited);
+    std::vector<uint8_t> flip(n, 0);
+    std::vector<uint8_t> comp_open;
+    std::vector<uint32_t> queue;
+    queue.reserve(n);
+    for(size_t seed=0; seed<n; ++seed) {
+        if(component[seed] != kUnvisited || !valid(faces[seed])) continue;
+        uint32_t c = (uint32_t)comp_open.size();
+        comp_open.push_back(0);
+        component[seed] = c;
+        queue.clear();
+        queue.push_back((uint32_t)seed);
+        for(size_t qi=0; qi<queue.size(); ++qi) {
+            uint32_t f = queue[qi];
+            comp_open[c] |= open_face[f];
+            for(uint32_t k=start[f]; k<start[f+1]; ++k) {
+                uint32_t g = adj[k];
+                uint8_t want = flip[f] ^ adj_flip[k];
+                if(component[g] == kUnvisited) {
+                    component[g] = c; flip[g] = want;
+                    queue.push_back(g);
+                } else if(flip[g] != want) {
+                    st.conflicts++; // each inconsistent link is seen from both sides
+                    comp_open[c] = 1;
+                }
+            }
+        }
+    }
+    st.conflicts /= 2;
+    st.components = comp_open.size();
+
+    parallel_for(n, [&](size_t i){ if(flip[i]) std::swap(faces[i].y, faces[i].z); });
+
+    // Signed volume (x6) per closed component; negative means the component faces inward.
+    std::vector<double> volume(st.components, 0.0);
+    for(size_t i=0;i<n;++i) {
+        uint32_t c = component[i];
+        if(c == kUnvisited || comp_open[c]) continue;
+        const glm::ivec3 f = faces[i];
+        glm::dvec3 a(positions[f.x]), b(positions[f.y]), d(positions[f.z]);
+        volume[c] += glm::dot(a, glm::cross(b, d));
+    }
+    std::vector<uint8_t> invert(st.components, 0);
+    for(size_t c=0;c<st.components;++c) {
+        if(comp_open[c]) continue;
+        st.closed_components++;
+        if(volume[c] < 0.0) { invert[c] = 1; st.inverted_components++; }
+    }
+    parallel_for(n, [&](size_t i){
+        uint32_t c = component[i];
+        if(c != kUnvisited && invert[c]) { std::swap(faces[i].y, faces[i].z); flip[i] ^= 1; }
+    });
+    for(uint8_t f: flip) st.flipped_faces += f;
+    st.ms = ms_since(t0);
+    return st;
+}
@@ -0,0 +1,53 @@
+#pragma once
+// Load-time clean-up passes over the raw SMF arrays (positions + triangle faces).
+// All passes rewrite `faces` in place; out-of-range face indices are left as -1 so
+// the builders' existing bounds checks keep skipping them.
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstddef>
+
+struct WeldStats {
+    size_t input_vertices = 0;
+    size_t merged = 0;
+    float epsilon = 0.0f;
+    double ms = 0.0;
+};
+
+// Merges vertices closer than `epsilon` (<= 0 picks 1e-6 of the bounding-box diagonal)
+// using a spatial hash grid, then compacts `positions` and remaps `faces`.
+// Each vertex maps to the lowest-index vertex within epsilon; chains are collapsed.
+// Vertices with non-finite positions are kept as they are and never merged.
+WeldStats weld_vertices(std::vector<glm::vec3>& positions, std::vector<glm::ivec3>& faces, float epsilon);
+
+struct CleanStats {
+    size_t input_faces = 0;
+    size_t invalid = 0;           // index out of range
+    size_t degenerate = 0;        // repeated index or (near) zero area
+    size_t duplicate = 0;         // same three vertices, same winding as an earlier face
+    size_t flipped_duplicate = 0; // same three vertices, opposite winding
+    double ms = 0.0;
+    size_t removed() const { return invalid + degenerate + duplicate + flipped_duplicate; }
+};
+
+// Drops invalid, degenerate, duplicate and opposite-wound duplicate triangles,
+// keeping the first occurrence of each triangle and the original face order.
+CleanStats clean_faces(const std::vector<glm::vec3>& positions, std::vector<glm::ivec3>& faces);
+
+struct OrientStats {
+    size_t components = 0;
+    size_t closed_components = 0;   // every edge shared by exactly two faces
+    size_t flipped_faces = 0;
+    size_t inverted_components = 0; // closed components turned outward by signed volume
+    size_t boundary_edges = 0;
+    size_t nonmanifold_edges = 0;
+    size_t conflicts = 0;           // non-orientable (Moebius-like) adjacencies
+    double ms = 0.0;
+    // Back faces can only be culled safely when every component is closed and consistent.
+    bool cull_safe() const { return components > 0 && closed_components == components && conflicts == 0; }
+};
+
+// Makes winding consistent within each edge-connected component (breadth-first flips
+// across manifold edges), then orients closed components so their signed volume is positive.
+OrientStats orient_faces(const std::vector<glm::vec3>& positions, std::vector<glm::ivec3>& faces);
@@ -0,0 +1,447 @@
+#include "mesh_codec.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+const uint32_t kCodecMagic = 0x5A4D4653; // "SFMZ"
+const uint32_t kCodecVersion = 2;
+
+const uint32_t kScaleBits = 12;
+const uint32_t kScale = 1u << kScaleBits;
+const uint32_t kRansL = 1u << 16; // lower bound of the normalised state
+const int kRansStates = 4;       // interleaved so consecutive symbols do not wait on each other
+
+struct CodecHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t vertex_count;
+    uint64_t face_count;
+    uint32_t position_bits;
+    uint32_t vertex_chunks;
+    uint32_t face_chunks;
+    uint32_t chunk_vertices;
+    uint32_t chunk_faces;
+    float lo[3];
+    float step[3];
+};
+
+enum StreamMode : uint8_t { kStreamRaw = 0, kStreamRans = 1 };
+
+// Residuals use 32-bit wrapping arithmetic, so any pair of int32 values round-trips.
+inline int32_t wrap_sub(int32_t a, int32_t b) { return (int32_t)((uint32_t)a - (uint32_t)b); }
+inline uint32_t zigzag(int32_t v) { return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); }
+inline int32_t unzigzag(uint32_t v) { return (int32_t)((v >> 1) ^ (0u - (v & 1))); }
+
+inline void put_varint(std::vector<uint8_t>& out, uint64_t v) {
+    while(v >= 0x80) { out.push_back((uint8_t)(v | 0x80)); v >>= 7; }
+    out.push_back((uint8_t)v);
+}
+
+inline bool get_varint(const uint8_t*& p, const uint8_t* end, uint64_t& v) {
+    v = 0;
+    for(int shift=0; shift<64; shift+=7) {
+        if(p == end) return false;
+        uint8_t b = *p++;
+        v |= (uint64_t)(b & 0x7F) << shift;
+        if(!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+// Scales symbol counts to frequencies summing to kScale, keeping every used symbol >= 1.
+void normalise_frequencies(const uint64_t counts[256], uint64_t total, uint32_t freq[256]) {
+    uint32_t sum = 0;
+    int largest = 0;
+    for(int s=0;s<256;++s) {
+        freq[s] = counts[s] ? std::max<uint32_t>(1, (uint32_t)(counts[s] * kScale / total)) : 0;
+        sum += freq[s];
+        if(counts[s] > counts[largest]) largest = s;
+    }
+    if(sum < kScale) { freq[largest] += kScale - sum; return; }
+    while(sum > kScale) {
+        int s = -1;
+        for(int k=0;k<256;++k) if(freq[k] > 1 && (s < 0 || freq[k] > freq[s])) s = k;
+        uint32_t take = std::min(sum - kScale, std::max(1u, freq[s] / 2));
+        freq[s] -= take;
+        sum -= take;
+    }
+}
+
+// symbol count, mode, then either the raw bytes or (frequency table, size, rANS payload).
+void encode_stream(const std::vector<uint8_t>& symbols, std::vector<uint8_t>& out) {
+    const size_t n = symbols.size();
+    put_varint(out, n);
+    uint64_t counts[256] = {0};
+    for(uint8_t s: symbols) ++counts[s];
+    uint32_t freq[256], start[256];
+    int used = 0;
+    if(n) normalise_frequencies(counts, n, freq);
+    else std::fill(freq, freq + 256, 0u);
+    for(int s=0, acc=0; s<256; ++s) { start[s] = (uint32_t)acc; acc += freq[s]; used += freq[s] != 0; }
+
+    // Interleaved states, encoded back to front so the decoder runs forwards. States
+    // renormalise by whole 16-bit words, so each symbol moves at most one word.
+    std::vector<uint16_t> buf(n + 2 * kRansStates + 8);
+    uint16_t* const buf_end = buf.data() + buf.size();
+    uint16_t* ptr = buf_end;
+    uint32_t state[kRansStates];
+    std::fill(state, state + kRansStates, kRansL);
+    for(size_t i=n; i-- > 0;) {
+        uint8_t s = symbols[i];
+        uint32_t& x = state[i % kRansStates];
+        uint32_t f = freq[s];
+        uint32_t x_max = ((kRansL >> kScaleBits) << 16) * f;
+        if(x >= x_max) { *--ptr = (uint16_t)x; x >>= 16; }
+        x = ((x / f) << kScaleBits) + (x % f) + start[s];
+    }
+    for(int k=kRansStates-1;k>=0;--k) { ptr -= 2; std::memcpy(ptr, &state[k], 4); }
+    size_t payload = (size_t)(buf_end - ptr) * sizeof(uint16_t);
+
+    size_t table_bytes = 1 + 3 * (size_t)used;
+    if(n == 0 || payload + table_bytes >= n) {
+        out.push_back(kStreamRaw);
+        out.insert(out.end(), symbols.begin(), symbols.end());
+        return;
+    }
+    out.push_back(kStreamRans);
+    put_varint(out, (uint64_t)used);
+    for(int s=0;s<256;++s) if(freq[s]) { out.push_back((uint8_t)s); put_varint(out, freq[s]); }
+    put_varint(out, payload);
+    out.insert(out.end(), (const uint8_t*)ptr, (const uint8_t*)buf_end);
+}
+
+struct DecodeSlot { uint16_t freq; uint16_t bias; uint8_t symbol; };
+
+// A stream written by encode_stream: either raw symbols or a rANS payload whose
+// decode table has been filled in.
+struct SymbolStream {
+    uint64_t n = 0;
+    const uint8_t* raw = nullptr;
+    const uint8_t* in = nullptr;
+    const uint8_t* in_end = nullptr;
+};
+
+// Parses the stream header and table, rejecting any symbol above `max_symbol`.
+bool read_stream(const uint8_t*& p, const uint8_t* end, uint8_t max_symbol, DecodeSlot* slots, SymbolStream& s) {
+    if(!get_varint(p, end, s.n) || p == end) return false;
+    uint8_t mode = *p++;
+    if(mode == kStreamRaw) {
+        if((uint64_t)(end - p) < s.n) return false;
+        s.raw = p;
+        p += s.n;
+        for(uint64_t i=0;i<s.n;++i) if(s.raw[i] > max_symbol) return false;
+        return true;
+    }
+    if(mode != kStreamRans) return false;
+
+    uint64_t used = 0;
+    if(!get_varint(p, end, used) || used == 0 || used > 256) return false;
+    uint32_t acc = 0;
+    for(uint64_t k=0;k<used;++k) {
+        if(p == end) return false;
+        uint8_t sym = *p++;
+        uint64_t f = 0;
+        if(sym > max_symbol || !get_varint(p, end, f) || f == 0 || acc + f > kScale) return false;
+        for(uint32_t i=0;i<f;++i) slots[acc + i] = DecodeSlot{ (uint16_t)f, (uint16_t)i, sym };
+        acc += (uint32_t)f;
+    }
+    uint64_t payload = 0;
+    if(acc != kScale || !get_varint(p, end, payload) || (uint64_t)(end - p) < payload
+       || payload < 4 * kRansStates || payload % 2) return false;
+    s.in = p;
+    s.in_end = p + payload;
+    p = s.in_end;
+    return true;
+}
+
+// Hands every symbol to `emit` in order; stops with false as soon as `emit` does.
+template<class Emit>
+bool decode_symbols(const SymbolStream& s, const DecodeSlot* slots, Emit&& emit) {
+    const uint64_t n = s.n;
+    if(s.raw) {
+        for(uint64_t i=0;i<n;++i) if(!emit(s.raw[i])) return false;
+        return true;
+    }
+    const uint8_t* in = s.in;
+    const uint8_t* in_end = s.in_end;
+    uint32_t state[kRansStates];
+    std::memcpy(state, in, sizeof(state));
+    in += sizeof(state);
+    // Every symbol reads at most one word, so the bounds check is needed only when
+    // fewer words remain than symbols.
+    uint64_t i = 0;
+    for(;;) {
+        uint64_t safe = std::min<uint64_t>(n - i, (uint64_t)(in_end - in) / 2) & ~(uint64_t)(kRansStates - 1);
+        if(safe == 0) break;
+        for(uint64_t stop=i+safe; i<stop; i+=kRansStates) {
+            for(int k=0;k<kRansStates;++k) {
+                uint32_t x = state[k];
+                const DecodeSlot& d = slots[x & (kScale - 1)];
+                if(!emit(d.symbol)) return false;
+                x = d.freq * (x >> kScaleBits) + d.bias;
+                // Branch-free: whether a state renormalises is close to a coin flip.
+                uint16_t w;
+                std::memcpy(&w, in, 2);
+                bool renorm = x < kRansL;
+                x = renorm ? (x << 16) | w : x;
+                in += renorm ? 2 : 0;
+                state[k] = x;
+            }
+        }
+    }
+    for(; i<n; ++i) {
+        uint32_t& x = state[i % kRansStates];
+        const DecodeSlot& d = slots[x & (kScale - 1)];
+        if(!emit(d.symbol)) return false;
+        x = d.freq * (x >> kScaleBits) + d.bias;
+        if(x < kRansL) {
+            if(in_end - in < 2) return false;
+            uint16_t w; std::memcpy(&w, in, 2); in += 2;
+            x = (x << 16) | w;
+        }
+    }
+    return true;
+}
+
+inline uint32_t bit_length(uint32_t v) {
+    uint32_t k = 0;
+    while(v) { ++k; v >>= 1; }
+    return k;
+}
+
+// Residuals are zigzagged to uint32 and packed in blocks of kBlock values, each at the
+// bit width of its largest value. The widths form an rANS-coded stream; the packed bits
+// follow raw. Inside a block every value sits at a fixed offset, so decoding is a load,
+// shift and mask per value with no serial dependency between them.
+const size_t kBlock = 16;
+
+void encode_residuals(const std::vector<uint32_t>& values, std::vector<uint8_t>& out) {
+    const size_t n = values.size();
+    std::vector<uint8_t> widths((n + kBlock - 1) / kBlock), bits;
+    bits.reserve(n);
+    uint64_t acc = 0;
+    uint32_t count = 0;
+    for(size_t b=0;b<widths.size();++b) {
+        size_t first = b * kBlock, last = std::min(n, first + kBlock);
+        uint32_t all = 0;
+        for(size_t i=first;i<last;++i) all |= values[i];
+        uint32_t w = bit_length(all);
+        widths[b] = (uint8_t)w;
+        for(size_t i=first;i<last;++i) {
+            acc |= (uint64_t)values[i] << count;
+            count += w;
+            while(count >= 8) { bits.push_back((uint8_t)acc); acc >>= 8; count -= 8; }
+        }
+    }
+    if(count) bits.push_back((uint8_t)acc);
+    encode_stream(widths, out);
+    put_varint(out, bits.size());
+    out.insert(out.end(), bits.begin(), bits.end());
+}
+
+// Decodes exactly `count` residuals into `values`.
+bool decode_residuals(const uint8_t*& p, const uint8_t* end, size_t count, std::vector<uint32_t>& values) {
+    static thread_local DecodeSlot slots[kScale];
+    static thread_local std::vector<uint8_t> widths, bits;
+    const size_t blocks = (count + kBlock - 1) / kBlock;
+    SymbolStream s;
+    uint64_t bytes = 0;
+    if(!read_stream(p, end, 32, slots, s) || s.n != blocks
+       || !get_varint(p, end, bytes) || (uint64_t)(end - p) < bytes) return false;
+    widths.resize(blocks);
+    uint8_t* w = widths.data();
+    if(!decode_symbols(s, slots, [&](uint8_t k) { *w++ = k; return true; })) return false;
+    uint64_t total = 0;
+    for(size_t b=0;b<blocks;++b) total += (uint64_t)widths[b] * std::min(kBlock, count - b * kBlock);
+    if(total > bytes * 8) return false;
+    // Padded so every value can be read with one unaligned 8-byte load.
+    bits.assign(p, p + bytes);
+    bits.resize(bytes + 8, 0);
+    p += bytes;
+    values.resize(count);
+    const uint8_t* base = bits.data();
+    uint64_t pos = 0;
+    for(size_t b=0;b<blocks;++b) {
+        const uint32_t k = widths[b];
+        const uint64_t mask = (1ull << k) - 1;
+        size_t first = b * kBlock, last = std::min(count, first + kBlock);
+        for(size_t i=first;i<last;++i, pos+=k) {
+            uint64_t word;
+            std::memcpy(&word, base + (pos >> 3), 8);
+            values[i] = (uint32_t)((word >> (pos & 7)) & mask);
+        }
+    }
+    return true;
+}
+
+void encode_vertex_chunk(const glm::vec3* v, size_t count, const CodecHeader& h, std::vector<uint8_t>& out) {
+    const int32_t q_max = (int32_t)((1u << h.position_bits) - 1);
+    std::vector<uint32_t> residuals;
+    residuals.reserve(count * 3);
+    int32_t prev[3] = {0, 0, 0};
+    for(size_t i=0;i<count;++i) {
+        for(int a=0;a<3;++a) {
+            float t = h.step[a] > 0.0f ? (v[i][a] - h.lo[a]) / h.step[a] : 0.0f;
+            int32_t q = std::isfinite(t) ? (int32_t)std::min(std::max(std::llround(t), 0ll), (long long)q_max) : 0;
+            residuals.push_back(zigzag(q - prev[a]));
+            prev[a] = q;
+        }
+    }
+    encode_residuals(residuals, out);
+}
+
+bool decode_vertex_chunk(const uint8_t* p, const uint8_t* end, glm::vec3* v, size_t count, const CodecHeader& h) {
+    static thread_local std::vector<uint32_t> residuals;
+    if(!decode_residuals(p, end, count * 3, residuals)) return false;
+    const uint32_t* r = residuals.data();
+    int32_t prev[3] = {0, 0, 0};
+    for(size_t i=0;i<count;++i, r+=3) {
+        for(int a=0;a<3;++a) {
+            prev[a] += unzigzag(r[a]);
+            v[i][a] = h.lo[a] + (float)prev[a] * h.step[a];
+        }
+    }
+    return true;
+}
+
+void encode_face_chunk(const glm::ivec3* f, size_t count, std::vector<uint8_t>& out) {
+    std::vector<uint32_t> lead, corner;
+    lead.reserve(count);
+    corner.reserve(count * 2);
+    int32_t prev = 0;
+    for(size_t i=0;i<count;++i) {
+        lead.push_back(zigzag(wrap_sub(f[i].x, prev)));
+        corner.push_back(zigzag(wrap_sub(f[i].y, f[i].x)));
+        corner.push_back(zigzag(wrap_sub(f[i].z, f[i].x)));
+        prev = f[i].x;
+    }
+    encode_residuals(lead, out);
+    encode_residuals(corner, out);
+}
+
+bool decode_face_chunk(const uint8_t* p, const uint8_t* end, glm::ivec3* f, size_t count) {
+    static thread_local std::vector<uint32_t> lead, corner;
+    if(!decode_residuals(p, end, count, lead) || !decode_residuals(p, end, count * 2, corner)) return false;
+    uint32_t prev = 0;
+    for(size_t i=0;i<count;++i) {
+        prev += (uint32_t)unzigzag(lead[i]);
+        f[i] = glm::ivec3((int32_t)prev, (int32_t)(prev + (uint32_t)unzigzag(corner[2*i])),
+                          (int32_t)(prev + (uint32_t)unzigzag(corner[2*i+1])));
+    }
+    return true;
+}
+
+} // namespace
+
+bool encode_mesh(const std::vector<glm::vec3>& positions, const std::vector<glm::ivec3>& faces,
+                 const MeshCodecOptions& options, std::vector<uint8_t>& out, MeshCodecStats* stats) {
+    auto t0 = std::chrono::steady_clock::now();
+    out.clear();
+    if(options.position_bits < 8 || options.position_bits > 24 || !options.chunk_vertices || !options.chunk_faces) return false;
+    const size_t nv = positions.size(), nf = faces.size();
+    const size_t cv = std::min<size_t>(options.chunk_vertices, 0xFFFFFFFFu), cf = std::min<size_t>(options.chunk_faces, 0xFFFFFFFFu);
+
+    CodecHeader h = {};
+    h.magic = kCodecMagic;
+    h.version = kCodecVersion;
+    h.vertex_count = nv;
+    h.face_count = nf;
+    h.position_bits = (uint32_t)options.position_bits;
+    h.vertex_chunks = (uint32_t)((nv + cv - 1) / cv);
+    h.face_chunks = (uint32_t)((nf + cf - 1) / cf);
+    h.chunk_vertices = (uint32_t)cv;
+    h.chunk_faces = (uint32_t)cf;
+    glm::vec3 lo(0.0f), hi(0.0f);
+    bool any = false;
+    for(const glm::vec3& p: positions) {
+        if(!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z)) continue;
+        lo = any ? glm::min(lo, p) : p;
+        hi = any ? glm::max(hi, p) : p;
+        any = true;
+    }
+    const float q_max = (float)((1u << h.position_bits) - 1);
+    for(int a=0;a<3;++a) { h.lo[a] = lo[a]; h.step[a] = (hi[a] - lo[a]) / q_max; }
+
+    const size_t chunks = (size_t)h.vertex_chunks + h.face_chunks;
+    std::vector<std::vector<uint8_t>> encoded(chunks);
+    parallel_for(chunks, [&](size_t c){
+        if(c < h.vertex_chunks) {
+            size_t b = c * cv;
+            encode_vertex_chunk(positions.data() + b, std::min(cv, nv - b), h, encoded[c]);
+        } else {
+            size_t b = (c - h.vertex_chunks) * cf;
+            encode_face_chunk(faces.data() + b, std::min(cf, nf - b), encoded[c]);
+        }
+    }, 1);
+
+    // Header, then the end offset of every chunk, then the chunks.
+    std::vector<uint64_t> ends(chunks);
+    uint64_t acc = 0;
+    for(size_t c=0;c<chunks;++c) { acc += encoded[c].size(); ends[c] = acc; }
+    out.resize(sizeof(h) + chunks * sizeof(uint64_t) + acc);
+    std::memcpy(out.data(), &h, sizeof(h));
+    std::memcpy(out.data() + sizeof(h), ends.data(), chunks * sizeof(uint64_t));
+    uint8_t* dst = out.data() + sizeof(h) + chunks * sizeof(uint64_t);
+    for(auto& e: encoded) { if(!e.empty()) std::memcpy(dst, e.data(), e.size()); dst += e.size(); }
+
+    if(stats) {
+        stats->raw_bytes = nv * sizeof(glm::vec3) + nf * sizeof(glm::ivec3);
+        stats->encoded_bytes = out.size();
+        stats->chunks = chunks;
+        stats->ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    }
+    return true;
+}
+
+bool decode_mesh(const uint8_t* data, size_t size, std::vector<glm::vec3>& positions, std::vector<glm::ivec3>& faces,
+                 bool parallel, MeshCodecStats* stats) {
+    auto t0 = std::chrono::steady_clock::now();
+    CodecHeader h;
+    if(size < sizeof(h)) return false;
+    std::memcpy(&h, data, sizeof(h));
+    if(h.magic != kCodecMagic || h.version != kCodecVersion || h.position_bits < 8 || h.position_bits > 24
+       || !h.chunk_vertices || !h.chunk_faces
+       || h.vertex_chunks != (h.vertex_count + h.chunk_vertices - 1) / h.chunk_vertices
+       || h.face_chunks != (h.face_count + h.chunk_faces - 1) / h.chunk_faces) return false;
+    const size_t chunks = (size_t)h.vertex_chunks + h.face_chunks;
+    const size_t table = sizeof(h) + chunks * sizeof(uint64_t);
+    if(size < table) return false;
+    std::vector<uint64_t> ends(chunks);
+    std::memcpy(ends.data(), data + sizeof(h), chunks * sizeof(uint64_t));
+    for(size_t c=0;c<chunks;++c) if(ends[c] > size - table || (c && ends[c] < ends[c-1])) return false;
+
+    positions.resize(h.vertex_count);
+    faces.resize(h.face_count);
+    const uint8_t* payload = data + table;
+    std::atomic<bool> ok{true};
+    auto decode_chunk = [&](size_t c){
+        const uint8_t* p = payload + (c ? ends[c-1] : 0);
+        const uint8_t* end = payload + ends[c];
+        bool good;
+        if(c < h.vertex_chunks) {
+            size_t b = c * (size_t)h.chunk_vertices;
+            good = decode_vertex_chunk(p, end, positions.data() + b, std::min<size_t>(h.chunk_vertices, h.vertex_count - b), h);
+        } else {
+            size_t b = (c - h.vertex_chunks) * (size_t)h.chunk_faces;
+            good = decode_face_chunk(p, end, faces.data() + b, std::min<size_t>(h.chunk_faces, h.face_count - b));
+        }
+        if(!good) ok.store(false, std::memory_order_relaxed);
+    };
+    if(parallel) parallel_for(chunks, decode_chunk, 1);
+    else for(size_t c=0;c<chunks;++c) decode_chunk(c);
+    if(!ok.load()) { positions.clear(); faces.clear(); return false; }
+
+    if(stats) {
+        stats->raw_bytes = positions.size() * sizeof(glm::vec3) + faces.size() * sizeof(glm::ivec3);
+        stats->encoded_bytes = size;
+        stats->chunks = chunks;
+        stats->ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    }
+    return true;
+}
@@ -0,0 +1,38 @@
+#pragma once
+// Compact encoding of indexed triangle meshes, used for compressed mesh caches.
+//
+// Positions are quantised to `position_bits` per axis over the bounding box and
+// predicted from the previous vertex. Each face codes its first index as a delta from
+// the previous face's first index and its other two relative to that first index.
+// The zigzagged residuals are bit-packed in blocks of 16 at the width of each block's
+// largest value; the widths are compressed by an order-0 rANS coder (four interleaved
+// states, 12-bit frequencies) and the packed bits are stored raw. Vertices and faces
+// are cut into chunks that reset every predictor, so chunks encode and decode
+// independently and in parallel. Faces round-trip exactly; positions are within
+// half a quantisation step.
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+struct MeshCodecOptions {
+    int position_bits = 16;          // 8..24
+    size_t chunk_vertices = 1 << 16;
+    size_t chunk_faces = 1 << 16;
+};
+
+struct MeshCodecStats {
+    size_t raw_bytes = 0;     // positions and faces as float/int arrays
+    size_t encoded_bytes = 0;
+    size_t chunks = 0;
+    double ms = 0.0;
+    double ratio() const { return encoded_bytes ? (double)raw_bytes / encoded_bytes : 0.0; }
+};
+
+bool encode_mesh(const std::vector<glm::vec3>& positions, const std::vector<glm::ivec3>& faces,
+                 const MeshCodecOptions& options, std::vector<uint8_t>& out, MeshCodecStats* stats = nullptr);
+// False on truncated or corrupt input. `parallel` decodes chunks on all cores.
+bool decode_mesh(const uint8_t* data, size_t size, std::vector<glm::vec3>& positions, std::vector<glm::ivec3>& faces,
+                 bool parallel = true, MeshCodecStats* stats = nullptr);
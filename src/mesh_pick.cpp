@@ -0,0 +1,48 @@
+#include "mesh_pick.h"
+
+#include <chrono>
+#include <utility>
+
+Ray cursor_ray(double x, double y, int width, int height, const glm::mat4& proj, const glm::mat4& view, const glm::mat4& model) {
+    Ray ray;
+    if(width <= 0 || height <= 0) return ray;
+    float nx = 2.0f * (float)x / (float)width - 1.0f, ny = 1.0f - 2.0f * (float)y / (float)height;
+    glm::mat4 inv = glm::inverse(proj * view * model);
+    glm::vec4 near_point = inv * glm::vec4(nx, ny, -1.0f, 1.0f);
+    glm::vec4 far_point = inv * glm::vec4(nx, ny, 1.0f, 1.0f);
+    ray.origin = glm::vec3(near_point) / near_point.w;
+    ray.dir = glm::vec3(far_point) / far_point.w - ray.origin;
+    ray.t_min = 0.0f;
+    ray.t_max = 1.0f; // the far plane
+    return ray;
+}
+
+MeshPicker::~MeshPicker() {
+    if(worker.joinable()) worker.join();
+}
+
+void MeshPicker::build_async(std::vector<glm::vec3> p, std::vector<glm::ivec3> f) {
+    if(worker.joinable()) worker.join();
+    done.store(false, std::memory_order_relaxed);
+    positions = std::move(p);
+    faces = std::move(f);
+    worker = std::thread([this]{
+        bvh_stats = bvh.build(positions, faces);
+        done.store(true, std::memory_order_release);
+    });
+}
+
+bool MeshPicker::pick(const Ray& ray, PickResult& result) const {
+    result = PickResult();
+    if(!ready()) return false;
+    auto t0 = std::chrono::steady_clock::now();
+    RayHit hit;
+    if(bvh.intersect(ray, hit)) {
+        result.face = hit.face;
+        result.corners = faces[hit.face];
+        for(int k=0;k<3;++k) result.positions[k] = positions[result.corners[k]];
+        result.point = ray.origin + hit.t * ray.dir;
+    }
+    result.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    return true;
+}
@@ -0,0 +1,54 @@
+#pragma once
+// Cursor picking against a BVH over the displayed triangles.
+//
+// The BVH is built on a background thread so loading is not held up; picks made
+// before it is ready report that instead of blocking. A pick unprojects the cursor
+// with the frame's projection, view and model matrices into a model-space ray, so
+// its cost is one BVH query.
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+
+#include "bvh.h"
+
+struct PickResult {
+    uint32_t face = RayHit::kNone; // index into the faces given to build_async()
+    glm::ivec3 corners = glm::ivec3(-1);
+    glm::vec3 positions[3];
+    glm::vec3 point = glm::vec3(0.0f); // model space
+    double ms = 0.0;
+    bool hit() const { return face != RayHit::kNone; }
+};
+
+// Ray through window pixel (x, y) (origin top left, as GLFW reports the cursor) in the
+// space `model` maps from. Works for perspective and orthographic projections.
+Ray cursor_ray(double x, double y, int width, int height, const glm::mat4& proj, const glm::mat4& view, const glm::mat4& model);
+
+class MeshPicker {
+public:
+    MeshPicker() = default;
+    MeshPicker(const MeshPicker&) = delete;
+    MeshPicker& operator=(const MeshPicker&) = delete;
+    ~MeshPicker();
+
+    // Takes the triangles and builds the BVH on a background thread. A previous
+    // build is waited for and replaced.
+    void build_async(std::vector<glm::vec3> positions, std::vector<glm::ivec3> faces);
+    bool ready() const { return done.load(std::memory_order_acquire); }
+    const BvhStats& stats() const { return bvh_stats; } // valid once ready()
+
+    // False (and no hit) while the BVH is still being built.
+    bool pick(const Ray& ray, PickResult& result) const;
+
+private:
+    std::thread worker;
+    std::atomic<bool> done{false};
+    std::vector<glm::vec3> positions;
+    std::vector<glm::ivec3> faces;
+    Bvh bvh;
+    BvhStats bvh_stats;
+};
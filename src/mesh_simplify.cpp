@@ -0,0 +1,348 @@
+#include "mesh_simplify.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+
+namespace {
+
+// Symmetric 4x4 quadric, upper triangle.
+struct Quadric {
+    double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0;
+
+    static Quadric plane(const glm::dvec3& n, double d, double w) {
+        Quadric q;
+        q.a2 = w*n.x*n.x; q.ab = w*n.x*n.y; q.ac = w*n.x*n.z; q.ad = w*n.x*d;
+        q.b2 = w*n.y*n.y; q.bc = w*n.y*n.z; q.bd = w*n.y*d;
+        q.c2 = w*n.z*n.z; q.cd = w*n.z*d;
+        q.d2 = w*d*d;
+        return q;
+    }
+    Quadric& operator+=(const Quadric& o) {
+        a2 += o.a2; ab += o.ab; ac += o.ac; ad += o.ad; b2 += o.b2;
+        bc += o.bc; bd += o.bd; c2 += o.c2; cd += o.cd; d2 += o.d2;
+        return *this;
+    }
+    double eval(const glm::dvec3& p) const {
+        return a2*p.x*p.x + 2*ab*p.x*p.y + 2*ac*p.x*p.z + 2*ad*p.x
+             + b2*p.y*p.y + 2*bc*p.y*p.z + 2*bd*p.y
+             + c2*p.z*p.z + 2*cd*p.z + d2;
+    }
+    // Minimiser of the quadric; false when the 3x3 system is (near) singular.
+    bool optimum(glm::dvec3& p) const {
+        double det = a2*(b2*c2 - bc*bc) - ab*(ab*c2 - bc*ac) + ac*(ab*bc - b2*ac);
+        if(std::fabs(det) < 1e-12) return false;
+        double inv = 1.0 / det;
+        p.x = -inv*(ad*(b2*c2 - bc*bc) - ab*(bd*c2 - cd*bc) + ac*(bd*bc - cd*b2));
+        p.y = -inv*(a2*(bd*c2 - cd*bc) - ad*(ab*c2 - bc*ac) + ac*(ab*cd - bd*ac));
+        p.z = -inv*(a2*(b2*cd - bc*bd) - ab*(ab*cd - bd*ac) + ad*(ab*bc - b2*ac));
+        return true;
+    }
+};
+
+struct Candidate {
+    uint32_t lo, hi;
+    float cost;
+    uint8_t valid;
+    uint8_t keep_hi; // the surviving endpoint; the other one is merged into it
+    glm::vec3 target;
+};
+
+// Vertex -> incident faces in CSR form.
+void build_vertex_faces(size_t nv, const std::vector<glm::ivec3>& faces, std::vector<uint32_t>& start, std::vector<uint32_t>& list) {
+    start.assign(nv + 1, 0);
+    for(const auto &f: faces) { start[f.x+1]++; start[f.y+1]++; start[f.z+1]++; }
+    for(size_t i=0;i<nv;++i) start[i+1] += start[i];
+    list.resize(start[nv]);
+    std::vector<uint32_t> fill(start.begin(), start.end() - 1);
+    for(size_t t=0;t<faces.size();++t) {
+        list[fill[faces[t].x]++] = (uint32_t)t;
+        list[fill[faces[t].y]++] = (uint32_t)t;
+        list[fill[faces[t].z]++] = (uint32_t)t;
+    }
+}
+
+// Unique undirected edges, sorted; `count` is the number of faces using each.
+void collect_edges(size_t nv, const std::vector<glm::ivec3>& faces, std::vector<uint64_t>& edges, std::vector<uint32_t>& count) {
+    std::vector<uint64_t> all(faces.size()*3);
+    parallel_for(faces.size(), [&](size_t t){
+        for(int k=0;k<3;++k) {
+            uint64_t a = (uint32_t)faces[t][k], b = (uint32_t)faces[t][(k+1)%3];
+            all[3*t+k] = std::min(a, b) * nv + std::max(a, b);
+        }
+    });
+    int bits = 8;
+    while(bits < 64 && ((uint64_t)nv * nv) >> bits) bits += 8;
+    parallel_radix_sort(all, [](uint64_t v){ return v; }, bits);
+    edges.clear(); count.clear();
+    for(size_t i=0;i<all.size();) {
+        size_t j = i + 1;
+        while(j < all.size() && all[j] == all[i]) ++j;
+        edges.push_back(all[i]);
+        count.push_back((uint32_t)(j - i));
+        i = j;
+    }
+}
+
+void snapshot(const std::vector<glm::vec3>& pos, const std::vector<glm::ivec3>& faces, MeshLod& out) {
+    std::vector<int> remap(pos.size(), -1);
+    for(const auto &f: faces) { remap[f.x] = 0; remap[f.y] = 0; remap[f.z] = 0; }
+    int used = 0;
+    for(auto &r: remap) if(r == 0) r = used++;
+    out.positions.resize((size_t)used);
+    parallel_for(pos.size(), [&](size_t i){ if(remap[i] >= 0) out.positions[remap[i]] = pos[i]; });
+    out.faces.resize(faces.size());
+    parallel_for(faces.size(), [&](size_t t){
+        out.faces[t] = glm::ivec3(remap[faces[t].x], remap[faces[t].y], remap[faces[t].z]);
+    });
+}
+
+// Pass-based collapse engine shared by the LOD chain and the progressive mesh builder.
+// With half_edge set, collapses keep one endpoint in place instead of moving it to the
+// quadric optimum, so every collapse can be undone exactly by a vertex split.
+class QemEngine {
+public:
+    std::vector<glm::vec3> pos;
+    std::vector<glm::ivec3> faces;
+    size_t input_count = 0;
+    double max_error2 = 0.0;
+    SimplifyStats stats;
+
+    QemEngine(const std::vector<glm::vec3>& positions, const std::vector<glm::ivec3>& input_faces, bool half_edge)
+        : pos(positions), nv(positions.size()), half_edge(half_edge) {
+        faces.reserve(input_faces.size());
+        for(const auto &f: input_faces) {
+            if(f.x < 0 || f.y < 0 || f.z < 0 || (size_t)f.x >= nv || (size_t)f.y >= nv || (size_t)f.z >= nv) continue;
+            if(f.x == f.y || f.y == f.z || f.x == f.z) continue;
+            faces.push_back(f);
+        }
+        input_count = faces.size();
+        if(nv == 0 || input_count == 0 || nv >= 0xFFFFFFFFu) { faces.clear(); input_count = 0; return; }
+        init_quadrics();
+        remap.resize(nv);
+        for(size_t i=0;i<nv;++i) remap[i] = (uint32_t)i;
+        locked.assign(nv, 0);
+    }
+
+    // One pass towards `target` faces. Applied collapses are appended to `log` in order.
+    size_t pass(size_t target, std::vector<EdgeCollapse>* log);
+
+private:
+    size_t nv;
+    bool half_edge;
+    std::vector<Quadric> quad;
+    std::vector<uint32_t> remap, vf_start, vf_list;
+    std::vector<uint8_t> locked;
+    std::vector<uint64_t> edges, order;
+    std::vector<uint32_t> edge_count;
+    std::vector<Candidate> cand;
+
+    void init_quadrics();
+    bool collapse_is_valid(const Candidate& c, uint32_t shared_faces) const;
+};
+
+void QemEngine::init_quadrics() {
+    // Plane quadrics per face, gathered per vertex.
+    build_vertex_faces(nv, faces, vf_start, vf_list);
+    std::vector<Quadric> face_q(faces.size());
+    parallel_for(faces.size(), [&](size_t t){
+        glm::dvec3 a(pos[faces[t].x]), b(pos[faces[t].y]), c(pos[faces[t].z]);
+        glm::dvec3 n = glm::cross(b - a, c - a);
+        double len = glm::length(n);
+        if(len > 0.0) { n /= len; face_q[t] = Quadric::plane(n, -glm::dot(n, a), 1.0); }
+    });
+    quad.assign(nv, Quadric());
+    parallel_for(nv, [&](size_t v){
+        for(uint32_t k=vf_start[v]; k<vf_start[v+1]; ++k) quad[v] += face_q[vf_list[k]];
+    });
+
+    // Border edges get a heavily weighted plane perpendicular to their face to keep open borders in place.
+    collect_edges(nv, faces, edges, edge_count);
+    for(size_t e=0;e<edges.size();++e) {
+        if(edge_count[e] != 1) continue;
+        uint32_t a = (uint32_t)(edges[e] / nv), b = (uint32_t)(edges[e] % nv);
+        for(uint32_t k=vf_start[a]; k<vf_start[a+1]; ++k) {
+            const glm::ivec3 f = faces[vf_list[k]];
+            if(f.x != (int)b && f.y != (int)b && f.z != (int)b) continue;
+            glm::dvec3 pa(pos[a]), pb(pos[b]), pc(pos[f.x + f.y + f.z - (int)a - (int)b]);
+            glm::dvec3 n = glm::cross(pb - pa, pc - pa);
+            glm::dvec3 m = glm::cross(pb - pa, n);
+            double len = glm::length(m);
+            if(len <= 0.0) break;
+            m /= len;
+            Quadric q = Quadric::plane(m, -glm::dot(m, pa), 100.0);
+            quad[a] += q; quad[b] += q;
+            break;
+        }
+    }
+}
+
+// Link condition (the endpoints share only the opposite vertices of the edge's faces)
+// and no surrounding triangle may flip or become a sliver.
+bool QemEngine::collapse_is_valid(const Candidate& c, uint32_t shared_faces) const {
+    if(shared_faces > 2) return false;
+    uint32_t ring_lo[64], ring_hi[64]; int n_lo = 0, n_hi = 0;
+    for(int side=0; side<2; ++side) {
+        uint32_t v = side ? c.hi : c.lo;
+        uint32_t* ring = side ? ring_hi : ring_lo;
+        int &n = side ? n_hi : n_lo;
+        for(uint32_t k=vf_start[v]; k<vf_start[v+1]; ++k) {
+            const glm::ivec3 f = faces[vf_list[k]];
+            for(int j=0;j<3;++j) {
+                uint32_t w = (uint32_t)f[j];
+                if(w == v) continue;
+                if(std::find(ring, ring + n, w) == ring + n) { if(n == 64) return false; ring[n++] = w; }
+            }
+        }
+    }
+    int shared = 0;
+    for(int i=0;i<n_lo;++i) if(ring_lo[i] != c.hi && std::find(ring_hi, ring_hi + n_hi, ring_lo[i]) != ring_hi + n_hi) ++shared;
+    if(shared != (int)shared_faces) return false;
+
+    for(int side=0; side<2; ++side) {
+        uint32_t v = side ? c.hi : c.lo;
+        for(uint32_t k=vf_start[v]; k<vf_start[v+1]; ++k) {
+            const glm::ivec3 f = faces[vf_list[k]];
+            bool has_lo = f.x == (int)c.lo || f.y == (int)c.lo || f.z == (int)c.lo;
+            bool has_hi = f.x == (int)c.hi || f.y == (int)c.hi || f.z == (int)c.hi;
+            if(has_lo && has_hi) continue; // removed by the collapse
+            glm::vec3 a = pos[f.x], b = pos[f.y], d = pos[f.z];
+            glm::vec3 n0 = glm::cross(b - a, d - a);
+            if(f.x == (int)v) a = c.target; else if(f.y == (int)v) b = c.target; else d = c.target;
+            glm::vec3 n1 = glm::cross(b - a, d - a);
+            if(glm::dot(n0, n1) <= 0.25f * glm::length(n0) * glm::length(n1)) return false;
+        }
+    }
+    return true;
+}
+
+size_t QemEngine::pass(size_t target, std::vector<EdgeCollapse>* log) {
+    if(faces.size() <= target) return 0;
+    build_vertex_faces(nv, faces, vf_start, vf_list);
+    collect_edges(nv, faces, edges, edge_count);
+    cand.resize(edges.size());
+
+    // Score every edge in parallel (placement and cost), then sort by cost.
+    parallel_for(edges.size(), [&](size_t e){
+        Candidate &c = cand[e];
+        c.lo = (uint32_t)(edges[e] / nv); c.hi = (uint32_t)(edges[e] % nv);
+        c.valid = 0;
+        Quadric q = quad[c.lo]; q += quad[c.hi];
+        glm::dvec3 pl(pos[c.lo]), ph(pos[c.hi]);
+        double el = q.eval(pl), eh = q.eval(ph);
+        glm::dvec3 p;
+        if(half_edge) {
+            p = el <= eh ? pl : ph;
+        } else if(!q.optimum(p)) {
+            glm::dvec3 mid = (pl + ph) * 0.5;
+            double em = q.eval(mid);
+            p = el <= eh ? (el <= em ? pl : mid) : (eh <= em ? ph : mid);
+        }
+        c.keep_hi = half_edge && eh < el;
+        c.cost = (float)std::max(0.0, q.eval(p));
+        c.target = half_edge ? (c.keep_hi ? pos[c.hi] : pos[c.lo]) : glm::vec3(p);
+    });
+
+    order.resize(cand.size());
+    parallel_for(cand.size(), [&](size_t e){
+        uint32_t bits; std::memcpy(&bits, &cand[e].cost, 4);
+        order[e] = ((uint64_t)bits << 32) | (uint64_t)e;
+    });
+    parallel_radix_sort(order, [](uint64_t v){ return v >> 32; }, 32);
+
+    // Only the cheapest quarter of the edges competes in a pass; their validity is checked in parallel.
+    const size_t pool = std::max<size_t>(1, order.size() / 4);
+    parallel_for(pool, [&](size_t oi){
+        const size_t e = (uint32_t)order[oi];
+        cand[e].valid = collapse_is_valid(cand[e], edge_count[e]);
+    }, 1024);
+
+    // Greedy independent set: a collapse locks every vertex of the faces around both endpoints.
+    std::fill(locked.begin(), locked.end(), 0);
+    size_t removed = 0, collapses = 0;
+    const size_t need = faces.size() - target;
+    std::vector<uint32_t> changed;
+    for(size_t oi=0; oi<pool && removed < need; ++oi) {
+        const uint32_t e = (uint32_t)order[oi];
+        const Candidate &c = cand[e];
+        if(!c.valid || locked[c.lo] || locked[c.hi]) continue;
+        for(int side=0; side<2; ++side) {
+            uint32_t v = side ? c.hi : c.lo;
+            for(uint32_t k=vf_start[v]; k<vf_start[v+1]; ++k) {
+                const glm::ivec3 f = faces[vf_list[k]];
+                locked[f.x] = locked[f.y] = locked[f.z] = 1;
+            }
+        }
+        uint32_t keep = c.keep_hi ? c.hi : c.lo, gone = c.keep_hi ? c.lo : c.hi;
+        Quadric q = quad[c.lo]; q += quad[c.hi];
+        quad[keep] = q;
+        pos[keep] = c.target;
+        remap[gone] = keep;
+        changed.push_back(gone);
+        if(log) log->push_back({ keep, gone });
+        max_error2 = std::max(max_error2, (double)c.cost);
+        removed += edge_count[e];
+        ++collapses;
+    }
+    stats.passes++;
+    stats.collapses += collapses;
+    if(collapses == 0) return 0;
+
+    parallel_for(faces.size(), [&](size_t t){
+        glm::ivec3 &f = faces[t];
+        f = glm::ivec3((int)remap[f.x], (int)remap[f.y], (int)remap[f.z]);
+    });
+    faces.erase(std::remove_if(faces.begin(), faces.end(), [](const glm::ivec3& f){
+        return f.x == f.y || f.y == f.z || f.x == f.z;
+    }), faces.end());
+    for(uint32_t v: changed) remap[v] = v;
+    return collapses;
+}
+
+} // namespace
+
+std::vector<MeshLod> build_lod_chain(const std::vector<glm::vec3>& positions, const std::vector<glm::ivec3>& input_faces,
+                                     std::vector<float> ratios, SimplifyStats* stats) {
+    auto t0 = std::chrono::steady_clock::now();
+    std::sort(ratios.begin(), ratios.end(), std::greater<float>());
+    std::vector<MeshLod> lods(ratios.size());
+    for(size_t i=0;i<ratios.size();++i) lods[i].ratio = ratios[i];
+
+    QemEngine qem(positions, input_faces, false);
+    if(qem.input_count == 0) return lods;
+
+    size_t level = 0;
+    auto take_snapshots = [&](bool force){
+        while(level < lods.size() && (force || qem.faces.size() <= (size_t)(lods[level].ratio * qem.input_count))) {
+            snapshot(qem.pos, qem.faces, lods[level]);
+            lods[level].error = (float)std::sqrt(qem.max_error2);
+            ++level;
+        }
+    };
+    take_snapshots(false);
+    while(level < lods.size()) {
+        if(!qem.pass((size_t)(lods[level].ratio * qem.input_count), nullptr)) break;
+        take_snapshots(false);
+    }
+    // Targets the simplifier could not reach get the coarsest mesh it produced.
+    take_snapshots(true);
+
+    qem.stats.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    if(stats) *stats = qem.stats;
+    return lods;
+}
+
+std::vector<EdgeCollapse> half_edge_collapses(const std::vector<glm::vec3>& positions, const std::vector<glm::ivec3>& faces,
+                                              size_t target_faces, SimplifyStats* stats) {
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<EdgeCollapse> log;
+    QemEngine qem(positions, faces, true);
+    while(qem.pass(target_faces, &log)) {}
+    qem.stats.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    if(stats) *stats = qem.stats;
+    return log;
+}
@@ -0,0 +1,42 @@
+#pragma once
+// Quadric-error-metric (Garland-Heckbert) edge-collapse simplification.
+//
+// Collapses run in passes: every pass scores all edges in parallel (optimal
+// position, quadric cost, fold-over check), radix-sorts them by cost and greedily
+// takes an independent set of the cheapest ones, so no two collapses in a pass
+// touch the same triangles. LOD levels are snapshots taken as the face count
+// crosses each target.
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+struct MeshLod {
+    float ratio = 1.0f;  // requested fraction of the input face count
+    float error = 0.0f;  // largest collapse error so far, in object-space distance units
+    std::vector<glm::vec3> positions;
+    std::vector<glm::ivec3> faces;
+};
+
+struct SimplifyStats {
+    size_t passes = 0;
+    size_t collapses = 0;
+    double ms = 0.0;
+};
+
+struct EdgeCollapse {
+    uint32_t kept;    // stays in place
+    uint32_t removed; // merged into `kept`
+};
+
+// Returns one level per ratio (sorted from finest to coarsest). Levels whose target
+// cannot be reached hold the coarsest mesh the simplifier could produce.
+std::vector<MeshLod> build_lod_chain(const std::vector<glm::vec3>& positions, const std::vector<glm::ivec3>& faces,
+                                     std::vector<float> ratios, SimplifyStats* stats = nullptr);
+
+// Half-edge collapses (the kept vertex never moves) in the order applied, down to
+// `target_faces` or until no valid collapse remains. Reversing the list gives vertex splits.
+std::vector<EdgeCollapse> half_edge_collapses(const std::vector<glm::vec3>& positions, const std::vector<glm::ivec3>& faces,
+                                              size_t target_faces, SimplifyStats* stats = nullptr);
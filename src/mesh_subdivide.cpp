@@ -0,0 +1,228 @@
+#include "mesh_subdivide.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+namespace {
+
+const uint32_t kNone = 0xFFFFFFFFu;
+
+struct HalfEdgeRef {
+    uint64_t key;    // lo * nv + hi
+    uint32_t corner; // face * 3 + k: the edge from corner k to corner k+1
+};
+
+// Edge-indexed adjacency. Edge e joins v0[e] < v1[e]; opp0/opp1 are the vertices
+// opposite it in its first two faces (kNone when missing). face_edge[3f+k] is the
+// edge from corner k to corner k+1 of face f.
+struct EdgeTable {
+    std::vector<uint32_t> v0, v1, opp0, opp1;
+    std::vector<uint8_t> crease; // boundary or non-manifold
+    std::vector<uint32_t> face_edge;
+    size_t size() const { return v0.size(); }
+};
+
+int bits_for(uint64_t n) {
+    int bits = 8;
+    while(bits < 64 && (n >> bits)) bits += 8;
+    return bits;
+}
+
+// Per-chunk counts turned into chunk offsets; returns the total.
+template<class CountFn>
+size_t chunk_offsets(size_t n, std::vector<size_t>& offsets, CountFn count) {
+    offsets.assign(worker_count() + 1, 0);
+    parallel_chunks(n, [&](unsigned c, size_t b, size_t e){ offsets[c + 1] = count(b, e); });
+    for(size_t c=1;c<offsets.size();++c) offsets[c] += offsets[c-1];
+    return offsets.back();
+}
+
+void build_edges(size_t nv, const std::vector<glm::ivec3>& faces, EdgeTable& t) {
+    const size_t nf = faces.size();
+    std::vector<HalfEdgeRef> refs(3*nf);
+    parallel_for(nf, [&](size_t f){
+        for(int k=0;k<3;++k) {
+            uint64_t a = (uint32_t)faces[f][k], b = (uint32_t)faces[f][(k+1)%3];
+            refs[3*f+k] = { std::min(a, b) * nv + std::max(a, b), (uint32_t)(3*f + k) };
+        }
+    });
+    parallel_radix_sort(refs, [](const HalfEdgeRef& r){ return r.key; }, bits_for((uint64_t)nv * nv));
+
+    const size_t n = refs.size();
+    auto head = [&](size_t i){ return i == 0 || refs[i].key != refs[i-1].key; };
+    std::vector<size_t> offsets;
+    size_t ne = chunk_offsets(n, offsets, [&](size_t b, size_t e){
+        size_t cnt = 0;
+        for(size_t i=b;i<e;++i) cnt += head(i);
+        return cnt;
+    });
+    t.v0.resize(ne); t.v1.resize(ne); t.opp0.resize(ne); t.opp1.resize(ne);
+    t.crease.resize(ne);
+    t.face_edge.resize(3*nf);
+    auto opposite = [&](uint32_t corner){ return (uint32_t)faces[corner / 3][(corner % 3 + 2) % 3]; };
+    parallel_chunks(n, [&](unsigned c, size_t b, size_t e){
+        size_t id = offsets[c] - 1; // a chunk may start inside the previous chunk's last run
+        for(size_t i=b;i<e;++i) {
+            if(head(i)) {
+                ++id;
+                size_t run = i + 1;
+                while(run < n && refs[run].key == refs[i].key) ++run;
+                t.v0[id] = (uint32_t)(refs[i].key / nv);
+                t.v1[id] = (uint32_t)(refs[i].key % nv);
+                t.opp0[id] = opposite(refs[i].corner);
+                t.opp1[id] = run - i >= 2 ? opposite(refs[i+1].corner) : kNone;
+                t.crease[id] = run - i != 2;
+            }
+            t.face_edge[refs[i].corner] = (uint32_t)id;
+        }
+    });
+}
+
+// Vertex -> incident edges in CSR form.
+void build_vertex_edges(size_t nv, const EdgeTable& t, std::vector<uint32_t>& start, std::vector<uint32_t>& list) {
+    const size_t ne = t.size();
+    std::vector<uint64_t> pairs(2*ne);
+    parallel_for(ne, [&](size_t e){
+        pairs[2*e]   = (uint64_t)t.v0[e] << 32 | e;
+        pairs[2*e+1] = (uint64_t)t.v1[e] << 32 | e;
+    });
+    parallel_radix_sort(pairs, [](uint64_t p){ return p >> 32; }, bits_for(nv));
+    start.assign(nv + 1, 0);
+    for(uint64_t p: pairs) ++start[(p >> 32) + 1];
+    for(size_t v=0; v<nv; ++v) start[v+1] += start[v];
+    list.resize(pairs.size());
+    parallel_for(pairs.size(), [&](size_t i){ list[i] = (uint32_t)pairs[i]; });
+}
+
+} // namespace
+
+SubdivideStats loop_subdivide(std::vector<glm::vec3>& positions, std::vector<glm::ivec3>& faces, int levels, float max_edge) {
+    auto t0 = std::chrono::steady_clock::now();
+    SubdivideStats st;
+    st.input_faces = faces.size();
+    {
+        const size_t nv = positions.size();
+        size_t kept = 0;
+        for(const glm::ivec3 &t: faces) {
+            bool in_range = t.x >= 0 && t.y >= 0 && t.z >= 0 && (size_t)t.x < nv && (size_t)t.y < nv && (size_t)t.z < nv;
+            if(in_range && t.x != t.y && t.y != t.z && t.x != t.z) faces[kept++] = t;
+        }
+        faces.resize(kept);
+    }
+    const bool adaptive = max_edge > 0.0f;
+
+    EdgeTable edges;
+    std::vector<uint32_t> vstart, vlist, rank;
+    std::vector<uint8_t> split;
+    std::vector<size_t> offsets;
+    for(int level=0; level<levels && !faces.empty(); ++level) {
+        const size_t nv = positions.size(), nf = faces.size();
+        // Corner ids and vertex ids must stay 32-bit after a full 1-to-4 split.
+        if(12*nf >= 0xFFFFFFFFull || nv + 3*nf >= 0xFFFFFFFFull) break;
+        build_edges(nv, faces, edges);
+        const size_t ne = edges.size();
+
+        split.resize(ne);
+        parallel_for(ne, [&](size_t e){
+            split[e] = !adaptive || glm::length(positions[edges.v1[e]] - positions[edges.v0[e]]) > max_edge;
+        });
+        rank.resize(ne);
+        size_t ns = chunk_offsets(ne, offsets, [&](size_t b, size_t e){
+            size_t cnt = 0;
+            for(size_t i=b;i<e;++i) cnt += split[i];
+            return cnt;
+        });
+        if(ns == 0) break;
+        parallel_chunks(ne, [&](unsigned c, size_t b, size_t e){
+            uint32_t r = (uint32_t)offsets[c];
+            for(size_t i=b;i<e;++i) rank[i] = split[i] ? r++ : kNone;
+        });
+
+        // Old vertices: Warren's beta for interior vertices, the 1-6-1 crease rule on
+        // boundaries, fixed at corners and non-manifold points.
+        std::vector<glm::vec3> next(nv + ns);
+        build_vertex_edges(nv, edges, vstart, vlist);
+        parallel_for(nv, [&](size_t v){
+            const glm::vec3 p = positions[v];
+            glm::vec3 ring(0.0f), crease_ring(0.0f);
+            uint32_t n = 0, creases = 0;
+            bool all_split = true;
+            for(uint32_t i=vstart[v]; i<vstart[v+1]; ++i) {
+                uint32_t e = vlist[i];
+                const glm::vec3 q = positions[edges.v0[e] == v ? edges.v1[e] : edges.v0[e]];
+                ring += q; ++n;
+                if(edges.crease[e]) { crease_ring += q; ++creases; }
+                all_split = all_split && split[e];
+            }
+            if(!all_split || n == 0) next[v] = p;
+            else if(creases == 0) {
+                float beta = n == 3 ? 3.0f / 16.0f : 3.0f / (8.0f * n);
+                next[v] = (1.0f - n * beta) * p + beta * ring;
+            }
+            else if(creases == 2) next[v] = 0.75f * p + 0.125f * crease_ring;
+            else next[v] = p;
+        });
+        // Edge points: 3/8 of the endpoints plus 1/8 of the opposite vertices, midpoints on creases.
+        parallel_for(ne, [&](size_t e){
+            if(!split[e]) return;
+            const glm::vec3 a = positions[edges.v0[e]], b = positions[edges.v1[e]];
+            if(edges.crease[e]) next[nv + rank[e]] = 0.5f * (a + b);
+            else next[nv + rank[e]] = 0.375f * (a + b) + 0.125f * (positions[edges.opp0[e]] + positions[edges.opp1[e]]);
+        });
+
+        // Faces: 1-to-4 when all edges split, otherwise bisect / trisect towards the split edges.
+        auto splits_of = [&](size_t f){ return split[edges.face_edge[3*f]] + split[edges.face_edge[3*f+1]] + split[edges.face_edge[3*f+2]]; };
+        size_t out_faces = chunk_offsets(nf, offsets, [&](size_t b, size_t e){
+            size_t cnt = 0;
+            for(size_t f=b;f<e;++f) cnt += 1 + splits_of(f);
+            return cnt;
+        });
+        std::vector<glm::ivec3> refined(out_faces);
+        parallel_chunks(nf, [&](unsigned c, size_t b, size_t e){
+            glm::ivec3 *out = refined.data() + offsets[c];
+            for(size_t f=b;f<e;++f) {
+                const glm::ivec3 t = faces[f];
+                auto mid = [&](int k){ return (int)(nv + rank[edges.face_edge[3*f + k]]); };
+                auto is_split = [&](int k){ return split[edges.face_edge[3*f + k]] != 0; };
+                int s = splits_of(f);
+                if(s == 0) { *out++ = t; continue; }
+                if(s == 3) {
+                    int m0 = mid(0), m1 = mid(1), m2 = mid(2);
+                    *out++ = glm::ivec3(t.x, m0, m2);
+                    *out++ = glm::ivec3(m0, t.y, m1);
+                    *out++ = glm::ivec3(m2, m1, t.z);
+                    *out++ = glm::ivec3(m0, m1, m2);
+                    continue;
+                }
+                if(s == 1) {
+                    int r = is_split(0) ? 0 : is_split(1) ? 1 : 2;
+                    int a = t[r], bb = t[(r+1)%3], cc = t[(r+2)%3], m = mid(r);
+                    *out++ = glm::ivec3(a, m, cc);
+                    *out++ = glm::ivec3(m, bb, cc);
+                    continue;
+                }
+                // Two split edges: rotate so the unsplit edge runs b -> c.
+                int r = !is_split(0) ? 0 : !is_split(1) ? 1 : 2;
+                int bb = t[r], cc = t[(r+1)%3], a = t[(r+2)%3];
+                int mab = mid((r+2)%3), mca = mid((r+1)%3);
+                *out++ = glm::ivec3(a, mab, mca);
+                if(glm::length(next[mab] - next[cc]) <= glm::length(next[bb] - next[mca])) {
+                    *out++ = glm::ivec3(mab, bb, cc);
+                    *out++ = glm::ivec3(mab, cc, mca);
+                } else {
+                    *out++ = glm::ivec3(mab, bb, mca);
+                    *out++ = glm::ivec3(mca, bb, cc);
+                }
+            }
+        });
+
+        positions.swap(next);
+        faces.swap(refined);
+        st.split_edges += ns;
+        ++st.levels;
+    }
+    st.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    return st;
+}
@@ -0,0 +1,27 @@
+#pragma once
+// Loop subdivision (Loop 1987) for generating dense, smooth meshes from coarse ones.
+//
+// Each level builds an edge table (endpoints, opposite vertices, per-face edge ids)
+// with a parallel radix sort, then computes edge points, repositions the old
+// vertices and writes the refined faces in parallel passes. Boundary and
+// non-manifold edges follow the crease rules, so open meshes keep their outline.
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstddef>
+
+struct SubdivideStats {
+    int levels = 0;          // levels actually run
+    size_t input_faces = 0;
+    size_t split_edges = 0;  // over all levels
+    double ms = 0.0;
+};
+
+// Uniform when `max_edge` <= 0: every level splits each triangle into four.
+// Adaptive otherwise: only edges longer than `max_edge` are split; triangles with one
+// or two split edges are cut into two or three so the mesh stays crack-free, and old
+// vertices are only smoothed once all their edges are split. Stops after `levels`
+// levels or when no edge is longer than `max_edge`.
+SubdivideStats loop_subdivide(std::vector<glm::vec3>& positions, std::vector<glm::ivec3>& faces,
+                              int levels, float max_edge = 0.0f);
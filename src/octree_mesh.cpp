@@ -0,0 +1,372 @@
+#include "octree_mesh.h"
+#include "mesh_bounds.h"
+#include "mesh_cache.h"
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <cmath>
+
+namespace {
+
+const uint32_t kOctMagic = 0x434F4653; // "SFOC"
+const uint32_t kOctVersion = 1;
+const uint32_t kNever = std::numeric_limits<uint32_t>::max();
+const uint32_t kFlagClosed = 1;
+const int kMaxOctreeDepth = 21; // cells stop splitting here even when over the face limit
+
+struct OctHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t chunk_count;
+    uint32_t max_vertices; // largest chunk, i.e. the pool slot size
+    uint32_t max_indices;
+    uint32_t flags;
+    float center[3];
+    float radius;
+};
+
+struct OctChunkRecord {
+    float lo[3];
+    float hi[3];
+    uint32_t vertex_count;
+    uint32_t index_count;
+    uint64_t offset; // from the start of the file: vertices, then indices
+};
+
+struct OctreeBuilder {
+    const std::vector<glm::vec3>& centroids;
+    size_t chunk_faces;
+    std::vector<uint32_t> scratch;
+    std::vector<std::pair<size_t, size_t>> leaves; // face ranges in `order`, in octree order
+    size_t max_depth = 0;
+
+    // Sorts order[begin, end) into the eight octants of the cube (center, half) and recurses.
+    void split(std::vector<uint32_t>& order, size_t begin, size_t end, glm::vec3 center, float half, int depth) {
+        max_depth = std::max(max_depth, (size_t)depth);
+        if(end - begin <= chunk_faces || depth >= kMaxOctreeDepth) {
+            // An unsplittable cell (coincident centroids) still has to fit a slot.
+            for(size_t b=begin; b<end; b+=chunk_faces) leaves.emplace_back(b, std::min(end, b + chunk_faces));
+            return;
+        }
+        size_t count[9] = {0};
+        auto octant = [&](uint32_t f){
+            const glm::vec3& c = centroids[f];
+            return (c.x >= center.x ? 1 : 0) | (c.y >= center.y ? 2 : 0) | (c.z >= center.z ? 4 : 0);
+        };
+        for(size_t i=begin; i<end; ++i) ++count[octant(order[i]) + 1];
+        for(int k=0;k<8;++k) count[k+1] += count[k];
+        scratch.resize(end - begin);
+        size_t next[8];
+        std::copy(count, count + 8, next);
+        for(size_t i=begin; i<end; ++i) scratch[next[octant(order[i])]++] = order[i];
+        std::copy(scratch.begin(), scratch.begin() + (end - begin), order.begin() + begin);
+        float q = 0.5f * half;
+        for(int k=0;k<8;++k) {
+            if(count[k+1] == count[k]) continue;
+            glm::vec3 c(center.x + ((k & 1) ? q : -q), center.y + ((k & 2) ? q : -q), center.z + ((k & 4) ? q : -q));
+            split(order, begin + count[k], begin + count[k+1], c, q, depth + 1);
+        }
+    }
+};
+
+} // namespace
+
+bool write_octree_mesh(const std::string& path, const std::vector<VertexPN>& vertices,
+                       const std::vector<unsigned int>& indices, bool closed,
+                       size_t chunk_faces, OctreeBuildStats* stats) {
+    auto t0 = std::chrono::steady_clock::now();
+    const size_t nv = vertices.size();
+    chunk_faces = std::max<size_t>(chunk_faces, 1);
+
+    std::vector<uint32_t> order;
+    std::vector<glm::vec3> centroids(indices.size() / 3);
+    order.reserve(centroids.size());
+    for(size_t f=0; f<centroids.size(); ++f) {
+        unsigned int a = indices[3*f], b = indices[3*f+1], c = indices[3*f+2];
+        if(a >= nv || b >= nv || c >= nv) continue;
+        centroids[f] = (vertices[a].position + vertices[b].position + vertices[c].position) / 3.0f;
+        order.push_back((uint32_t)f);
+    }
+    if(order.empty()) { std::cerr << "Octree mesh: nothing to write" << std::endl; return false; }
+
+    std::vector<glm::vec3> positions(nv);
+    for(size_t i=0;i<nv;++i) positions[i] = vertices[i].position;
+    MeshBounds bounds = compute_bounds(positions);
+    glm::vec3 extent = bounds.box.hi - bounds.box.lo;
+    float half = 0.5f * std::max(extent.x, std::max(extent.y, extent.z));
+    OctreeBuilder builder{ centroids, chunk_faces, {}, {} };
+    builder.split(order, 0, order.size(), 0.5f * (bounds.box.lo + bounds.box.hi), half, 0);
+
+    std::error_code ec;
+    std::filesystem::path parent = std::filesystem::path(path).parent_path();
+    if(!parent.empty()) std::filesystem::create_directories(parent, ec);
+    std::string tmp = path + ".tmp";
+    OctreeBuildStats st;
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if(!out) { std::cerr << "Cannot write octree mesh: " << tmp << std::endl; return false; }
+        OctHeader h = { kOctMagic, kOctVersion, (uint32_t)builder.leaves.size(), 0, 0, closed ? kFlagClosed : 0u,
+                        { bounds.sphere.center.x, bounds.sphere.center.y, bounds.sphere.center.z }, std::max(bounds.sphere.radius, 1e-6f) };
+        std::vector<OctChunkRecord> table(builder.leaves.size());
+        out.write((const char*)&h, sizeof(h));
+        out.write((const char*)table.data(), (std::streamsize)(table.size()*sizeof(OctChunkRecord)));
+
+        // Chunk vertices are renumbered locally; `local` is reset after each chunk.
+        std::vector<uint32_t> local(nv, kNever);
+        std::vector<uint32_t> used;
+        std::vector<VertexPN> chunk_vertices;
+        std::vector<uint32_t> chunk_indices;
+        uint64_t offset = sizeof(h) + table.size()*sizeof(OctChunkRecord);
+        for(size_t c=0; c<builder.leaves.size(); ++c) {
+            used.clear();
+            chunk_indices.clear();
+            for(size_t i=builder.leaves[c].first; i<builder.leaves[c].second; ++i) {
+                for(int k=0;k<3;++k) {
+                    unsigned int v = indices[3*(size_t)order[i] + k];
+                    if(local[v] == kNever) { local[v] = (uint32_t)used.size(); used.push_back(v); }
+                    chunk_indices.push_back(local[v]);
+                }
+            }
+            chunk_vertices.resize(used.size());
+            glm::vec3 lo = vertices[used[0]].position, hi = lo;
+            for(size_t i=0;i<used.size();++i) {
+                chunk_vertices[i] = vertices[used[i]];
+                lo = glm::min(lo, chunk_vertices[i].position);
+                hi = glm::max(hi, chunk_vertices[i].position);
+                local[used[i]] = kNever;
+            }
+            OctChunkRecord& r = table[c];
+            for(int a=0;a<3;++a) { r.lo[a] = lo[a]; r.hi[a] = hi[a]; }
+            r.vertex_count = (uint32_t)chunk_vertices.size();
+            r.index_count = (uint32_t)chunk_indices.size();
+            r.offset = offset;
+            h.max_vertices = std::max(h.max_vertices, r.vertex_count);
+            h.max_indices = std::max(h.max_indices, r.index_count);
+            st.shared_vertices += chunk_vertices.size();
+            out.write((const char*)chunk_vertices.data(), (std::streamsize)(chunk_vertices.size()*sizeof(VertexPN)));
+            out.write((const char*)chunk_indices.data(), (std::streamsize)(chunk_indices.size()*sizeof(uint32_t)));
+            offset += chunk_vertices.size()*sizeof(VertexPN) + chunk_indices.size()*sizeof(uint32_t);
+        }
+        // Rewrite the header and table now that the sizes are known.
+        out.seekp(0);
+        out.write((const char*)&h, sizeof(h));
+        out.write((const char*)table.data(), (std::streamsize)(table.size()*sizeof(OctChunkRecord)));
+        if(!out) { std::cerr << "Cannot write octree mesh: " << tmp << std::endl; return false; }
+        st.file_bytes = (size_t)offset;
+    }
+    std::filesystem::rename(tmp, path, ec);
+    if(ec) return false;
+
+    if(stats) {
+        st.chunks = builder.leaves.size();
+        st.max_depth = builder.max_depth;
+        st.shared_vertices -= std::min(st.shared_vertices, nv);
+        st.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        *stats = st;
+    }
+    return true;
+}
+
+OctreeMeshStream::~OctreeMeshStream() {
+    close();
+}
+
+void OctreeMeshStream::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for(auto& t: loaders) t.join();
+    loaders.clear();
+    chunks.clear();
+    slots.clear();
+    queue.clear();
+    ready.clear();
+    waiting.clear();
+    uploading.clear();
+    pending.clear();
+    draw_list.clear();
+    loading = 0;
+    loaded_bytes = 0;
+    stopping = false;
+}
+
+bool OctreeMeshStream::open(const std::string& path, size_t pool_bytes, size_t vertex_bytes, unsigned loader_threads) {
+    close();
+    std::ifstream in(path, std::ios::binary);
+    if(!in) return false;
+    OctHeader h;
+    if(!in.read((char*)&h, sizeof(h)) || h.magic != kOctMagic || h.version != kOctVersion || h.chunk_count == 0) return false;
+    int64_t left = stream_bytes_left(in);
+    if(left < 0 || (uint64_t)h.chunk_count > (uint64_t)left / sizeof(OctChunkRecord)) return false;
+    std::vector<OctChunkRecord> table(h.chunk_count);
+    if(!in.read((char*)table.data(), (std::streamsize)(table.size()*sizeof(OctChunkRecord)))) return false;
+    uint64_t file_size = sizeof(h) + (uint64_t)left;
+
+    chunks.resize(table.size());
+    for(size_t c=0;c<table.size();++c) {
+        const OctChunkRecord& r = table[c];
+        uint64_t bytes = (uint64_t)r.vertex_count*sizeof(VertexPN) + (uint64_t)r.index_count*sizeof(uint32_t);
+        if(r.vertex_count > h.max_vertices || r.index_count > h.max_indices || r.offset + bytes > file_size) { chunks.clear(); return false; }
+        Chunk& k = chunks[c];
+        k.lo = glm::vec3(r.lo[0], r.lo[1], r.lo[2]);
+        k.hi = glm::vec3(r.hi[0], r.hi[1], r.hi[2]);
+        k.vertex_count = r.vertex_count;
+        k.index_count = r.index_count;
+        k.offset = r.offset;
+        k.state = kOnDisk;
+        k.visible = false;
+        k.coverage = 0.0f;
+        k.slot = kNever;
+    }
+    file = path;
+    max_vertices = h.max_vertices;
+    max_indices = h.max_indices;
+    center = glm::vec3(h.center[0], h.center[1], h.center[2]);
+    radius = h.radius;
+    closed = (h.flags & kFlagClosed) != 0;
+
+    size_t slot_bytes = std::max<size_t>(1, max_vertices * vertex_bytes + max_indices * sizeof(uint32_t));
+    size_t count = std::min(std::max<size_t>(pool_bytes / slot_bytes, 1), chunks.size());
+    slots.assign(count, Slot{ kNever, 0 });
+    frame = 0;
+    visible = 0;
+    evicted = 0;
+    for(unsigned t=0; t<std::max(loader_threads, 1u); ++t) loaders.emplace_back([this]{ load_chunks(); });
+    return true;
+}
+
+size_t OctreeMeshStream::bytes_read() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return loaded_bytes;
+}
+
+void OctreeMeshStream::load_chunks() {
+    std::ifstream in(file, std::ios::binary);
+    std::unique_lock<std::mutex> lock(mutex);
+    for(;;) {
+        wake.wait(lock, [this]{ return stopping || !queue.empty(); });
+        if(stopping) return;
+        Loaded l;
+        l.chunk = queue.back();
+        queue.pop_back();
+        Chunk& c = chunks[l.chunk];
+        c.state = kLoading;
+        uint64_t offset = c.offset;
+        l.vertices.resize(c.vertex_count);
+        l.indices.resize(c.index_count);
+        ++loading;
+        lock.unlock();
+
+        in.clear();
+        in.seekg((std::streamoff)offset);
+        in.read((char*)l.vertices.data(), (std::streamsize)(l.vertices.size()*sizeof(VertexPN)));
+        in.read((char*)l.indices.data(), (std::streamsize)(l.indices.size()*sizeof(uint32_t)));
+        bool ok = (bool)in;
+        for(size_t i=0; ok && i<l.indices.size(); ++i) ok = l.indices[i] < l.vertices.size();
+
+        lock.lock();
+        --loading;
+        if(!ok) {
+            std::cerr << "Octree mesh: cannot read chunk " << l.chunk << " of " << file << std::endl;
+            l.vertices.clear();
+            l.indices.clear();
+        }
+        loaded_bytes += l.vertices.size()*sizeof(VertexPN) + l.indices.size()*sizeof(uint32_t);
+        ready.push_back(std::move(l));
+    }
+}
+
+void OctreeMeshStream::update(const glm::mat4& model_view, const glm::mat4& proj, int viewport_height, size_t upload_bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++frame;
+    pending.clear();
+    uploading.clear();
+    draw_list.clear();
+    if(chunks.empty()) return;
+
+    // Visibility and screen coverage of each chunk's bounding sphere.
+    glm::mat4 clip = proj * model_view;
+    glm::vec4 planes[6];
+    frustum_planes(clip, planes);
+    float scale = glm::length(glm::vec3(model_view[0]));
+    bool perspective = proj[2][3] != 0.0f;
+    float pixels = proj[1][1] * 0.5f * (float)std::max(viewport_height, 1);
+    visible = 0;
+    for(Chunk& c: chunks) {
+        glm::vec3 mid = 0.5f * (c.lo + c.hi);
+        float r = 0.5f * glm::length(c.hi - c.lo);
+        c.visible = sphere_in_frustum(planes, mid, r);
+        if(!c.visible) { c.coverage = 0.0f; continue; }
+        ++visible;
+        float dist = -(model_view * glm::vec4(mid, 1.0f)).z;
+        float rv = r * scale;
+        float px = perspective ? (dist > rv ? rv * pixels / dist : std::numeric_limits<float>::max()) : rv * pixels;
+        c.coverage = px < 1e18f ? 3.14159265f * px * px : std::numeric_limits<float>::max();
+        if(c.state == kResident) slots[c.slot].last_used = frame;
+    }
+
+    // Finished loads, most wanted first, go to free slots or replace chunks that are not in view.
+    for(Loaded& l: ready) waiting.push_back(std::move(l));
+    ready.clear();
+    std::sort(waiting.begin(), waiting.end(), [&](const Loaded& a, const Loaded& b){
+        return chunks[a.chunk].coverage > chunks[b.chunk].coverage;
+    });
+    size_t budget = 0;
+    std::vector<Loaded> keep;
+    for(Loaded& l: waiting) {
+        Chunk& c = chunks[l.chunk];
+        if(!c.visible || l.indices.empty()) { c.state = kOnDisk; continue; }
+        size_t bytes = l.vertices.size()*sizeof(VertexPN) + l.indices.size()*sizeof(uint32_t);
+        if(!uploading.empty() && budget + bytes > upload_bytes) { c.state = kReady; keep.push_back(std::move(l)); continue; }
+        uint32_t best = kNever;
+        for(uint32_t s=0; s<slots.size(); ++s) {
+            if(slots[s].chunk == kNever) { best = s; break; }
+            if(slots[s].last_used < frame && (best == kNever || slots[s].last_used < slots[best].last_used)) best = s;
+        }
+        if(best == kNever) { c.state = kOnDisk; continue; } // the pool is full of visible chunks
+        if(slots[best].chunk != kNever) {
+            Chunk& old = chunks[slots[best].chunk];
+            old.state = kOnDisk;
+            old.slot = kNever;
+            ++evicted;
+        }
+        slots[best] = Slot{ l.chunk, frame };
+        c.state = kResident;
+        c.slot = best;
+        budget += bytes;
+        uploading.push_back(std::move(l));
+    }
+    waiting.swap(keep);
+    for(const Loaded& l: uploading)
+        pending.push_back(OctreeUpload{ chunks[l.chunk].slot, l.vertices.data(), l.vertices.size(), l.indices.data(), l.indices.size() });
+
+    // Requeue the missing visible chunks, no more than there are slots they could take.
+    size_t open_slots = 0;
+    for(const Slot& s: slots) open_slots += s.chunk == kNever || s.last_used < frame;
+    size_t in_flight = loading + waiting.size();
+    size_t capacity = open_slots > in_flight ? open_slots - in_flight : 0;
+    std::vector<uint32_t> wanted;
+    for(uint32_t i=0; i<chunks.size(); ++i) {
+        Chunk& c = chunks[i];
+        if(c.state == kQueued) c.state = kOnDisk;
+        if(c.visible && c.state == kOnDisk) wanted.push_back(i);
+    }
+    std::sort(wanted.begin(), wanted.end(), [&](uint32_t a, uint32_t b){ return chunks[a].coverage > chunks[b].coverage; });
+    if(wanted.size() > capacity) wanted.resize(capacity);
+    std::reverse(wanted.begin(), wanted.end());
+    for(uint32_t i: wanted) chunks[i].state = kQueued;
+    queue.swap(wanted);
+    if(!queue.empty()) wake.notify_all();
+
+    for(uint32_t i=0; i<chunks.size(); ++i)
+        if(chunks[i].visible && chunks[i].state == kResident) draw_list.push_back(OctreeDraw{ chunks[i].slot, chunks[i].index_count });
+    std::sort(draw_list.begin(), draw_list.end(), [&](const OctreeDraw& a, const OctreeDraw& b){
+        return chunks[slots[a.slot].chunk].coverage > chunks[slots[b.slot].chunk].coverage;
+    });
+}
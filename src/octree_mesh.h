@@ -0,0 +1,127 @@
+#pragma once
+// Out-of-core meshes: triangles partitioned into octree chunks on disk, streamed
+// into a fixed pool of GPU slots.
+//
+// The writer splits octree cells by triangle centroid until each leaf holds at most
+// `chunk_faces` triangles and stores every leaf as a self-contained chunk (its own
+// vertices, local indices and bounds). The stream keeps only the chunk table in
+// memory. Each frame it frustum-culls the chunks, queues the missing visible ones for
+// background loader threads in order of screen coverage, and hands finished loads to
+// the renderer as (slot, data) uploads. A slot is reused for the least recently
+// visible chunk once the pool is full, so GPU memory stays at the pool size.
+
+#include "vertex_layout.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+
+struct OctreeBuildStats {
+    size_t chunks = 0;
+    size_t max_depth = 0;
+    size_t shared_vertices = 0; // extra copies of vertices on chunk borders
+    size_t file_bytes = 0;
+    double ms = 0.0;
+};
+
+// Writes (vertices, indices) as octree chunks of at most `chunk_faces` triangles.
+// `closed` is stored for the reader (back-face culling is safe).
+bool write_octree_mesh(const std::string& path, const std::vector<VertexPN>& vertices,
+                       const std::vector<unsigned int>& indices, bool closed,
+                       size_t chunk_faces = 1 << 16, OctreeBuildStats* stats = nullptr);
+
+// A loaded chunk to copy into pool slot `slot`; the pointers stay valid until the next update().
+struct OctreeUpload {
+    uint32_t slot;
+    const VertexPN* vertices;
+    size_t vertex_count;
+    const uint32_t* indices;
+    size_t index_count;
+};
+
+struct OctreeDraw {
+    uint32_t slot;
+    uint32_t index_count;
+};
+
+class OctreeMeshStream {
+public:
+    ~OctreeMeshStream();
+
+    // Reads the chunk table and starts the loaders. The pool gets as many slots as fit
+    // in `pool_bytes` at `vertex_bytes` per vertex (at least one, at most one per chunk).
+    bool open(const std::string& path, size_t pool_bytes, size_t vertex_bytes, unsigned loader_threads = 2);
+    void close();
+
+    // `model_view` maps chunk coordinates to eye space. Culls, re-prioritises the load
+    // queue, assigns finished loads to slots (at most `upload_bytes` of them) and
+    // rebuilds the draw list, nearest-looking chunks first.
+    void update(const glm::mat4& model_view, const glm::mat4& proj, int viewport_height, size_t upload_bytes);
+    const std::vector<OctreeUpload>& uploads() const { return pending; }
+    const std::vector<OctreeDraw>& draws() const { return draw_list; }
+
+    // Pool geometry: slot s owns vertices [s*slot_vertices, ...) and indices [s*slot_indices, ...).
+    size_t slot_count() const { return slots.size(); }
+    size_t slot_vertices() const { return max_vertices; }
+    size_t slot_indices() const { return max_indices; }
+
+    size_t chunk_count() const { return chunks.size(); }
+    size_t visible_chunks() const { return visible; }
+    size_t resident_visible_chunks() const { return draw_list.size(); }
+    size_t bytes_read() const;
+    size_t evictions() const { return evicted; }
+
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = 1.0f;
+    bool closed = false;
+
+private:
+    enum State : uint8_t { kOnDisk, kQueued, kLoading, kReady, kResident };
+    struct Chunk {
+        glm::vec3 lo, hi;
+        uint32_t vertex_count, index_count;
+        uint64_t offset;
+        State state;
+        bool visible;
+        float coverage; // projected pixels; load and draw priority
+        uint32_t slot;
+    };
+    struct Slot {
+        uint32_t chunk;
+        uint64_t last_used; // frame the chunk was last visible
+    };
+    struct Loaded {
+        uint32_t chunk;
+        std::vector<VertexPN> vertices;
+        std::vector<uint32_t> indices;
+    };
+
+    void load_chunks();
+
+    std::string file;
+    std::vector<Chunk> chunks;
+    std::vector<Slot> slots;
+    size_t max_vertices = 0, max_indices = 0;
+    uint64_t frame = 0;
+    size_t visible = 0, evicted = 0;
+    std::vector<OctreeUpload> pending;
+    std::vector<Loaded> uploading; // backs `pending`
+    std::vector<Loaded> waiting;   // loaded but over this frame's upload budget
+    std::vector<OctreeDraw> draw_list;
+
+    // Shared with the loaders: `queue` is sorted so the most wanted chunk is last.
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::vector<uint32_t> queue;
+    std::vector<Loaded> ready;
+    size_t loading = 0;
+    size_t loaded_bytes = 0;
+    bool stopping = false;
+    std::vector<std::thread> loaders;
+};
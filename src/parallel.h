@@ -0,0 +1,72 @@
+#pragma once
+// Small std::thread helpers shared by the mesh passes.
+
+#include <thread>
+#include <vector>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+
+inline unsigned worker_count() {
+    unsigned n = std::thread::hardware_concurrency();
+    return n ? n : 4;
+}
+
+// Splits [0,n) into at most worker_count() contiguous chunks and runs
+// fn(chunk, begin, end) for each one, the last on the calling thread.
+// Inputs smaller than `grain` run as a single chunk.
+template<class F>
+unsigned parallel_chunks(size_t n, F&& fn, size_t grain = 16384) {
+    if(n == 0) return 0;
+    unsigned chunks = (unsigned)std::min<size_t>(worker_count(), (n + grain - 1) / grain);
+    if(chunks <= 1) { fn(0u, (size_t)0, n); return 1; }
+    std::vector<std::thread> pool;
+    pool.reserve(chunks - 1);
+    for(unsigned c=0;c+1<chunks;++c) {
+        size_t b = n*c/chunks, e = n*(c+1)/chunks;
+        pool.emplace_back([&fn, c, b, e]{ fn(c, b, e); });
+    }
+    fn(chunks - 1, n*(chunks - 1)/chunks, n);
+    for(auto &t: pool) t.join();
+    return chunks;
+}
+
+template<class F>
+void parallel_for(size_t n, F&& fn, size_t grain = 16384) {
+    parallel_chunks(n, [&fn](unsigned, size_t b, size_t e){ for(size_t i=b;i<e;++i) fn(i); }, grain);
+}
+
+// Stable LSD radix sort, 8 bits per pass over the low `key_bits` bits of key(item).
+// Histograms and scatters are per chunk, so each pass is parallel and linear.
+template<class T, class KeyFn>
+void parallel_radix_sort(std::vector<T>& items, KeyFn key, int key_bits) {
+    size_t n = items.size();
+    if(n < 2) return;
+    std::vector<T> tmp(n);
+    unsigned chunks = (unsigned)std::min<size_t>(worker_count(), (n + 65535) / 65536);
+    if(chunks == 0) chunks = 1;
+    std::vector<std::array<size_t, 256>> hist(chunks);
+    auto run = [&](auto&& body) {
+        std::vector<std::thread> pool;
+        for(unsigned c=1;c<chunks;++c) pool.emplace_back([&body, c]{ body(c); });
+        body(0u);
+        for(auto &t: pool) t.join();
+    };
+    for(int shift=0; shift<key_bits; shift+=8) {
+        run([&](unsigned c){
+            auto &h = hist[c]; h.fill(0);
+            size_t b = n*c/chunks, e = n*(c+1)/chunks;
+            for(size_t i=b;i<e;++i) h[(key(items[i]) >> shift) & 255]++;
+        });
+        size_t sum = 0;
+        for(int d=0;d<256;++d)
+            for(unsigned c=0;c<chunks;++c) { size_t t = hist[c][d]; hist[c][d] = sum; sum += t; }
+        run([&](unsigned c){
+            auto &h = hist[c];
+            size_t b = n*c/chunks, e = n*(c+1)/chunks;
+            for(size_t i=b;i<e;++i) tmp[h[(key(items[i]) >> shift) & 255]++] = items[i];
+        });
+        items.swap(tmp);
+    }
+}
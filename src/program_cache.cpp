@@ -0,0 +1,95 @@
+#include "program_cache.h"
+#include "mesh_cache.h"
+#include "gl_ext.h"
+
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+#include <cstring>
+
+namespace {
+
+const uint32_t kProgramMagic = 0x42474653; // "SFGB"
+const uint32_t kProgramVersion = 1;
+
+struct ProgramHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    uint32_t format;  // driver binary format
+    uint32_t length;
+};
+
+uint64_t hash_string(const char* s, uint64_t seed) {
+    return s ? hash_bytes(s, std::strlen(s), seed) : hash_bytes(nullptr, 0, seed + 1);
+}
+
+} // namespace
+
+uint64_t program_cache_key(const std::vector<const char*>& sources) {
+    uint64_t h = kProgramVersion;
+    h = hash_string((const char*)glGetString(GL_VENDOR), h);
+    h = hash_string((const char*)glGetString(GL_RENDERER), h);
+    h = hash_string((const char*)glGetString(GL_VERSION), h);
+    for(const char* s: sources) h = hash_string(s, h);
+    return h;
+}
+
+GLuint load_cached_program(uint64_t key) {
+    if(!gl_ext.program_binary) return 0;
+    std::string path = mesh_cache_path(key, ".glbin");
+    std::ifstream in(path, std::ios::binary);
+    if(!in) return 0;
+    ProgramHeader h;
+    if(!in.read((char*)&h, sizeof(h)) || h.magic != kProgramMagic || h.version != kProgramVersion || h.key != key) return 0;
+    if(h.length == 0 || (int64_t)h.length > stream_bytes_left(in)) return 0;
+    std::vector<char> binary(h.length);
+    if(!in.read(binary.data(), (std::streamsize)binary.size())) return 0;
+    in.close();
+
+    GLuint prog = glCreateProgram();
+    gl_ext.ProgramBinary(prog, (GLenum)h.format, binary.data(), (GLsizei)binary.size());
+    GLint ok = 0;
+    glGetProgramiv(prog, GL_LINK_STATUS, &ok);
+    if(!ok) {
+        // Same key but rejected, e.g. after a driver update that kept its version string.
+        std::cerr << "Program cache: driver rejected " << path << ", compiling from source" << std::endl;
+        glDeleteProgram(prog);
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+        return 0;
+    }
+    return prog;
+}
+
+void prepare_program_for_cache(GLuint prog) {
+    if(gl_ext.program_binary) gl_ext.ProgramParameteri(prog, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+bool save_cached_program(uint64_t key, GLuint prog) {
+    if(!gl_ext.program_binary) return false;
+    GLint ok = 0, length = 0;
+    glGetProgramiv(prog, GL_LINK_STATUS, &ok);
+    glGetProgramiv(prog, GL_PROGRAM_BINARY_LENGTH, &length);
+    if(!ok || length <= 0) return false;
+    std::vector<char> binary((size_t)length);
+    GLsizei written = 0;
+    GLenum format = 0;
+    gl_ext.GetProgramBinary(prog, length, &written, &format, binary.data());
+    if(written <= 0) return false;
+
+    std::string path = mesh_cache_path(key, ".glbin");
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if(!out) { std::cerr << "Cannot write program cache: " << tmp << std::endl; return false; }
+        ProgramHeader h = { kProgramMagic, kProgramVersion, key, (uint32_t)format, (uint32_t)written };
+        out.write((const char*)&h, sizeof(h));
+        out.write(binary.data(), written);
+        if(!out) { std::cerr << "Cannot write program cache: " << tmp << std::endl; return false; }
+    }
+    std::filesystem::rename(tmp, path, ec);
+    return !ec;
+}
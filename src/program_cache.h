@@ -0,0 +1,23 @@
+#pragma once
+// On-disk cache of linked shader programs (driver binaries), stored as cache/<key>.glbin.
+//
+// The key hashes the shader sources together with the driver's GL_VENDOR, GL_RENDERER
+// and GL_VERSION strings, so a driver update misses instead of handing the new driver
+// an old binary. A driver may still reject a binary it wrote (glProgramBinary leaves
+// the program unlinked); load_cached_program() then deletes the entry and returns 0,
+// and the caller compiles from source. Without GL 4.1 or GL_ARB_get_program_binary
+// every load misses and saves do nothing. Attribute locations are part of the binary.
+
+#include <glad/glad.h>
+
+#include <vector>
+#include <cstdint>
+
+uint64_t program_cache_key(const std::vector<const char*>& sources);
+
+// A linked program from the cached binary, or 0 on a miss or a stale entry.
+GLuint load_cached_program(uint64_t key);
+
+// Call between glCreateProgram and glLinkProgram for programs that will be saved.
+void prepare_program_for_cache(GLuint prog);
+bool save_cached_program(uint64_t key, GLuint prog);
@@ -0,0 +1,299 @@
+#include "progressive_mesh.h"
+#include "mesh_simplify.h"
+#include "mesh_bounds.h"
+#include "mesh_cache.h"
+#include "parallel.h"
+
+#include <iostream>
+#include <filesystem>
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+namespace {
+
+const uint32_t kPmMagic = 0x484D5053; // "SPMH"
+const uint32_t kPmVersion = 1;
+const uint32_t kNever = std::numeric_limits<uint32_t>::max();
+const uint32_t kFlagClosed = 1;
+
+struct PmHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertex_count;  // final (fully refined) counts
+    uint32_t face_count;
+    uint32_t base_vertices;
+    uint32_t base_faces;
+    uint32_t split_count;
+    uint32_t flags;
+    float center[3];
+    float radius;
+};
+
+// Fixed part of one split record; followed by `corner_count` index slots and
+// `face_count` triangles (3 indices each).
+struct PmSplit {
+    VertexPN vertex;
+    uint32_t corner_count;
+    uint32_t face_count;
+};
+
+// Representative of `v` once the collapses before `step` are applied.
+inline uint32_t resolve(uint32_t v, uint32_t step, const std::vector<uint32_t>& when, const std::vector<uint32_t>& into) {
+    while(when[v] < step) v = into[v];
+    return v;
+}
+
+// Collapse that makes the chains of `a` and `b` meet, or kNever.
+inline uint32_t merge_step(uint32_t a, uint32_t b, const std::vector<uint32_t>& when, const std::vector<uint32_t>& into) {
+    uint32_t last = kNever;
+    while(a != b) {
+        uint32_t sa = when[a], sb = when[b];
+        if(sa == kNever && sb == kNever) return kNever;
+        if(sa < sb) { last = sa; a = into[a]; }
+        else { last = sb; b = into[b]; }
+    }
+    return last;
+}
+
+// Every directed edge appears once and its reverse appears too: closed and consistently wound.
+bool is_closed(size_t nv, const std::vector<glm::ivec3>& faces) {
+    std::vector<uint64_t> edges(faces.size() * 3);
+    parallel_for(faces.size(), [&](size_t f){
+        for(int k=0;k<3;++k) edges[f*3 + k] = (uint64_t)faces[f][k] * nv + (uint64_t)faces[f][(k+1)%3];
+    });
+    int bits = 1;
+    while(bits < 64 && ((uint64_t)1 << bits) < (uint64_t)nv * nv) ++bits;
+    parallel_radix_sort(edges, [](uint64_t e){ return e; }, bits);
+    for(size_t i=0;i<edges.size();++i) {
+        if(i && edges[i] == edges[i-1]) return false;
+        uint64_t reverse = (edges[i] % nv) * nv + edges[i] / nv;
+        if(!std::binary_search(edges.begin(), edges.end(), reverse)) return false;
+    }
+    return true;
+}
+
+} // namespace
+
+bool write_progressive_mesh(const std::string& path, const std::vector<VertexPN>& vertices,
+                            const std::vector<unsigned int>& indices, size_t base_faces, PmBuildStats* stats) {
+    auto t0 = std::chrono::steady_clock::now();
+
+    // Only referenced vertices and proper triangles take part; the stream keeps their order.
+    std::vector<uint32_t> compact(vertices.size(), kNever);
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> source;
+    std::vector<glm::ivec3> faces;
+    faces.reserve(indices.size() / 3);
+    for(size_t i=0;i + 2<indices.size();i+=3) {
+        unsigned int a = indices[i], b = indices[i+1], c = indices[i+2];
+        if(a >= vertices.size() || b >= vertices.size() || c >= vertices.size()) continue;
+        if(a == b || b == c || a == c) continue;
+        glm::ivec3 f;
+        for(int k=0;k<3;++k) {
+            unsigned int v = indices[i+k];
+            if(compact[v] == kNever) {
+                compact[v] = (uint32_t)positions.size();
+                positions.push_back(vertices[v].position);
+                source.push_back(v);
+            }
+            f[k] = (int)compact[v];
+        }
+        faces.push_back(f);
+    }
+    const size_t nv = positions.size(), nf = faces.size();
+    if(nv == 0 || nf == 0) { std::cerr << "Progressive mesh: nothing to write" << std::endl; return false; }
+
+    std::vector<EdgeCollapse> log = half_edge_collapses(positions, faces, base_faces);
+    const uint32_t ns = (uint32_t)log.size();
+
+    std::vector<uint32_t> when(nv, kNever), into(nv);
+    for(uint32_t v=0; v<nv; ++v) into[v] = v;
+    for(uint32_t s=0; s<ns; ++s) { when[log[s].removed] = s; into[log[s].removed] = log[s].kept; }
+
+    // Vertex order: survivors of the full collapse sequence, then one vertex per split.
+    std::vector<uint32_t> id(nv);
+    uint32_t nb = 0;
+    for(uint32_t v=0; v<nv; ++v) if(when[v] == kNever) id[v] = nb++;
+    for(uint32_t k=0; k<ns; ++k) id[log[ns - 1 - k].removed] = nb + k;
+
+    // A face disappears at the collapse that merges two of its corners; split s
+    // (applied in order ns-1 .. 0) restores the faces removed by collapse s.
+    std::vector<uint32_t> gone(nf);
+    parallel_for(nf, [&](size_t f){
+        uint32_t a = (uint32_t)faces[f].x, b = (uint32_t)faces[f].y, c = (uint32_t)faces[f].z;
+        gone[f] = std::min({ merge_step(a, b, when, into), merge_step(b, c, when, into), merge_step(a, c, when, into) });
+    });
+
+    // Face slots: base faces first, then grouped by split in refinement order.
+    std::vector<uint32_t> split_faces(ns + 1, 0); // count per refinement position, prefix-summed
+    size_t nbf = 0;
+    for(size_t f=0; f<nf; ++f) {
+        if(gone[f] == kNever) ++nbf;
+        else ++split_faces[ns - 1 - gone[f] + 1];
+    }
+    for(uint32_t k=0; k<ns; ++k) split_faces[k+1] += split_faces[k];
+    std::vector<uint32_t> slot(nf);
+    {
+        std::vector<uint32_t> next(split_faces.begin(), split_faces.end() - 1);
+        uint32_t base_next = 0;
+        for(size_t f=0; f<nf; ++f)
+            slot[f] = gone[f] == kNever ? base_next++ : (uint32_t)nbf + next[ns - 1 - gone[f]]++;
+    }
+
+    // Every corner shows the first vertex on its chain still alive at the time; the
+    // chain links collapsed before the face's own removal are retargets at later splits.
+    std::vector<uint32_t> final_index(nf * 3);
+    std::vector<uint32_t> retarget_count(ns + 1, 0);
+    for(size_t f=0; f<nf; ++f) {
+        for(int k=0;k<3;++k) {
+            uint32_t v = (uint32_t)faces[f][k];
+            final_index[(size_t)slot[f]*3 + k] = id[resolve(v, gone[f], when, into)];
+            for(; when[v] < gone[f]; v = into[v]) ++retarget_count[ns - 1 - when[v] + 1];
+        }
+    }
+    for(uint32_t k=0; k<ns; ++k) retarget_count[k+1] += retarget_count[k];
+    std::vector<uint32_t> retargets(retarget_count[ns]);
+    {
+        std::vector<uint32_t> next(retarget_count.begin(), retarget_count.end() - 1);
+        for(size_t f=0; f<nf; ++f)
+            for(int k=0;k<3;++k)
+                for(uint32_t v = (uint32_t)faces[f][k]; when[v] < gone[f]; v = into[v])
+                    retargets[next[ns - 1 - when[v]]++] = slot[f]*3 + k;
+    }
+
+    MeshBounds bounds = compute_bounds(positions);
+    glm::vec3 center = bounds.sphere.center;
+    float radius = bounds.sphere.radius;
+
+    std::error_code ec;
+    std::filesystem::path parent = std::filesystem::path(path).parent_path();
+    if(!parent.empty()) std::filesystem::create_directories(parent, ec);
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if(!out) { std::cerr << "Cannot write progressive mesh: " << tmp << std::endl; return false; }
+        PmHeader h = { kPmMagic, kPmVersion, (uint32_t)nv, (uint32_t)nf, nb, (uint32_t)nbf, ns,
+                       is_closed(nv, faces) ? kFlagClosed : 0u, { center.x, center.y, center.z }, std::max(radius, 1e-6f) };
+        out.write((const char*)&h, sizeof(h));
+        std::vector<VertexPN> base(nb);
+        for(uint32_t v=0; v<nv; ++v) if(when[v] == kNever) base[id[v]] = vertices[source[v]];
+        out.write((const char*)base.data(), (std::streamsize)(base.size()*sizeof(VertexPN)));
+        out.write((const char*)final_index.data(), (std::streamsize)(nbf*3*sizeof(uint32_t)));
+        for(uint32_t k=0; k<ns; ++k) {
+            const EdgeCollapse &c = log[ns - 1 - k];
+            PmSplit s = { vertices[source[c.removed]], retarget_count[k+1] - retarget_count[k], split_faces[k+1] - split_faces[k] };
+            out.write((const char*)&s, sizeof(s));
+            out.write((const char*)(retargets.data() + retarget_count[k]), (std::streamsize)(s.corner_count*sizeof(uint32_t)));
+            out.write((const char*)(final_index.data() + (nbf + split_faces[k])*3), (std::streamsize)(s.face_count*3*sizeof(uint32_t)));
+        }
+        if(!out) { std::cerr << "Cannot write progressive mesh: " << tmp << std::endl; return false; }
+        if(stats) stats->file_bytes = (size_t)out.tellp();
+    }
+    std::filesystem::rename(tmp, path, ec);
+    if(ec) return false;
+
+    if(stats) {
+        stats->base_vertices = nb;
+        stats->base_faces = nbf;
+        stats->splits = ns;
+        stats->ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    }
+    return true;
+}
+
+bool ProgressiveMeshStream::open(const std::string& path) {
+    in.close();
+    in.clear();
+    in.open(path, std::ios::binary);
+    if(!in) return false;
+    PmHeader h;
+    if(!in.read((char*)&h, sizeof(h)) || h.magic != kPmMagic || h.version != kPmVersion) return false;
+    if(h.base_vertices + h.split_count != h.vertex_count || h.base_faces > h.face_count || h.base_vertices == 0) return false;
+    // Every vertex and face is stored somewhere in the file: the base arrays, then one
+    // record per split carrying its vertex and its new faces.
+    uint64_t least = (uint64_t)h.base_vertices * sizeof(VertexPN) + (uint64_t)h.split_count * sizeof(PmSplit)
+                   + (uint64_t)h.face_count * 3 * sizeof(uint32_t);
+    int64_t left = stream_bytes_left(in);
+    if(left < 0 || (uint64_t)left < least) return false;
+
+    verts.assign(h.vertex_count, VertexPN());
+    idx.assign((size_t)h.face_count * 3, 0u);
+    in.read((char*)verts.data(), (std::streamsize)(h.base_vertices*sizeof(VertexPN)));
+    in.read((char*)idx.data(), (std::streamsize)((size_t)h.base_faces*3*sizeof(uint32_t)));
+    if(!in) return false;
+    for(size_t i=0;i<(size_t)h.base_faces*3;++i) if(idx[i] >= h.base_vertices) return false;
+
+    center = glm::vec3(h.center[0], h.center[1], h.center[2]);
+    radius = h.radius;
+    closed = (h.flags & kFlagClosed) != 0;
+    vertex_count = h.base_vertices;
+    index_count = (size_t)h.base_faces * 3;
+    split_count = h.split_count;
+    applied = 0;
+    bytes = sizeof(h) + h.base_vertices*sizeof(VertexPN) + index_count*sizeof(uint32_t);
+    dirty_v_lo = 0; dirty_v_hi = vertex_count;
+    dirty_slots.clear();
+    dirty_i_first = 0;
+    return true;
+}
+
+size_t ProgressiveMeshStream::refine(double budget_ms) {
+    auto t0 = std::chrono::steady_clock::now();
+    size_t done = 0;
+    while(applied < split_count) {
+        // Check the clock every few splits; a split costs well under a microsecond.
+        if((done & 63) == 63 && std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count() >= budget_ms) break;
+        PmSplit s;
+        if(!in.read((char*)&s, sizeof(s))) { split_count = applied; break; }
+        scratch.resize((size_t)s.corner_count + (size_t)s.face_count*3);
+        in.read((char*)scratch.data(), (std::streamsize)(scratch.size()*sizeof(uint32_t)));
+        if(!in || index_count + (size_t)s.face_count*3 > idx.size()) { split_count = applied; break; }
+
+        uint32_t v = (uint32_t)vertex_count++;
+        verts[v] = s.vertex;
+        dirty_v_lo = std::min(dirty_v_lo, (size_t)v);
+        dirty_v_hi = std::max(dirty_v_hi, (size_t)v + 1);
+        // Retargets below the appended tail are scattered; remember them individually.
+        for(uint32_t i=0;i<s.corner_count;++i) {
+            uint32_t c = scratch[i];
+            if(c >= index_count) continue;
+            idx[c] = v;
+            if(c < dirty_i_first) dirty_slots.push_back(c);
+        }
+        const uint32_t *tri = scratch.data() + s.corner_count;
+        for(size_t i=0;i<(size_t)s.face_count*3;++i) idx[index_count++] = tri[i] <= v ? tri[i] : v;
+        bytes += sizeof(s) + scratch.size()*sizeof(uint32_t);
+        ++applied;
+        ++done;
+    }
+    return done;
+}
+
+bool ProgressiveMeshStream::take_dirty(size_t& vertex_first, size_t& vertex_count_out,
+                                       std::vector<std::pair<size_t, size_t>>& index_ranges) {
+    index_ranges.clear();
+    // Nearby retargets are merged: one slightly larger upload beats many tiny ones.
+    const size_t kGap = 256;
+    std::sort(dirty_slots.begin(), dirty_slots.end());
+    for(uint32_t c: dirty_slots) {
+        if(!index_ranges.empty() && c < index_ranges.back().first + index_ranges.back().second + kGap)
+            index_ranges.back().second = std::max(index_ranges.back().second, (size_t)c + 1 - index_ranges.back().first);
+        else
+            index_ranges.push_back({ (size_t)c, 1 });
+    }
+    if(index_count > dirty_i_first) {
+        if(!index_ranges.empty() && dirty_i_first < index_ranges.back().first + index_ranges.back().second + kGap)
+            index_ranges.back().second = index_count - index_ranges.back().first;
+        else
+            index_ranges.push_back({ dirty_i_first, index_count - dirty_i_first });
+    }
+    bool any = dirty_v_hi > dirty_v_lo || !index_ranges.empty();
+    vertex_first = dirty_v_lo;
+    vertex_count_out = dirty_v_hi > dirty_v_lo ? dirty_v_hi - dirty_v_lo : 0;
+    dirty_v_lo = std::numeric_limits<size_t>::max();
+    dirty_v_hi = 0;
+    dirty_slots.clear();
+    dirty_i_first = index_count;
+    return any;
+}
@@ -0,0 +1,70 @@
+#pragma once
+// Progressive meshes: a coarse base mesh plus an ordered stream of vertex splits.
+//
+// The writer runs half-edge collapses offline and lays the final vertex and index
+// buffers out in refinement order: base vertices and faces first, then one new
+// vertex and the faces it restores per split. A split therefore only appends a
+// vertex, appends faces, and retargets a list of index slots to the new vertex,
+// so the renderer can keep full-size GPU buffers and upload the dirty ranges.
+
+#include "vertex_layout.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+
+struct PmBuildStats {
+    size_t base_vertices = 0;
+    size_t base_faces = 0;
+    size_t splits = 0;
+    size_t file_bytes = 0;
+    double ms = 0.0;
+};
+
+// Writes the progressive form of (vertices, indices); the base mesh is simplified
+// towards `base_faces` triangles.
+bool write_progressive_mesh(const std::string& path, const std::vector<VertexPN>& vertices,
+                            const std::vector<unsigned int>& indices, size_t base_faces = 512,
+                            PmBuildStats* stats = nullptr);
+
+class ProgressiveMeshStream {
+public:
+    // Reads the header and the base mesh; splits stay on disk until refine().
+    bool open(const std::string& path);
+    // Applies splits read from disk until `budget_ms` has elapsed or the stream ends.
+    size_t refine(double budget_ms);
+    bool complete() const { return applied == split_count; }
+
+    // Vertex range and (first, count) index ranges touched since the last call;
+    // false when nothing changed.
+    bool take_dirty(size_t& vertex_first, size_t& vertex_count, std::vector<std::pair<size_t, size_t>>& index_ranges);
+
+    // Sized for the final mesh; only the first active_*() entries are meaningful.
+    const std::vector<VertexPN>& vertices() const { return verts; }
+    const std::vector<unsigned int>& indices() const { return idx; }
+    size_t active_vertices() const { return vertex_count; }
+    size_t active_indices() const { return index_count; }
+    size_t splits_applied() const { return applied; }
+    size_t splits_total() const { return split_count; }
+    size_t bytes_read() const { return bytes; }
+
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = 1.0f;
+    bool closed = false; // full mesh is closed and consistently wound
+
+private:
+    std::ifstream in;
+    std::vector<VertexPN> verts;
+    std::vector<unsigned int> idx;
+    size_t vertex_count = 0, index_count = 0;
+    size_t split_count = 0, applied = 0, bytes = 0;
+    size_t dirty_v_lo = 0, dirty_v_hi = 0;
+    size_t dirty_i_first = 0;            // everything from here to index_count is new
+    std::vector<uint32_t> dirty_slots;   // retargeted slots below dirty_i_first
+    std::vector<uint32_t> scratch;
+};
@@ -6,20 +6,43 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include <vector>
+#include <map>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <cmath>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdio>
+#include <chrono>
+#include <thread>
+#include <atomic>
 
-struct Vertex { glm::vec3 pos; glm::vec3 normal; };
+#include "vertex_layout.h"
+#include "mesh_clean.h"
+#include "mesh_cache.h"
+#include "mesh_subdivide.h"
+#include "mesh_bounds.h"
+#include "mesh_pick.h"
+#include "mesh_ao.h"
+#include "uniform_table.h"
+#include "stream_ring.h"
+#include "program_cache.h"
+#include "light_clusters.h"
+
+using Vertex = VertexPN;
 struct Material { glm::vec3 ambient, diffuse, specular; float shininess; };
 
 static std::vector<Vertex> g_vertices;
 static std::vector<unsigned int> g_indices;
-static GLuint g_VAO = 0, g_VBO = 0, g_EBO = 0;
+static GpuMesh g_mesh;
 
 static bool g_usePhong = true;
+static int g_lightCount = 2;      // L cycles 1..kMaxLights
+static bool g_specular = true;    // H toggles
+static bool g_deferred = false;   // R toggles: G-buffer and light volumes instead of forward shading
+static bool g_depthPrepass = false; // Z toggles: forward shading behind a depth-only pass
 static int g_materialIndex = 0;
 static Material g_materials[3];
 
@@ -27,6 +50,38 @@ static float camAngle = 0.0f, camRadius = 3.5f, camHeight = 0.0f;
 static float lightAngle = 0.0f, lightRadius = 2.0f, lightHeight = 0.5f;
 
 static bool g_perspective = true;
+static const float kFovY = glm::radians(45.0f);
+// Centres the model on its bounding sphere and scales it to unit radius; the lights and
+// the camera orbit are laid out for a unit-sized model at the origin.
+static glm::mat4 g_modelNormalize(1.0f);
+
+static bool g_weld = false;
+static float g_weldEpsilon = 0.0f; // 0: derived from the bounding box
+static bool g_clean = false;
+static bool g_useMeshCache = true;
+static int g_cacheCompressBits = 0; // > 0: compressed cache, positions quantised to this many bits
+static bool g_orient = false;
+static bool g_cullBackFaces = false;
+static int g_subdivideLevels = 0;
+static float g_subdivideMaxEdge = 0.0f; // > 0: adaptive, as a fraction of the bounding-box half-diagonal
+
+static bool g_ao = false;
+static int g_aoRays = 64;
+static bool g_aoVisible = true; // B toggles the baked occlusion to compare
+
+static size_t g_pointLightCount = 0; // --lights: clustered point lights on top of the two main ones
+static std::vector<PointLight> g_pointLights;
+static LightClusters g_clusters;
+
+static size_t g_instanceCount = 0; // --instances: copies of the model, all drawn by one instanced call
+static std::vector<InstanceData> g_instances;        // every copy
+static std::vector<InstanceData> g_visibleInstances; // this frame's copies inside the view frustum
+static double g_instanceCullMs = 0.0;
+static float g_sceneRadius = 1.0f; // bounding radius of everything drawn: the unit model or the instance grid
+
+// The picked face index is also the triangle's offset in g_indices.
+static MeshPicker g_picker;
+static uint32_t g_pickedFace = RayHit::kNone;
 
 static double lastFrameTime = 0.0;
 
@@ -44,206 +99,913 @@ static std::string readFileToString(const std::string &path) {
     std::stringstream ss; ss << ifs.rdbuf(); return ss.str();
 }
 
-static bool loadSMF(const std::string &filename, std::vector<glm::vec3> &positions, std::vector<glm::ivec3> &faces) {
-    std::ifstream in(filename);
-    if (!in.is_open()) { std::cerr << "Cannot open SMF: " << filename << '\n'; return false; }
-    std::string line; int ln = 0;
-    while (std::getline(in, line)) {
-        ++ln;
-        if (line.empty() || line[0] == '#') continue;
-        std::istringstream ss(line);
-        char type; ss >> type;
-        if (type == 'v') {
-            glm::vec3 p; if (!(ss >> p.x >> p.y >> p.z)) { std::cerr<<"Bad v at "<<ln<<"\n"; continue; }
-            positions.push_back(p);
-        } else if (type == 'f') {
-            glm::ivec3 f; if (!(ss >> f.x >> f.y >> f.z)) { std::cerr<<"Bad f at "<<ln<<"\n"; continue; }
-            f -= glm::ivec3(1);
-            if (f.x < 0 || f.y < 0 || f.z < 0) { std::cerr<<"Invalid face idx at "<<ln<<"\n"; continue; }
-            faces.push_back(f);
-        }
-    }
-    return !positions.empty() && !faces.empty();
+// Uniform blocks shared by every program. The UBO behind them is bound once, so
+// switching programs costs no uniform uploads; the C++ mirrors are below.
+static const int kMaxLights = 2; // world light, camera light
+static const char* shading_blocks = R"(
+#define MAX_LIGHTS 2
+layout(std140) uniform FrameBlock {
+    mat4 model;
+    mat4 view;
+    mat4 projection;
+    vec3 viewPos;
+    float aoStrength;
+};
+struct Light {
+    vec3 position;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+layout(std140) uniform LightBlock {
+    Light lights[MAX_LIGHTS];
+};
+layout(std140) uniform MaterialBlock {
+    vec3 materialAmbient;
+    vec3 materialDiffuse;
+    vec3 materialSpec;
+    float materialShininess;
+};
+#define MATERIAL_COUNT 3
+struct Material {
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+    float shininess;
+};
+layout(std140) uniform MaterialTable {
+    Material materials[MATERIAL_COUNT];
+};
+Material blockMaterial() { return Material(materialAmbient, materialDiffuse, materialSpec, materialShininess); }
+)";
+
+// std140 images of the blocks: every vec3 starts a new 16-byte slot, and a float
+// right after one fills its fourth component.
+struct FrameBlock {
+    glm::mat4 model, view, projection;
+    glm::vec3 viewPos; float aoStrength;
+};
+struct LightStd140 {
+    glm::vec3 position; float pad0;
+    glm::vec3 ambient;  float pad1;
+    glm::vec3 diffuse;  float pad2;
+    glm::vec3 specular; float pad3;
+};
+struct LightBlock {
+    LightStd140 lights[kMaxLights];
+};
+struct MaterialBlock {
+    glm::vec3 ambient;  float pad0;
+    glm::vec3 diffuse;  float pad1;
+    glm::vec3 specular; float shininess;
+};
+static_assert(sizeof(FrameBlock) == 208 && offsetof(FrameBlock, viewPos) == 192, "FrameBlock must match std140");
+static_assert(sizeof(LightBlock) == 64 * kMaxLights, "LightBlock must match std140");
+static_assert(sizeof(MaterialBlock) == 48 && offsetof(MaterialBlock, shininess) == 44, "MaterialBlock must match std140");
+enum ShadingBlock { kFrameBlock, kLightBlock, kMaterialBlock, kMaterialTableBlock };
+
+// Shader permutations. Both stages are written once and specialised by the #defines a
+// ShadingKey puts after #version: PHONG (per-fragment instead of per-vertex lighting),
+// SPECULAR, QUANTIZED_INPUT (SNORM8 normals get renormalised before interpolation),
+// INSTANCED (per-instance placement and material index) and SHADE_LIGHTS, which the
+// key expands into one shadeLight() call per light with a constant index. Disabled
+// features therefore leave no code in the variant.
+static const char* shading_lighting = R"(
+vec3 shadeLight(int i, Material m, vec3 P, vec3 N, vec3 V, float ambientScale) {
+    vec3 L = normalize(lights[i].position - P);
+    vec3 c = ambientScale * lights[i].ambient * m.ambient;
+    c += lights[i].diffuse * max(dot(N, L), 0.0) * m.diffuse;
+#if SPECULAR
+    vec3 R = reflect(-L, N);
+    c += lights[i].specular * pow(max(dot(V, R), 0.0), m.shininess) * m.specular;
+#endif
+    return c;
+}
+vec3 shade(Material m, vec3 P, vec3 N, float ambientScale) {
+    vec3 V = normalize(viewPos - P);
+    vec3 result = vec3(0.0);
+    SHADE_LIGHTS
+    return result;
 }
+)";
 
-static const char* gouraud_vs = R"(
-#version 130
+// Vertex stages only: world placement, through the instance's rows when INSTANCED
+// (rotation and uniform scale, so normals need no inverse transpose).
+static const char* instance_transform = R"(
 in vec3 aPos;
+#if INSTANCED
+in vec4 aInstanceRow0;
+in vec4 aInstanceRow1;
+in vec4 aInstanceRow2;
+in float aInstanceMaterial;
+vec3 worldPosition() {
+    vec4 p = model * vec4(aPos, 1.0);
+    return vec3(dot(aInstanceRow0, p), dot(aInstanceRow1, p), dot(aInstanceRow2, p));
+}
+vec3 worldNormal(vec3 n) {
+    n = mat3(model) * n;
+    return normalize(vec3(dot(aInstanceRow0.xyz, n), dot(aInstanceRow1.xyz, n), dot(aInstanceRow2.xyz, n)));
+}
+int instanceMaterial() { return clamp(int(aInstanceMaterial), 0, MATERIAL_COUNT - 1); }
+#else
+vec3 worldPosition() { return vec3(model * vec4(aPos, 1.0)); }
+vec3 worldNormal(vec3 n) { return normalize(mat3(model) * n); }
+#endif
+)";
+
+static const char* shading_vs = R"(
 in vec3 aNormal;
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-uniform vec3 viewPos;
-uniform vec3 worldLightPos;
-uniform vec3 worldLightAmbient;
-uniform vec3 worldLightDiffuse;
-uniform vec3 worldLightSpec;
-uniform vec3 cameraLightPos;
-uniform vec3 cameraLightAmbient;
-uniform vec3 cameraLightDiffuse;
-uniform vec3 cameraLightSpec;
-uniform vec3 materialAmbient;
-uniform vec3 materialDiffuse;
-uniform vec3 materialSpec;
-uniform float materialShininess;
+in float aOcclusion;
+invariant gl_Position; // must match depth_vs bit for bit under the pre-pass's GL_EQUAL
+#if PHONG
+out vec3 FragPos;
+out vec3 Normal;
+out float Occlusion;
+#if INSTANCED
+flat out int MaterialIndex;
+#endif
+#else
 out vec3 outColor;
+#endif
 void main() {
-    vec3 FragPos = vec3(model * vec4(aPos,1.0));
-    vec3 N = normalize(mat3(model) * aNormal);
-    vec3 viewDir = normalize(viewPos - FragPos);
-
-    vec3 result = vec3(0.0);
-
-    // world light
-    vec3 L1 = normalize(worldLightPos - FragPos);
-    float diff1 = max(dot(N, L1), 0.0);
-    vec3 R1 = reflect(-L1, N);
-    float spec1 = pow(max(dot(viewDir, R1), 0.0), materialShininess);
-    result += worldLightAmbient * materialAmbient;
-    result += worldLightDiffuse * diff1 * materialDiffuse;
-    result += worldLightSpec * spec1 * materialSpec;
-
-    // camera light
-    vec3 L2 = normalize(cameraLightPos - FragPos);
-    float diff2 = max(dot(N, L2), 0.0);
-    vec3 R2 = reflect(-L2, N);
-    float spec2 = pow(max(dot(viewDir, R2), 0.0), materialShininess);
-    result += cameraLightAmbient * materialAmbient;
-    result += cameraLightDiffuse * diff2 * materialDiffuse;
-    result += cameraLightSpec * spec2 * materialSpec;
-
-    outColor = result;
-    gl_Position = projection * view * model * vec4(aPos,1.0);
+    vec3 worldPos = worldPosition();
+#if QUANTIZED_INPUT
+    vec3 n = normalize(aNormal);
+#else
+    vec3 n = aNormal;
+#endif
+#if PHONG
+    FragPos = worldPos;
+    Normal = worldNormal(n);
+    Occlusion = aOcclusion;
+#if INSTANCED
+    MaterialIndex = instanceMaterial();
+#endif
+#else
+#if INSTANCED
+    Material m = materials[instanceMaterial()];
+#else
+    Material m = blockMaterial();
+#endif
+    outColor = shade(m, worldPos, worldNormal(n), 1.0 - aoStrength * aOcclusion);
+#endif
+    gl_Position = projection * view * vec4(worldPos, 1.0);
 }
 )";
 
-static const char* gouraud_fs = R"(
-#version 130
+static const char* shading_fs = R"(
+#if PHONG
+in vec3 FragPos;
+in vec3 Normal;
+in float Occlusion;
+#if INSTANCED
+flat in int MaterialIndex;
+#endif
+#else
 in vec3 outColor;
+#endif
 out vec4 FragColor;
-void main() { FragColor = vec4(outColor, 1.0); }
-)";
+uniform vec4 highlight;
+#if CLUSTERED
+uniform samplerBuffer pointLights;    // two texels per light: position and radius, colour
+uniform usamplerBuffer clusterCells;  // per cluster: first entry in clusterIndices, count
+uniform usamplerBuffer clusterIndices;
+uniform vec4 clusterScale;            // 1 / tile pixels (x, y), depth slice scale and bias
+uniform vec4 clusterDims;
 
-static const char* phong_vs = R"(
-#version 130
-in vec3 aPos;
-in vec3 aNormal;
-out vec3 FragPos;
-out vec3 Normal;
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+vec3 shadeClusterLights(Material m, vec3 P, vec3 N) {
+    vec3 V = normalize(viewPos - P);
+    float depth = -(view * vec4(P, 1.0)).z;
+    ivec3 dims = ivec3(clusterDims.xyz);
+    ivec3 cluster = ivec3(gl_FragCoord.xy * clusterScale.xy, log(max(depth, 1e-6)) * clusterScale.z + clusterScale.w);
+    cluster = clamp(cluster, ivec3(0), dims - 1);
+    uvec2 cell = texelFetch(clusterCells, (cluster.z * dims.y + cluster.y) * dims.x + cluster.x).xy;
+    vec3 result = vec3(0.0);
+    for (uint k = 0u; k < cell.y; ++k) {
+        int i = int(texelFetch(clusterIndices, int(cell.x + k)).x);
+        vec4 sphere = texelFetch(pointLights, 2 * i);
+        vec3 color = texelFetch(pointLights, 2 * i + 1).rgb;
+        vec3 toLight = sphere.xyz - P;
+        float d = length(toLight);
+        float falloff = clamp(1.0 - d / sphere.w, 0.0, 1.0);
+        vec3 L = toLight / max(d, 1e-6);
+        vec3 lit = color * max(dot(N, L), 0.0) * m.diffuse;
+#if SPECULAR
+        lit += color * pow(max(dot(V, reflect(-L, N)), 0.0), m.shininess) * m.specular;
+#endif
+        result += falloff * falloff * lit;
+    }
+    return result;
+}
+#endif
 void main() {
-    FragPos = vec3(model * vec4(aPos,1.0));
-    Normal = normalize(mat3(model) * aNormal);
-    gl_Position = projection * view * model * vec4(aPos,1.0);
+#if PHONG
+#if INSTANCED
+    Material m = materials[MaterialIndex];
+#else
+    Material m = blockMaterial();
+#endif
+    vec3 color = shade(m, FragPos, normalize(Normal), 1.0 - aoStrength * Occlusion);
+#if CLUSTERED
+    color += shadeClusterLights(m, FragPos, normalize(Normal));
+#endif
+#else
+    vec3 color = outColor;
+#endif
+    FragColor = highlight.a > 0.0 ? highlight : vec4(color, 1.0);
 }
 )";
 
-static const char* phong_fs = R"(
-#version 130
+// Deferred path. The G-buffer pass runs the Phong vertex shader and stores, per pixel,
+// depth, the world normal with the ambient scale, and a material ID (255: picked face).
+// Lighting then reads it back: one fullscreen pass for the main lights, and one
+// screen-space quad per point light, sized to the light sphere's projection and
+// added with blending, so each light costs the pixels it covers.
+static const int kMaterialCount = 3;
+static const unsigned kHighlightMaterial = 255;
+static const char* gbuffer_fs = R"(
 in vec3 FragPos;
 in vec3 Normal;
+in float Occlusion;
+out vec4 gNormal;
+out uvec4 gMaterial;
+uniform vec4 highlight;
+#if INSTANCED
+flat in int MaterialIndex;
+#else
+uniform int materialId;
+#endif
+void main() {
+    gNormal = vec4(normalize(Normal), 1.0 - aoStrength * Occlusion);
+#if INSTANCED
+    gMaterial = uvec4(uint(MaterialIndex));
+#else
+    gMaterial = uvec4(highlight.a > 0.0 ? 255u : uint(materialId));
+#endif
+}
+)";
+
+static const char* deferred_common = R"(
+uniform sampler2D gDepth;
+uniform sampler2D gNormal;
+uniform usampler2D gMaterial;
+uniform samplerBuffer pointLights; // two texels per light: position and radius, colour
+uniform mat4 invViewProj;
+uniform vec4 viewport;             // width, height, near plane, unused
+
+// False for background pixels.
+bool readGBuffer(out vec3 P, out vec3 N, out float ambientScale, out uint id) {
+    ivec2 px = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, px, 0).r;
+    if (depth >= 1.0) return false;
+    vec4 g = texelFetch(gNormal, px, 0);
+    N = normalize(g.xyz);
+    ambientScale = g.w;
+    id = texelFetch(gMaterial, px, 0).r;
+    vec4 p = invViewProj * vec4(gl_FragCoord.xy / viewport.xy * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    P = p.xyz / p.w;
+    return true;
+}
+
+vec3 phongTerms(Material m, vec3 N, vec3 V, vec3 L, vec3 diffuse, vec3 specular) {
+    vec3 c = diffuse * max(dot(N, L), 0.0) * m.diffuse;
+#if SPECULAR
+    c += specular * pow(max(dot(V, reflect(-L, N)), 0.0), m.shininess) * m.specular;
+#endif
+    return c;
+}
+)";
+
+// A triangle covering the screen, from gl_VertexID alone.
+static const char* fullscreen_vs = R"(
+void main() {
+    vec2 p = vec2(gl_VertexID == 1 ? 3.0 : -1.0, gl_VertexID == 2 ? 3.0 : -1.0);
+    gl_Position = vec4(p, 0.0, 1.0);
+}
+)";
+
+static const char* deferred_lights_fs = R"(
 out vec4 FragColor;
-uniform vec3 viewPos;
-uniform vec3 worldLightPos;
-uniform vec3 worldLightAmbient;
-uniform vec3 worldLightDiffuse;
-uniform vec3 worldLightSpec;
-uniform vec3 cameraLightPos;
-uniform vec3 cameraLightAmbient;
-uniform vec3 cameraLightDiffuse;
-uniform vec3 cameraLightSpec;
-uniform vec3 materialAmbient;
-uniform vec3 materialDiffuse;
-uniform vec3 materialSpec;
-uniform float materialShininess;
+uniform vec4 highlight;
 void main() {
-    vec3 N = normalize(Normal);
-    vec3 viewDir = normalize(viewPos - FragPos);
-    vec3 result = vec3(0.0);
+    vec3 P, N;
+    float ambientScale;
+    uint id;
+    if (!readGBuffer(P, N, ambientScale, id)) discard;
+    if (id == 255u) { FragColor = highlight; return; }
+    Material m = materials[min(int(id), MATERIAL_COUNT - 1)];
+    FragColor = vec4(shade(m, P, N, ambientScale), 1.0);
+}
+)";
 
-    vec3 L1 = normalize(worldLightPos - FragPos);
-    float diff1 = max(dot(N, L1), 0.0);
-    vec3 R1 = reflect(-L1, N);
-    float spec1 = pow(max(dot(viewDir, R1), 0.0), materialShininess);
-    result += worldLightAmbient * materialAmbient;
-    result += worldLightDiffuse * diff1 * materialDiffuse;
-    result += worldLightSpec * spec1 * materialSpec;
+// Instance i covers the screen rectangle of point light i's sphere: the bounds of its
+// view-space box, or the whole screen when the sphere reaches the near plane.
+static const char* light_volume_vs = R"(
+flat out int lightIndex;
+void main() {
+    lightIndex = gl_InstanceID;
+    vec4 sphere = texelFetch(pointLights, 2 * gl_InstanceID);
+    vec3 c = (view * vec4(sphere.xyz, 1.0)).xyz;
+    float r = sphere.w;
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+    if (c.z - r > -viewport.z) { gl_Position = vec4(2.0, 2.0, 2.0, 1.0); return; } // entirely behind the near plane
+    vec2 lo = vec2(-1.0), hi = vec2(1.0);
+    if (c.z + r < -viewport.z) {
+        lo = vec2(1.0); hi = vec2(-1.0);
+        for (int k = 0; k < 8; ++k) {
+            vec3 q = c + r * vec3((k & 1) != 0 ? 1.0 : -1.0, (k & 2) != 0 ? 1.0 : -1.0, (k & 4) != 0 ? 1.0 : -1.0);
+            vec4 p = projection * vec4(q, 1.0);
+            lo = min(lo, p.xy / p.w);
+            hi = max(hi, p.xy / p.w);
+        }
+        lo = max(lo, vec2(-1.0));
+        hi = min(hi, vec2(1.0));
+    }
+    gl_Position = vec4(mix(lo, hi, corner), 0.0, 1.0);
+}
+)";
 
-    vec3 L2 = normalize(cameraLightPos - FragPos);
-    float diff2 = max(dot(N, L2), 0.0);
-    vec3 R2 = reflect(-L2, N);
-    float spec2 = pow(max(dot(viewDir, R2), 0.0), materialShininess);
-    result += cameraLightAmbient * materialAmbient;
-    result += cameraLightDiffuse * diff2 * materialDiffuse;
-    result += cameraLightSpec * spec2 * materialSpec;
+static const char* light_volume_fs = R"(
+flat in int lightIndex;
+out vec4 FragColor;
+void main() {
+    vec3 P, N;
+    float ambientScale;
+    uint id;
+    if (!readGBuffer(P, N, ambientScale, id) || id == 255u) discard;
+    vec4 sphere = texelFetch(pointLights, 2 * lightIndex);
+    vec3 toLight = sphere.xyz - P;
+    float d = length(toLight);
+    if (d >= sphere.w) discard;
+    float falloff = 1.0 - d / sphere.w;
+    vec3 color = texelFetch(pointLights, 2 * lightIndex + 1).rgb;
+    Material m = materials[min(int(id), MATERIAL_COUNT - 1)];
+    FragColor = vec4(falloff * falloff * phongTerms(m, N, normalize(viewPos - P), toLight / max(d, 1e-6), color, color), 1.0);
+}
+)";
 
-    FragColor = vec4(result, 1.0);
+// Depth pre-pass: positions only, from the mesh's depth stream, and no colour output.
+// The position math is the same as in shading_vs; with both outputs declared invariant
+// the colour pass reproduces these depths and GL_EQUAL passes only the nearest
+// surface, so each pixel is shaded once.
+static const char* depth_vs = R"(
+invariant gl_Position;
+void main() {
+    gl_Position = projection * view * vec4(worldPosition(), 1.0);
 }
 )";
 
-static GLuint compileProgramFromSources(const char* vsSrc, const char* fsSrc) {
-    GLuint vs = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vs, 1, &vsSrc, NULL);
-    glCompileShader(vs);
-    GLint ok; glGetShaderiv(vs, GL_COMPILE_STATUS, &ok);
-    if (!ok) { char buf[1024]; glGetShaderInfoLog(vs, 1024, NULL, buf); std::cerr<<"VS compile error: "<<buf<<"\n"; }
-
-    GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fs, 1, &fsSrc, NULL);
-    glCompileShader(fs);
-    glGetShaderiv(fs, GL_COMPILE_STATUS, &ok);
-    if (!ok) { char buf[1024]; glGetShaderInfoLog(fs, 1024, NULL, buf); std::cerr<<"FS compile error: "<<buf<<"\n"; }
-
-    GLuint prog = glCreateProgram();
-    glAttachShader(prog, vs);
-    glAttachShader(prog, fs);
-    glBindAttribLocation(prog, 0, "aPos");
-    glBindAttribLocation(prog, 1, "aNormal");
-    glLinkProgram(prog);
-    glGetProgramiv(prog, GL_LINK_STATUS, &ok);
-    if (!ok) { char buf[1024]; glGetProgramInfoLog(prog, 1024, NULL, buf); std::cerr<<"Link error: "<<buf<<"\n"; }
-    glDeleteShader(vs); glDeleteShader(fs);
-    return prog;
-}
-
-static bool buildMeshFromSMF(const std::string &path) {
+static const char* depth_fs = R"(
+void main() {}
+)";
+
+struct ShadingKey {
+    enum Pass { kForward, kGBuffer, kDeferredLights, kLightVolumes, kDepth };
+    Pass pass = kForward;
+    bool phong = true;
+    int lights = kMaxLights; // 1..kMaxLights, taken in LightBlock order
+    bool specular = true;
+    bool quantized = MeshLayout::quantised;
+    bool clustered = false; // Phong only: add the --lights point lights from the cluster lists
+    bool instanced = false; // --instances: placement and material per instance
+
+    uint32_t packed() const {
+        return (phong ? 1u : 0u) | (specular ? 2u : 0u) | (quantized ? 4u : 0u) | (clustered ? 8u : 0u) | ((uint32_t)lights << 4)
+             | ((uint32_t)pass << 8) | (instanced ? 1u << 12 : 0u);
+    }
+
+    std::string defines() const {
+        bool perFragment = phong || pass != kForward;
+        std::string d = "#define PHONG " + std::to_string(perFragment ? 1 : 0) + "\n#define SPECULAR " + std::to_string(specular ? 1 : 0)
+                      + "\n#define QUANTIZED_INPUT " + std::to_string(quantized ? 1 : 0)
+                      + "\n#define CLUSTERED " + std::to_string(clustered ? 1 : 0)
+                      + "\n#define INSTANCED " + std::to_string(instanced ? 1 : 0) + "\n#define SHADE_LIGHTS";
+        for (int i=0;i<lights;++i) d += " result += shadeLight(" + std::to_string(i) + ", m, P, N, V, ambientScale);";
+        return d + "\n";
+    }
+
+    std::string name() const {
+        std::string lightCount = std::to_string(lights) + (lights == 1 ? " light" : " lights");
+        std::string features = std::string(specular ? "" : ", no specular") + (quantized ? ", quantised" : "")
+                             + (instanced ? ", instanced" : "");
+        switch (pass) {
+        case kGBuffer: return std::string("G-buffer") + (quantized ? ", quantised" : "") + (instanced ? ", instanced" : "");
+        case kDeferredLights: return "Deferred, " + lightCount + features;
+        case kLightVolumes: return std::string("Light volumes") + (specular ? "" : ", no specular");
+        case kDepth: return std::string("Depth only") + (instanced ? ", instanced" : "");
+        default: return std::string(phong ? "Phong" : "Gouraud") + ", " + lightCount + features + (clustered ? ", clustered" : "");
+        }
+    }
+
+    std::string source(GLenum stage) const {
+        std::string head = std::string("#version 140\n") + defines() + shading_blocks + shading_lighting;
+        bool vertex = stage == GL_VERTEX_SHADER;
+        std::string placed = head + instance_transform;
+        switch (pass) {
+        case kGBuffer: return vertex ? placed + shading_vs : head + gbuffer_fs;
+        case kDeferredLights: return head + deferred_common + (vertex ? fullscreen_vs : deferred_lights_fs);
+        case kLightVolumes: return head + deferred_common + (vertex ? light_volume_vs : light_volume_fs);
+        case kDepth: return vertex ? placed + depth_vs : head + depth_fs;
+        default: return vertex ? placed + shading_vs : head + shading_fs;
+        }
+    }
+};
+
+// Loose uniforms of one shading program, resolved from its reflected table after
+// linking; everything else comes from the shared blocks.
+struct ShadingUniforms {
+    UniformTable table;
+    int highlight;
+    int pointLights, clusterCells, clusterIndices, clusterScale, clusterDims; // clustered variants only
+    int materialId, gDepth, gNormal, gMaterial, invViewProj, viewport;     // deferred passes only
+
+    void resolve(GLuint prog, const ShadingKey &key) {
+        table.reflect(prog);
+        highlight = table.find("highlight");
+        pointLights = table.find("pointLights");
+        clusterCells = table.find("clusterCells");
+        clusterIndices = table.find("clusterIndices");
+        clusterScale = table.find("clusterScale");
+        clusterDims = table.find("clusterDims");
+        materialId = table.find("materialId");
+        gDepth = table.find("gDepth");
+        gNormal = table.find("gNormal");
+        gMaterial = table.find("gMaterial");
+        invViewProj = table.find("invViewProj");
+        viewport = table.find("viewport");
+        // set() ignores -1, so a sampler the table cannot reflect would silently stay on unit 0.
+        auto require = [&](const char *uniform, int handle) {
+            if (handle < 0) std::cerr << "Shading program (" << key.name() << ") has no uniform " << uniform << "\n";
+        };
+        if (key.pass == ShadingKey::kDeferredLights || key.pass == ShadingKey::kLightVolumes) {
+            require("gDepth", gDepth);
+            require("gNormal", gNormal);
+            require("gMaterial", gMaterial);
+            require("invViewProj", invViewProj);
+            require("viewport", viewport);
+        }
+        if (key.pass == ShadingKey::kLightVolumes) require("pointLights", pointLights);
+        if (key.pass == ShadingKey::kForward && key.phong && key.clustered) {
+            require("pointLights", pointLights);
+            require("clusterCells", clusterCells);
+            require("clusterIndices", clusterIndices);
+            require("clusterScale", clusterScale);
+            require("clusterDims", clusterDims);
+        }
+        // Every pass reads FrameBlock; the others are only bound where a pass uses them.
+        if (!bind_uniform_block(prog, "FrameBlock", kFrameBlock)) std::cerr << "Shading program is missing FrameBlock\n";
+        bind_uniform_block(prog, "LightBlock", kLightBlock);
+        bind_uniform_block(prog, "MaterialBlock", kMaterialBlock);
+        bind_uniform_block(prog, "MaterialTable", kMaterialTableBlock);
+    }
+};
+
+// A program whose compile and link have been issued but not yet checked. With parallel
+// shader compilation the driver works on it in the background until programReady().
+struct PendingProgram {
+    GLuint prog = 0, vs = 0, fs = 0;
+    uint64_t key = 0;
+    bool cached = false;
+};
+
+static PendingProgram beginProgram(const char* vsSrc, const char* fsSrc) {
+    PendingProgram p;
+    p.key = program_cache_key({ vsSrc, fsSrc });
+    if (g_useMeshCache && (p.prog = load_cached_program(p.key))) {
+        std::cout << "Program cache hit: " << mesh_cache_path(p.key, ".glbin") << "\n";
+        p.cached = true;
+        return p;
+    }
+    p.vs = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(p.vs, 1, &vsSrc, NULL);
+    glCompileShader(p.vs);
+    p.fs = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(p.fs, 1, &fsSrc, NULL);
+    glCompileShader(p.fs);
+
+    p.prog = glCreateProgram();
+    glAttachShader(p.prog, p.vs);
+    glAttachShader(p.prog, p.fs);
+    bind_attrib_locations<MeshLayout>(p.prog);
+    glBindFragDataLocation(p.prog, 0, "FragColor");
+    glBindFragDataLocation(p.prog, 0, "gNormal");
+    glBindFragDataLocation(p.prog, 1, "gMaterial");
+    prepare_program_for_cache(p.prog);
+    glLinkProgram(p.prog);
+    return p;
+}
+
+// Never blocks. Without parallel compilation the status queries in finishProgram() are
+// where the driver would wait, so the program counts as ready straight away.
+static bool programReady(const PendingProgram &p) {
+    if (p.cached || !gl_ext.parallel_shader_compile) return true;
+    GLint done = GL_FALSE;
+    glGetProgramiv(p.prog, GL_COMPLETION_STATUS_KHR, &done);
+    return done == GL_TRUE;
+}
+
+// Reports compile and link errors and caches the binary of a successful link.
+static GLuint finishProgram(PendingProgram &p) {
+    if (p.cached) return p.prog;
+    GLint ok; glGetShaderiv(p.vs, GL_COMPILE_STATUS, &ok);
+    if (!ok) { char buf[1024]; glGetShaderInfoLog(p.vs, 1024, NULL, buf); std::cerr<<"VS compile error: "<<buf<<"\n"; }
+    glGetShaderiv(p.fs, GL_COMPILE_STATUS, &ok);
+    if (!ok) { char buf[1024]; glGetShaderInfoLog(p.fs, 1024, NULL, buf); std::cerr<<"FS compile error: "<<buf<<"\n"; }
+    glGetProgramiv(p.prog, GL_LINK_STATUS, &ok);
+    if (!ok) { char buf[1024]; glGetProgramInfoLog(p.prog, 1024, NULL, buf); std::cerr<<"Link error: "<<buf<<"\n"; }
+    else if (g_useMeshCache) save_cached_program(p.key, p.prog);
+    glDeleteShader(p.vs); glDeleteShader(p.fs);
+    p.vs = p.fs = 0;
+    return p.prog;
+}
+
+// Compiled permutations by ShadingKey::packed(); each is built the first time it is used.
+struct ShaderVariant {
+    std::string name;
+    GLuint prog = 0;
+    ShadingUniforms uniforms;
+};
+static std::map<uint32_t, ShaderVariant> g_variants;
+
+static PendingProgram beginVariant(const ShadingKey &key) {
+    return beginProgram(key.source(GL_VERTEX_SHADER).c_str(), key.source(GL_FRAGMENT_SHADER).c_str());
+}
+
+static ShaderVariant &addVariant(const ShadingKey &key, PendingProgram &pending) {
+    ShaderVariant &v = g_variants[key.packed()];
+    v.name = key.name();
+    v.prog = finishProgram(pending);
+    v.uniforms.resolve(v.prog, key);
+    return v;
+}
+
+static ShaderVariant &shaderVariant(const ShadingKey &key) {
+    auto it = g_variants.find(key.packed());
+    if (it != g_variants.end()) return it->second;
+    auto t0 = std::chrono::steady_clock::now();
+    PendingProgram pending = beginVariant(key);
+    ShaderVariant &v = addVariant(key, pending);
+    std::cout << "Shader variant: " << v.name << " ("
+              << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count() << " ms)\n";
+    return v;
+}
+
+// Texture buffers behind the clustered light lists (GL 3.1 has no storage buffers):
+// lights as RGBA32F, cells as RG32UI and the index list as R32UI, on units 0-2.
+struct ClusterBuffers {
+    enum { kLights, kCells, kIndices, kCount };
+    GLuint buffers[kCount] = {}, textures[kCount] = {};
+
+    void create() { glGenBuffers(kCount, buffers); glGenTextures(kCount, textures); }
+
+    void release() {
+        if (buffers[0]) { glDeleteBuffers(kCount, buffers); glDeleteTextures(kCount, textures); }
+        for (int i=0;i<kCount;++i) buffers[i] = textures[i] = 0;
+    }
+
+    // Orphans the old storage, so a frame still reading it on the GPU does not stall us.
+    void upload(int which, GLenum format, const void* data, size_t bytes) {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffers[which]);
+        glBufferData(GL_TEXTURE_BUFFER, (GLsizeiptr)std::max<size_t>(bytes, 16), nullptr, GL_STREAM_DRAW);
+        if (bytes) glBufferSubData(GL_TEXTURE_BUFFER, 0, (GLsizeiptr)bytes, data);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        glBindTexture(GL_TEXTURE_BUFFER, textures[which]);
+        glTexBuffer(GL_TEXTURE_BUFFER, format, buffers[which]);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+
+    void bind() const {
+        for (int i=0;i<kCount;++i) { glActiveTexture(GL_TEXTURE0 + i); glBindTexture(GL_TEXTURE_BUFFER, textures[i]); }
+        glActiveTexture(GL_TEXTURE0);
+    }
+};
+
+// Regenerates the point lights and their texture buffer. They fill a ball a little
+// larger than the unit-sized model.
+static void setPointLights(size_t count, ClusterBuffers &buffers) {
+    g_pointLights = make_point_lights(count, 1.3f, 0.35f);
+    buffers.upload(ClusterBuffers::kLights, GL_RGBA32F, g_pointLights.data(), g_pointLights.size() * sizeof(PointLight));
+}
+
+// Render targets of the deferred path: depth (positions are rebuilt from it), normal
+// and ambient scale as RGBA16F, material ID as R8UI. Reallocated when the window resizes.
+struct GBuffer {
+    enum { kDepthUnit = 3, kNormalUnit, kMaterialUnit }; // after the cluster buffers
+    GLuint fbo = 0, depth = 0, normal = 0, material = 0;
+    int width = 0, height = 0;
+
+    bool resize(int w, int h) {
+        if (fbo && w == width && h == height) return true;
+        release();
+        width = w; height = h;
+        depth = target(GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_FLOAT);
+        normal = target(GL_RGBA16F, GL_RGBA, GL_FLOAT);
+        material = target(GL_R8UI, GL_RED_INTEGER, GL_UNSIGNED_BYTE);
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, normal, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, material, 0);
+        const GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        glDrawBuffers(2, drawBuffers);
+        GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (status != GL_FRAMEBUFFER_COMPLETE) {
+            std::cerr << "G-buffer incomplete (status 0x" << std::hex << status << std::dec << ")\n";
+            release();
+            return false;
+        }
+        return true;
+    }
+
+    void release() {
+        if (fbo) glDeleteFramebuffers(1, &fbo);
+        GLuint textures[] = { depth, normal, material };
+        if (depth) glDeleteTextures(3, textures);
+        fbo = depth = normal = material = 0;
+        width = height = 0;
+    }
+
+    // Clears every target to its own "nothing here" value; the ID target is integer,
+    // so glClear's float colour would not apply to it.
+    void clear() const {
+        const GLfloat zero[4] = { 0.0f, 0.0f, 0.0f, 0.0f }, farDepth = 1.0f;
+        const GLuint noMaterial[4] = { 0, 0, 0, 0 };
+        glClearBufferfv(GL_COLOR, 0, zero);
+        glClearBufferuiv(GL_COLOR, 1, noMaterial);
+        glClearBufferfv(GL_DEPTH, 0, &farDepth);
+    }
+
+    void bindTextures() const {
+        glActiveTexture(GL_TEXTURE0 + kDepthUnit); glBindTexture(GL_TEXTURE_2D, depth);
+        glActiveTexture(GL_TEXTURE0 + kNormalUnit); glBindTexture(GL_TEXTURE_2D, normal);
+        glActiveTexture(GL_TEXTURE0 + kMaterialUnit); glBindTexture(GL_TEXTURE_2D, material);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+private:
+    GLuint target(GLenum internalFormat, GLenum format, GLenum type) const {
+        GLuint tex;
+        glGenTextures(1, &tex);
+        glBindTexture(GL_TEXTURE_2D, tex);
+        glTexImage2D(GL_TEXTURE_2D, 0, (GLint)internalFormat, width, height, 0, format, type, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return tex;
+    }
+};
+
+// Passes other than forward shading depend on fewer settings; fixing the rest keeps
+// one program per pass instead of one per forward permutation.
+static ShadingKey passKey(ShadingKey::Pass pass) {
+    ShadingKey key;
+    key.pass = pass;
+    if (pass == ShadingKey::kDeferredLights) key.lights = g_lightCount;
+    // Depth-only output ignores shading, so it varies only with instancing and quantisation.
+    if (pass != ShadingKey::kGBuffer && pass != ShadingKey::kDepth) key.specular = g_specular;
+    if (pass == ShadingKey::kGBuffer || pass == ShadingKey::kDepth) key.instanced = g_instanceCount > 0;
+    return key;
+}
+
+// Fragments shaded by the forward colour pass, kept apart for frames with and without
+// the depth pre-pass. With pipeline statistics this is the fragment shader invocation
+// count. Otherwise GL_SAMPLES_PASSED stands in: fragments that passed the depth test,
+// each of which ran the shader (nothing discards), so overdraw rejected by early
+// depth testing is not counted. Queries are read back kQueries frames later.
+struct FragmentCounter {
+    static const int kQueries = 3;
+    GLenum target = GL_SAMPLES_PASSED;
+    GLuint queries[kQueries] = {};
+    int mode[kQueries] = { -1, -1, -1 }; // pre-pass on (1) or off (0) while recorded; -1: unused
+    int current = 0;
+    double fragments[2] = { 0.0, 0.0 };
+    size_t frames[2] = { 0, 0 };
+
+    void create() {
+        target = gl_ext.pipeline_statistics ? GL_FRAGMENT_SHADER_INVOCATIONS : GL_SAMPLES_PASSED;
+        glGenQueries(kQueries, queries);
+    }
+
+    void release() {
+        if (queries[0]) glDeleteQueries(kQueries, queries);
+        for (GLuint &q : queries) q = 0;
+    }
+
+    void begin(bool prepass) {
+        if (mode[current] >= 0) {
+            GLuint count = 0;
+            glGetQueryObjectuiv(queries[current], GL_QUERY_RESULT, &count);
+            fragments[mode[current]] += count;
+            ++frames[mode[current]];
+        }
+        mode[current] = prepass ? 1 : 0;
+        glBeginQuery(target, queries[current]);
+    }
+
+    void end() {
+        glEndQuery(target);
+        current = (current + 1) % kQueries;
+    }
+
+    void print() {
+        if (!frames[0] && !frames[1]) return;
+        std::cout << (target == GL_SAMPLES_PASSED ? "Shaded fragments (samples passed) per frame: " : "Fragment shader invocations per frame: ");
+        const char* labels[2] = { "without depth pre-pass", "with depth pre-pass" };
+        for (int i=0;i<2;++i) {
+            if (i) std::cout << ", ";
+            if (frames[i]) std::cout << (size_t)(fragments[i] / frames[i]) << " " << labels[i] << " (" << frames[i] << " frames)";
+            else std::cout << "none " << labels[i];
+        }
+        std::cout << "\n";
+        fragments[0] = fragments[1] = 0.0;
+        frames[0] = frames[1] = 0;
+    }
+};
+
+// --compare-renderers: forward (clustered) and deferred shading in turn at each point
+// light count, each for kFrames frames after kWarmup. The 3.1 context has no timer
+// queries, so frames are timed on the CPU with glFinish() after every swap.
+struct RendererComparison {
+    static const int kWarmup = 10, kFrames = 60;
+    std::vector<size_t> counts{ 64, 256, 1024, 4096 };
+    std::vector<double> ms; // per run: forward then deferred for each count
+    size_t run = 0;
+    int frame = 0;
+    double start = 0.0;
+
+    bool active() const { return run < 2 * counts.size(); }
+    size_t lights() const { return counts[run / 2]; }
+    bool deferred() const { return run % 2 == 1; }
+
+    // Call once the frame has finished on the GPU.
+    void frameDone(double now) {
+        if (++frame == kWarmup) start = now;
+        if (frame < kWarmup + kFrames) return;
+        ms.push_back(1000.0 * (now - start) / kFrames);
+        frame = 0;
+        ++run;
+    }
+
+    void print(int w, int h) const {
+        std::printf("Renderer comparison at %dx%d (ms per frame, %d frames each):\n", w, h, kFrames);
+        std::printf("%7s %10s %10s\n", "lights", "forward", "deferred");
+        for (size_t i=0; i<counts.size(); ++i) std::printf("%7zu %10.2f %10.2f\n", counts[i], ms[2 * i], ms[2 * i + 1]);
+    }
+};
+
+// The clean-up passes selected on the command line.
+static MeshPrepareOptions prepareOptions() {
+    MeshPrepareOptions o;
+    o.weld = g_weld;
+    o.weld_epsilon = g_weldEpsilon;
+    o.clean = g_clean;
+    o.use_cache = g_useMeshCache;
+    o.compress_bits = g_cacheCompressBits;
+    return o;
+}
+
+// CPU side of the mesh: everything up to the GPU upload, so it can run on a worker thread.
+struct PreparedMesh {
     std::vector<glm::vec3> pos;
     std::vector<glm::ivec3> faces;
-    if (!loadSMF(path, pos, faces)) { std::cerr<<"SMF load failed\n"; return false; }
+    std::vector<float> occlusion; // empty without --ao
+};
+
+// Fills `m`, g_vertices/g_indices and the mesh-derived globals; makes no GL calls.
+static bool prepareMeshFromSMF(const std::string &path, PreparedMesh &m) {
+    std::vector<glm::vec3> &pos = m.pos;
+    std::vector<glm::ivec3> &faces = m.faces;
+    if (!load_prepared_mesh(path, prepareOptions(), pos, faces)) { std::cerr<<"SMF load failed\n"; return false; }
     if (faces.size() < 1) { std::cerr<<"No faces\n"; return false; }
 
+    if (g_orient) {
+        OrientStats os = orient_faces(pos, faces);
+        std::cout << "Orient: " << os.components << " components (" << os.closed_components << " closed), flipped "
+                  << os.flipped_faces << " faces, " << os.inverted_components << " turned outward; "
+                  << os.boundary_edges << " boundary / " << os.nonmanifold_edges << " non-manifold edges, "
+                  << os.conflicts << " conflicts; " << os.ms << " ms\n";
+        g_cullBackFaces = os.cull_safe();
+    }
+
+    if (g_subdivideLevels > 0) {
+        float maxEdge = 0.0f;
+        if (g_subdivideMaxEdge > 0.0f) {
+            glm::vec3 lo = pos[0], hi = pos[0];
+            for (auto &p : pos) { lo = glm::min(lo, p); hi = glm::max(hi, p); }
+            maxEdge = g_subdivideMaxEdge * 0.5f * glm::length(hi - lo);
+        }
+        SubdivideStats ss = loop_subdivide(pos, faces, g_subdivideLevels, maxEdge);
+        std::cout << "Subdivide: " << ss.levels << (maxEdge > 0.0f ? " adaptive" : "") << " Loop levels, "
+                  << ss.input_faces << " -> " << faces.size() << " faces (" << ss.ms << " ms)\n";
+        if (faces.empty()) { std::cerr<<"No faces\n"; return false; }
+    }
+
+    MeshBounds bounds = compute_bounds(pos);
+    if (!bounds.valid) { std::cerr<<"No finite vertex positions\n"; return false; }
+    float radius = std::max(bounds.sphere.radius, 1e-5f);
+    g_modelNormalize = glm::scale(glm::mat4(1.0f), glm::vec3(1.0f / radius)) * glm::translate(glm::mat4(1.0f), -bounds.sphere.center);
+    std::cout << "Bounds: sphere r " << bounds.sphere.radius << " (centroid sphere r " << bounds.centroid_radius
+              << "), OBB " << 100.0f * bounds.obb.volume() / std::max(bounds.box.volume(), 1e-30f)
+              << "% of AABB volume; " << bounds.ms << " ms\n";
+
     std::vector<glm::vec3> normals(pos.size(), glm::vec3(0.0f));
     for (auto &f : faces) {
         if ((size_t)f.x >= pos.size() || (size_t)f.y >= pos.size() || (size_t)f.z >= pos.size()) continue;
         glm::vec3 v1 = pos[f.y] - pos[f.x];
         glm::vec3 v2 = pos[f.z] - pos[f.x];
-        glm::vec3 fn = glm::normalize(glm::cross(v1, v2));
+        glm::vec3 fn = glm::cross(v1, v2);
+        float len = glm::length(fn);
+        if (len > 1e-8f) fn /= len; else continue; // zero-area face: normalising would give NaN
         normals[f.x] += fn; normals[f.y] += fn; normals[f.z] += fn;
     }
 
     g_vertices.clear(); g_indices.clear();
     for (size_t i=0;i<pos.size();++i) {
-        Vertex v; v.pos = pos[i]; v.normal = glm::normalize(normals[i]); g_vertices.push_back(v);
+        float len = glm::length(normals[i]);
+        Vertex v; v.position = pos[i]; v.normal = len > 1e-8f ? normals[i] / len : glm::vec3(0.0f, 0.0f, 1.0f); g_vertices.push_back(v);
     }
     for (auto &f : faces) { g_indices.push_back(f.x); g_indices.push_back(f.y); g_indices.push_back(f.z); }
 
-    glGenVertexArrays(1, &g_VAO);
-    glGenBuffers(1, &g_VBO);
-    glGenBuffers(1, &g_EBO);
-    glBindVertexArray(g_VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, g_VBO);
-    glBufferData(GL_ARRAY_BUFFER, g_vertices.size()*sizeof(Vertex), g_vertices.data(), GL_STATIC_DRAW);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, g_indices.size()*sizeof(unsigned int), g_indices.data(), GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0); glVertexAttribPointer(0,3,GL_FLOAT,GL_FALSE,sizeof(Vertex),(void*)0);
-    glEnableVertexAttribArray(1); glVertexAttribPointer(1,3,GL_FLOAT,GL_FALSE,sizeof(Vertex),(void*)offsetof(Vertex,normal));
-    glBindVertexArray(0);
     std::cout << "✅ Loaded " << pos.size() << " vertices and " << faces.size() << " faces.\n";
+
+    if (g_ao) {
+        AoOptions ao;
+        ao.rays = g_aoRays;
+        uint64_t key = occlusion_cache_key(pos, faces, ao);
+        std::vector<float> &occlusion = m.occlusion;
+        if (g_useMeshCache && load_cached_occlusion(key, pos.size(), occlusion)) {
+            std::cout << "AO cache hit: " << mesh_cache_path(key, ".ao") << "\n";
+        } else {
+            AoStats as;
+            occlusion = bake_vertex_occlusion(pos, faces, normals, ao, &as);
+            std::cout << "AO: " << ao.rays << " rays per vertex, " << as.rays << " rays within " << as.max_distance
+                      << " in " << as.ms << " ms (BVH " << as.bvh_ms << " ms)\n";
+            if (g_useMeshCache) save_cached_occlusion(key, occlusion);
+        }
+    }
     return true;
 }
 
+// --instances: copies of the unit-sized model on a cubic grid, each turned about the
+// vertical axis and given one of the materials in turn. Sets g_sceneRadius to the grid's.
+static std::vector<InstanceData> makeInstances(size_t count) {
+    const float spacing = 2.5f;
+    const size_t side = (size_t)std::ceil(std::cbrt((double)count));
+    const float half = 0.5f * spacing * (float)(side - 1);
+    std::vector<InstanceData> instances(count);
+    uint32_t seed = 1;
+    for (size_t i=0;i<count;++i) {
+        glm::vec3 cell((float)(i % side), (float)(i / side % side), (float)(i / (side * side)));
+        seed = seed * 1664525u + 1013904223u;
+        float yaw = 6.2831853f * (float)(seed >> 8) / 16777216.0f;
+        glm::mat4 place = glm::rotate(glm::translate(glm::mat4(1.0f), cell * spacing - glm::vec3(half)), yaw, glm::vec3(0.0f, 1.0f, 0.0f));
+        // glm is column-major, so row r is place[c][r] over the columns c.
+        InstanceData &d = instances[i];
+        d.row0 = glm::vec4(place[0][0], place[1][0], place[2][0], place[3][0]);
+        d.row1 = glm::vec4(place[0][1], place[1][1], place[2][1], place[3][1]);
+        d.row2 = glm::vec4(place[0][2], place[1][2], place[2][2], place[3][2]);
+        d.material = (float)(i % kMaterialCount);
+    }
+    g_sceneRadius = half * std::sqrt(3.0f) + 1.0f;
+    return instances;
+}
+
+// The whole mesh through `vao`, once per visible instance when instancing is on.
+static void drawMesh(GLuint vao) {
+    glBindVertexArray(vao);
+    if (g_instanceCount == 0) glDrawElements(GL_TRIANGLES, g_mesh.index_count, GL_UNSIGNED_INT, 0);
+    else if (!g_visibleInstances.empty())
+        glDrawElementsInstanced(GL_TRIANGLES, g_mesh.index_count, GL_UNSIGNED_INT, 0, (GLsizei)g_visibleInstances.size());
+}
+
+// Tests each instance's bounding sphere (the unit model's, moved by the instance's
+// translation) against the frustum and compacts the survivors into the instance buffer,
+// so copies behind or beside the camera cost neither vertex work nor draw slots.
+static void cullInstances(const glm::mat4 &viewProj) {
+    auto t0 = std::chrono::steady_clock::now();
+    glm::vec4 planes[6];
+    frustum_planes(viewProj, planes);
+    g_visibleInstances.clear();
+    for (const InstanceData &d : g_instances)
+        if (sphere_in_frustum(planes, glm::vec3(d.row0.w, d.row1.w, d.row2.w), 1.0f)) g_visibleInstances.push_back(d);
+    update_instances(g_mesh, g_visibleInstances.data(), g_visibleInstances.size());
+    g_instanceCullMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+static void uploadPreparedMesh(PreparedMesh &m) {
+    upload_mesh<MeshLayout>(g_vertices, g_indices, g_mesh, true); // depth stream for the pre-pass
+    if (!m.occlusion.empty()) attach_occlusion(g_mesh, m.occlusion);
+    if (g_instanceCount > 0) {
+        g_instances = makeInstances(g_instanceCount);
+        g_visibleInstances.reserve(g_instances.size());
+        attach_instances(g_mesh, g_instances);
+    }
+    g_picker.build_async(std::move(m.pos), std::move(m.faces));
+}
+
 static bool keyPressedOnce(GLFWwindow* w, int key) {
     int state = glfwGetKey(w, key);
     bool pressed = (state == GLFW_PRESS || state == GLFW_REPEAT);
@@ -255,8 +1017,8 @@ static bool keyPressedOnce(GLFWwindow* w, int key) {
 static void processContinuousInput(GLFWwindow* win) {
     if (glfwGetKey(win, GLFW_KEY_A) == GLFW_PRESS) camAngle -= 0.02f;
     if (glfwGetKey(win, GLFW_KEY_D) == GLFW_PRESS) camAngle += 0.02f;
-    if (glfwGetKey(win, GLFW_KEY_W) == GLFW_PRESS) { camRadius -= 0.04f; if (camRadius<0.2f) camRadius=0.2f; }
-    if (glfwGetKey(win, GLFW_KEY_S) == GLFW_PRESS) camRadius += 0.04f;
+    if (glfwGetKey(win, GLFW_KEY_W) == GLFW_PRESS) { camRadius -= 0.04f * g_sceneRadius; if (camRadius<0.2f) camRadius=0.2f; }
+    if (glfwGetKey(win, GLFW_KEY_S) == GLFW_PRESS) camRadius += 0.04f * g_sceneRadius;
     if (glfwGetKey(win, GLFW_KEY_LEFT) == GLFW_PRESS) lightAngle -= 0.02f;
     if (glfwGetKey(win, GLFW_KEY_RIGHT) == GLFW_PRESS) lightAngle += 0.02f;
     if (glfwGetKey(win, GLFW_KEY_I) == GLFW_PRESS) lightRadius -= 0.04f;
@@ -265,14 +1027,70 @@ static void processContinuousInput(GLFWwindow* win) {
     if (glfwGetKey(win, GLFW_KEY_O) == GLFW_PRESS) lightHeight -= 0.04f;
 }
 
+// Picks the triangle under the cursor; `model` maps the picker's positions to world space.
+static void pickUnderCursor(GLFWwindow* win, const glm::mat4 &proj, const glm::mat4 &view, const glm::mat4 &model) {
+    double x, y; glfwGetCursorPos(win, &x, &y);
+    int w, h; glfwGetWindowSize(win, &w, &h);
+    PickResult r;
+    if (!g_picker.pick(cursor_ray(x, y, w, h, proj, view, model), r)) { std::cout << "Pick: BVH still building\n"; return; }
+    static bool reported = false;
+    if (!reported) {
+        reported = true;
+        const BvhStats &bs = g_picker.stats();
+        std::cout << "Pick BVH: " << bs.triangles << " triangles, " << bs.nodes << " nodes, depth " << bs.max_depth
+                  << ", built in " << bs.ms << " ms\n";
+    }
+    g_pickedFace = r.face;
+    if (!r.hit()) { std::cout << "Pick: nothing under the cursor (" << r.ms << " ms)\n"; return; }
+    std::cout << "Pick: face " << r.face << " (" << r.ms << " ms)\n";
+    for (int k=0;k<3;++k)
+        std::cout << "  v" << r.corners[k] << " (" << r.positions[k].x << ", " << r.positions[k].y << ", " << r.positions[k].z << ")\n";
+}
+
+// Matches "--name" or "--name=value"; value is left untouched when absent.
+static bool parseFlag(const std::string &arg, const char* name, std::string &value) {
+    size_t n = std::char_traits<char>::length(name);
+    if (arg.compare(0, n, name) != 0) return false;
+    if (arg.size() == n) return true;
+    if (arg[n] != '=') return false;
+    value = arg.substr(n + 1);
+    return true;
+}
+
 int main(int argc, char** argv) {
-    if (argc < 2) { std::cerr<<"Usage: "<<argv[0]<<" <model.smf>\n"; return -1; }
-    std::string modelPath = argv[1];
+    std::string usage = std::string("Usage: ") + argv[0] + " <model.smf> [--weld[=eps]] [--clean] [--no-cache] [--orient]\n"
+                        "       [--subdivide[=levels]] [--subdivide-edge=fraction] [--ao[=rays]] [--cache-compress[=bits]] [--lights[=N]]\n"
+                        "       [--compare-renderers] [--depth-prepass] [--instances[=N]]\n";
+    std::string modelPath;
+    bool compareRenderers = false;
+    for (int i=1;i<argc;++i) {
+        std::string arg = argv[i], val;
+        if (parseFlag(arg, "--weld", val)) { g_weld = true; if (!val.empty()) g_weldEpsilon = (float)std::atof(val.c_str()); }
+        else if (arg == "--clean") g_clean = true;
+        else if (arg == "--no-cache") g_useMeshCache = false;
+        else if (parseFlag(arg, "--cache-compress", val)) {
+            // Only cleaned meshes are cached, so compressing the cache implies --clean.
+            g_cacheCompressBits = val.empty() ? 16 : std::min(std::max(std::atoi(val.c_str()), 8), 24);
+            g_clean = true;
+        }
+        else if (arg == "--orient") g_orient = true;
+        else if (parseFlag(arg, "--subdivide-edge", val)) g_subdivideMaxEdge = (float)std::atof(val.c_str());
+        else if (parseFlag(arg, "--subdivide", val)) g_subdivideLevels = val.empty() ? 1 : std::atoi(val.c_str());
+        else if (parseFlag(arg, "--ao", val)) { g_ao = true; if (!val.empty()) g_aoRays = std::max(1, std::atoi(val.c_str())); }
+        else if (parseFlag(arg, "--lights", val)) g_pointLightCount = val.empty() ? 256 : (size_t)std::max(0, std::atoi(val.c_str()));
+        else if (arg == "--compare-renderers") compareRenderers = true;
+        else if (arg == "--depth-prepass") g_depthPrepass = true;
+        else if (parseFlag(arg, "--instances", val)) g_instanceCount = val.empty() ? 10000 : (size_t)std::max(0, std::atoi(val.c_str()));
+        else if (arg.rfind("--", 0) == 0) { std::cerr<<"Unknown option "<<arg<<"\n"<<usage; return -1; }
+        else modelPath = arg;
+    }
+    if (modelPath.empty()) { std::cerr<<usage; return -1; }
+    if (g_subdivideMaxEdge > 0.0f && g_subdivideLevels == 0) g_subdivideLevels = 8;
 
     if (!glfwInit()) { std::cerr<<"GLFW init fail\n"; return -1; }
 
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 0);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1); // uniform blocks
     glfwWindowHint(GLFW_OPENGL_ANY_PROFILE, GLFW_TRUE);
     glfwWindowHint(GLFW_CLIENT_API, GLFW_OPENGL_API);
 
@@ -282,23 +1100,109 @@ int main(int argc, char** argv) {
     glfwSetInputMode(window, GLFW_STICKY_KEYS, GLFW_TRUE);
 
     if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) { std::cerr<<"GLAD init failed\n"; return -1; }
+    load_gl_extensions((GLADloadproc)glfwGetProcAddress);
+    if (g_instanceCount > 0 && !glVertexAttribDivisor) {
+        std::cerr << "Instancing needs GL 3.3 or GL_ARB_instanced_arrays; drawing a single copy\n";
+        g_instanceCount = 0;
+    }
+
+    // The mesh is parsed, cleaned and baked on a worker thread while this thread issues
+    // the shader compiles, so the first frame waits for the slower of the two, not both.
+    auto startupBegin = std::chrono::steady_clock::now();
+    auto startupMs = [&] { return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startupBegin).count(); };
+    PreparedMesh prepared;
+    bool meshOk = false;
+    double meshMs = 0.0;
+    std::atomic<bool> meshDone(false);
+    std::thread meshLoader([&] {
+        meshOk = prepareMeshFromSMF(modelPath, prepared);
+        meshMs = startupMs();
+        meshDone = true;
+    });
 
-    if (!buildMeshFromSMF(modelPath)) { std::cerr << "Failed to build mesh\n"; return -1; }
+    // The two variants G switches between; the others are compiled on first use.
+    ShadingKey gouraudKey, phongKey;
+    gouraudKey.phong = false;
+    gouraudKey.instanced = phongKey.instanced = g_instanceCount > 0;
+    PendingProgram gouraudPending = beginVariant(gouraudKey);
+    PendingProgram phongPending = beginVariant(phongKey);
+    double shaderMs = -1.0;
+    while (!meshDone || shaderMs < 0.0) {
+        if (shaderMs < 0.0 && programReady(gouraudPending) && programReady(phongPending)) shaderMs = startupMs();
+        glfwPollEvents();
+        if (!meshDone || shaderMs < 0.0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    meshLoader.join();
+    addVariant(gouraudKey, gouraudPending);
+    addVariant(phongKey, phongPending);
+    if (!meshOk) { std::cerr << "Failed to build mesh\n"; return -1; }
+    uploadPreparedMesh(prepared);
+    if (g_instanceCount > 0)
+        std::cout << "Instancing: " << g_instanceCount << " copies, " << (double)g_instanceCount * g_mesh.index_count / 3
+                  << " triangles per draw (picking disabled)\n";
 
-    GLuint gouraudProg = compileProgramFromSources(gouraud_vs, gouraud_fs);
-    GLuint phongProg = compileProgramFromSources(phong_vs, phong_fs);
+    ClusterBuffers clusterBuffers;
+    clusterBuffers.create();
+    if (g_pointLightCount > 0) {
+        setPointLights(g_pointLightCount, clusterBuffers);
+        std::cout << "Clustered shading: " << g_pointLights.size() << " point lights\n";
+    }
+    std::cout << "Startup: mesh " << meshMs << " ms, shaders " << shaderMs << " ms ("
+              << (gl_ext.parallel_shader_compile ? "parallel compile" : "serial compile") << "), ready after " << startupMs() << " ms\n";
+    // Lights and material rarely change and stay in a UBO (blocks 0 and 1 at kLightBlock
+    // and kMaterialBlock); the frame block changes every frame and is streamed.
+    UniformBuffer shadingBlocks;
+    shadingBlocks.create({ sizeof(LightBlock), sizeof(MaterialBlock) }, kLightBlock);
+    GLint uboAlign = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uboAlign);
+    uboAlign = std::max(uboAlign, 16);
+    // One FrameBlock per frame, at an offset glBindBufferRange accepts.
+    StreamRing frameRing;
+    frameRing.create(GL_UNIFORM_BUFFER, (sizeof(FrameBlock) + (size_t)uboAlign - 1) / (size_t)uboAlign * (size_t)uboAlign);
+    std::cout << "Ring buffer: " << (frameRing.persistent() ? "persistent mapping, 3 frames\n" : "orphaning (no buffer storage)\n");
 
     setDefaultMaterials();
+    // Deferred and instanced passes read every material from one table, indexed by the
+    // G-buffer ID or the instance's material.
+    struct MaterialTableBlock { MaterialBlock materials[kMaterialCount]; } table{};
+    for (int i=0;i<kMaterialCount;++i) {
+        table.materials[i].ambient = g_materials[i].ambient;
+        table.materials[i].diffuse = g_materials[i].diffuse;
+        table.materials[i].specular = g_materials[i].specular;
+        table.materials[i].shininess = g_materials[i].shininess;
+    }
+    UniformBuffer materialTable;
+    materialTable.create({ sizeof(MaterialTableBlock) }, kMaterialTableBlock);
+    materialTable.write(0, table);
+    materialTable.flush();
+    GBuffer gbuffer;
+    GLuint fullscreenVao = 0; // attributeless draws still need a VAO bound in a core context
+    glGenVertexArrays(1, &fullscreenVao);
+    RendererComparison comparison;
+    FragmentCounter fragmentCounter;
+    fragmentCounter.create();
+    const bool savedDeferred = g_deferred, savedPhong = g_usePhong;
+    if (compareRenderers) glfwSwapInterval(0);
 
     glEnable(GL_DEPTH_TEST);
+    if (g_cullBackFaces) {
+        glEnable(GL_CULL_FACE);
+        glCullFace(GL_BACK);
+        std::cout << "Back-face culling enabled (closed, consistently wound mesh)\n";
+    }
 
     for (int i=0;i<1024;++i) prevKeys[i]=false;
 
+    int fbw = 0, fbh = 0; glfwGetFramebufferSize(window, &fbw, &fbh);
+    camRadius = framing_distance(g_sceneRadius, kFovY, (fbw > 0 && fbh > 0) ? (float)fbw/(float)fbh : 900.0f/700.0f);
+
     lastFrameTime = glfwGetTime();
+    double frameMs = 0.0; // smoothed wall time between frames, vsync included
     while (!glfwWindowShouldClose(window)) {
         double now = glfwGetTime();
         double dt = now - lastFrameTime;
         lastFrameTime = now;
+        frameMs = frameMs > 0.0 ? 0.95 * frameMs + 50.0 * dt : 1000.0 * dt;
 
         processContinuousInput(window);
 
@@ -307,67 +1211,236 @@ int main(int argc, char** argv) {
         if (keyPressedOnce(window, GLFW_KEY_1)) { g_materialIndex = 0; std::cout<<"Material 1\n"; }
         if (keyPressedOnce(window, GLFW_KEY_2)) { g_materialIndex = 1; std::cout<<"Material 2\n"; }
         if (keyPressedOnce(window, GLFW_KEY_3)) { g_materialIndex = 2; std::cout<<"Material 3\n"; }
+        if (keyPressedOnce(window, GLFW_KEY_L)) { g_lightCount = g_lightCount % kMaxLights + 1; std::cout << "Lights: " << g_lightCount << "\n"; }
+        if (keyPressedOnce(window, GLFW_KEY_H)) { g_specular = !g_specular; std::cout << "Specular: " << (g_specular ? "on\n" : "off\n"); }
+        if (keyPressedOnce(window, GLFW_KEY_R)) { g_deferred = !g_deferred; std::cout << "Renderer: " << (g_deferred ? "deferred\n" : "forward\n"); }
+        if (keyPressedOnce(window, GLFW_KEY_Z)) { g_depthPrepass = !g_depthPrepass; std::cout << "Depth pre-pass: " << (g_depthPrepass ? "on\n" : "off\n"); }
+        if (keyPressedOnce(window, GLFW_KEY_B) && g_ao) { g_aoVisible = !g_aoVisible; std::cout << "Ambient occlusion: " << (g_aoVisible ? "on\n" : "off\n"); }
+        if (keyPressedOnce(window, GLFW_KEY_T)) {
+            for (auto &v : g_variants) print_uniform_stats(v.second.name.c_str(), v.second.uniforms.table.stats);
+            print_uniform_stats("blocks", shadingBlocks.stats);
+            print_ring_stats("frame block", frameRing.stats);
+            fragmentCounter.print();
+            std::cout << "Frame: " << frameMs << " ms\n";
+            if (g_instanceCount > 0)
+                std::cout << "Instances: " << g_visibleInstances.size() << " of " << g_instances.size()
+                          << " in the frustum, culled in " << g_instanceCullMs << " ms\n";
+            if (!g_pointLights.empty()) {
+                const LightClusterStats &cs = g_clusters.stats;
+                std::cout << "Clusters: " << g_clusters.dim_x() << "x" << g_clusters.dim_y() << "x" << g_clusters.dim_z() << ", "
+                          << cs.visible_lights << " of " << cs.lights << " lights visible, " << cs.references << " references ("
+                          << (cs.nonempty_clusters ? (double)cs.references / cs.nonempty_clusters : 0.0) << " per non-empty cluster, max "
+                          << cs.max_per_cluster << "), built in " << cs.ms << " ms\n";
+            }
+        }
         if (keyPressedOnce(window, GLFW_KEY_ESCAPE)) { glfwSetWindowShouldClose(window, true); }
+        if (compareRenderers && comparison.active()) {
+            g_usePhong = true;
+            g_deferred = comparison.deferred();
+            if (g_pointLights.size() != comparison.lights()) setPointLights(comparison.lights(), clusterBuffers);
+        }
 
         glm::vec3 camPos( camRadius * cos(camAngle), camHeight, camRadius * sin(camAngle) );
         glm::mat4 view = glm::lookAt(camPos, glm::vec3(0.0f), glm::vec3(0.0f,1.0f,0.0f));
         int w,h; glfwGetFramebufferSize(window, &w, &h);
         float aspect = (w>0 && h>0) ? (float)w/(float)h : 1.0f;
-        glm::mat4 proj = g_perspective ? glm::perspective(glm::radians(45.0f), aspect, 0.1f, 100.0f)
-                                       : glm::ortho(-camRadius*aspect, camRadius*aspect, -camRadius, camRadius, -100.0f, 100.0f);
-        glm::mat4 model = glm::mat4(1.0f);
+        float zNear, zFar;
+        sphere_depth_range(glm::length(camPos), g_sceneRadius, zNear, zFar);
+        if (!g_perspective) zNear = glm::length(camPos) - 1.01f * g_sceneRadius;
+        glm::mat4 proj = g_perspective ? glm::perspective(kFovY, aspect, zNear, zFar)
+                                       : glm::ortho(-camRadius*aspect, camRadius*aspect, -camRadius, camRadius, zNear, zFar);
+        glm::mat4 model = g_modelNormalize * g_mesh.dequant;
+        if (g_instanceCount > 0) cullInstances(proj * view);
 
-        glm::vec3 worldLightPos( lightRadius * cos(lightAngle), lightHeight, lightRadius * sin(lightAngle) );
-        glm::vec3 cameraLightPos = camPos; // camera-space light attached to eye
-        glm::vec3 worldLightAmbient(0.2f), worldLightDiffuse(0.6f), worldLightSpec(1.0f);
-        glm::vec3 cameraLightAmbient(0.1f), cameraLightDiffuse(0.4f), cameraLightSpec(0.5f);
+        static bool clickWasPressed = false;
+        bool click = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+        if (click && !clickWasPressed && g_instanceCount == 0) pickUnderCursor(window, proj, view, g_modelNormalize);
+        clickWasPressed = click;
 
         glClearColor(0.07f,0.08f,0.12f,1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        GLuint prog = g_usePhong ? phongProg : gouraudProg;
-        glUseProgram(prog);
+        double uniformStart = glfwGetTime();
+        frameRing.begin_frame();
+        size_t frameOffset = 0;
+        FrameBlock* frame = (FrameBlock*)frameRing.allocate(sizeof(FrameBlock), (size_t)uboAlign, frameOffset);
+        if (frame) {
+            frame->model = model;
+            frame->view = view;
+            frame->projection = proj;
+            frame->viewPos = camPos;
+            frame->aoStrength = g_aoVisible ? 1.0f : 0.0f;
+        }
+        frameRing.commit();
+        if (!frame) {
+            // Nothing valid to bind; drawing would read whatever the range last held.
+            static bool warned = false;
+            if (!warned) { std::cerr << "Frame block does not fit the ring buffer; skipping frames\n"; warned = true; }
+            frameRing.end_frame();
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+            continue;
+        }
+        glBindBufferRange(GL_UNIFORM_BUFFER, kFrameBlock, frameRing.id(), (GLintptr)frameOffset, sizeof(FrameBlock));
+
+        // Light 0 orbits the model; light 1 is attached to the eye.
+        LightBlock lights{};
+        LightStd140 &worldLight = lights.lights[0];
+        worldLight.position = glm::vec3(lightRadius * cos(lightAngle), lightHeight, lightRadius * sin(lightAngle));
+        worldLight.ambient = glm::vec3(0.2f);
+        worldLight.diffuse = glm::vec3(0.6f);
+        worldLight.specular = glm::vec3(1.0f);
+        LightStd140 &cameraLight = lights.lights[1];
+        cameraLight.position = camPos;
+        cameraLight.ambient = glm::vec3(0.1f);
+        cameraLight.diffuse = glm::vec3(0.4f);
+        cameraLight.specular = glm::vec3(0.5f);
+        shadingBlocks.write(0, lights);
 
-        GLint loc_model = glGetUniformLocation(prog, "model");
-        GLint loc_view  = glGetUniformLocation(prog, "view");
-        GLint loc_proj  = glGetUniformLocation(prog, "projection");
-        GLint loc_viewPos = glGetUniformLocation(prog, "viewPos"); // phong expects viewPos; gouraud uses it too
+        const Material& m = g_materials[g_materialIndex];
+        MaterialBlock material{};
+        material.ambient = m.ambient;
+        material.diffuse = m.diffuse;
+        material.specular = m.specular;
+        material.shininess = m.shininess;
+        shadingBlocks.write(1, material);
+        shadingBlocks.flush();
+        double uniformMs = 1000.0 * (glfwGetTime() - uniformStart);
+        shadingBlocks.stats.ms += uniformMs;
+        ++shadingBlocks.stats.frames;
 
-        glUniformMatrix4fv(loc_model, 1, GL_FALSE, glm::value_ptr(model));
-        glUniformMatrix4fv(loc_view, 1, GL_FALSE, glm::value_ptr(view));
-        glUniformMatrix4fv(loc_proj, 1, GL_FALSE, glm::value_ptr(proj));
-        if (loc_viewPos != -1) glUniform3fv(loc_viewPos, 1, glm::value_ptr(camPos));
+        if (g_deferred && gbuffer.resize(w, h)) {
+            // Geometry: depth, normal and material ID only, so the lighting below runs
+            // once per visible pixel however many triangles overlap it.
+            glBindFramebuffer(GL_FRAMEBUFFER, gbuffer.fbo);
+            gbuffer.clear();
+            ShaderVariant &geometry = shaderVariant(passKey(ShadingKey::kGBuffer));
+            ShadingUniforms &gu = geometry.uniforms;
+            glUseProgram(geometry.prog);
+            gu.table.set(gu.materialId, g_materialIndex);
+            gu.table.set(gu.highlight, glm::vec4(0.0f));
+            ++gu.table.stats.frames;
+            drawMesh(g_mesh.vao);
+            if (g_pickedFace != RayHit::kNone) {
+                gu.table.set(gu.highlight, glm::vec4(1.0f));
+                glDepthFunc(GL_LEQUAL);
+                glDrawElements(GL_TRIANGLES, 3, GL_UNSIGNED_INT, (void*)((size_t)g_pickedFace * 3 * sizeof(unsigned int)));
+                glDepthFunc(GL_LESS);
+            }
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-        auto setVec3 = [&](const char* name, const glm::vec3 &v){
-            GLint L = glGetUniformLocation(prog, name);
-            if (L != -1) glUniform3fv(L, 1, glm::value_ptr(v));
-        };
-        auto setFloat = [&](const char* name, float val){ GLint L = glGetUniformLocation(prog, name); if (L != -1) glUniform1f(L, val); };
-        setVec3("worldLightPos", worldLightPos);
-        setVec3("worldLightAmbient", worldLightAmbient);
-        setVec3("worldLightDiffuse", worldLightDiffuse);
-        setVec3("worldLightSpec", worldLightSpec);
-        setVec3("cameraLightPos", cameraLightPos);
-        setVec3("cameraLightAmbient", cameraLightAmbient);
-        setVec3("cameraLightDiffuse", cameraLightDiffuse);
-        setVec3("cameraLightSpec", cameraLightSpec);
-
-        setVec3("materialAmbient", g_materials[g_materialIndex].ambient);
-        setVec3("materialDiffuse", g_materials[g_materialIndex].diffuse);
-        setVec3("materialSpec", g_materials[g_materialIndex].specular);
-        setFloat("materialShininess", g_materials[g_materialIndex].shininess);
-
-        glBindVertexArray(g_VAO);
-        glDrawElements(GL_TRIANGLES, (GLsizei)g_indices.size(), GL_UNSIGNED_INT, 0);
+            // Lighting reads the G-buffer back; it needs no depth test or culling.
+            glDisable(GL_DEPTH_TEST);
+            glDisable(GL_CULL_FACE);
+            gbuffer.bindTextures();
+            clusterBuffers.bind();
+            glm::mat4 invViewProj = glm::inverse(proj * view);
+            glm::vec4 viewport((float)w, (float)h, zNear, 0.0f);
+            glBindVertexArray(fullscreenVao);
+
+            ShaderVariant &resolve = shaderVariant(passKey(ShadingKey::kDeferredLights));
+            ShadingUniforms &ru = resolve.uniforms;
+            glUseProgram(resolve.prog);
+            ru.table.set(ru.gDepth, (int)GBuffer::kDepthUnit);
+            ru.table.set(ru.gNormal, (int)GBuffer::kNormalUnit);
+            ru.table.set(ru.gMaterial, (int)GBuffer::kMaterialUnit);
+            ru.table.set(ru.invViewProj, invViewProj);
+            ru.table.set(ru.viewport, viewport);
+            ru.table.set(ru.highlight, glm::vec4(1.0f, 0.85f, 0.1f, 1.0f));
+            ++ru.table.stats.frames;
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+
+            if (!g_pointLights.empty()) {
+                ShaderVariant &volumes = shaderVariant(passKey(ShadingKey::kLightVolumes));
+                ShadingUniforms &vu = volumes.uniforms;
+                glUseProgram(volumes.prog);
+                vu.table.set(vu.gDepth, (int)GBuffer::kDepthUnit);
+                vu.table.set(vu.gNormal, (int)GBuffer::kNormalUnit);
+                vu.table.set(vu.gMaterial, (int)GBuffer::kMaterialUnit);
+                vu.table.set(vu.pointLights, (int)ClusterBuffers::kLights);
+                vu.table.set(vu.invViewProj, invViewProj);
+                vu.table.set(vu.viewport, viewport);
+                ++vu.table.stats.frames;
+                glEnable(GL_BLEND);
+                glBlendFunc(GL_ONE, GL_ONE);
+                glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei)g_pointLights.size());
+                glDisable(GL_BLEND);
+            }
+            glEnable(GL_DEPTH_TEST);
+            if (g_cullBackFaces) glEnable(GL_CULL_FACE);
+        } else {
+            ShadingKey key;
+            key.phong = g_usePhong;
+            key.lights = g_lightCount;
+            key.specular = g_specular;
+            key.clustered = g_usePhong && !g_pointLights.empty();
+            key.instanced = g_instanceCount > 0;
+            ShaderVariant &variant = shaderVariant(key);
+            if (g_depthPrepass) {
+                // Lay down the final depth first, then shade only fragments that match it.
+                glUseProgram(shaderVariant(passKey(ShadingKey::kDepth)).prog);
+                glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+                drawMesh(g_mesh.depth_vao);
+                glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+                glDepthFunc(GL_EQUAL);
+                glDepthMask(GL_FALSE);
+            }
+            glUseProgram(variant.prog);
+
+            ShadingUniforms& u = variant.uniforms;
+            if (key.clustered) {
+                g_clusters.build(g_pointLights, view, proj, w, h, std::max(zNear, 1e-3f), zFar);
+                clusterBuffers.upload(ClusterBuffers::kCells, GL_RG32UI, g_clusters.cells().data(), g_clusters.cells().size() * sizeof(uint32_t));
+                clusterBuffers.upload(ClusterBuffers::kIndices, GL_R32UI, g_clusters.indices().data(), g_clusters.indices().size() * sizeof(uint32_t));
+                clusterBuffers.bind();
+                u.table.set(u.pointLights, (int)ClusterBuffers::kLights);
+                u.table.set(u.clusterCells, (int)ClusterBuffers::kCells);
+                u.table.set(u.clusterIndices, (int)ClusterBuffers::kIndices);
+                u.table.set(u.clusterScale, glm::vec4(1.0f / g_clusters.tile_pixels, 1.0f / g_clusters.tile_pixels,
+                                                      g_clusters.slice_scale(), g_clusters.slice_bias()));
+                u.table.set(u.clusterDims, glm::vec4((float)g_clusters.dim_x(), (float)g_clusters.dim_y(), (float)g_clusters.dim_z(), 0.0f));
+            }
+            u.table.set(u.highlight, glm::vec4(0.0f));
+            ++u.table.stats.frames;
+
+            fragmentCounter.begin(g_depthPrepass);
+            drawMesh(g_mesh.vao);
+            fragmentCounter.end();
+            if (g_pickedFace != RayHit::kNone) {
+                // Same vertices through the same shader, so LEQUAL lets it land on top of itself.
+                u.table.set(u.highlight, glm::vec4(1.0f, 0.85f, 0.1f, 1.0f));
+                glDepthFunc(GL_LEQUAL);
+                glDrawElements(GL_TRIANGLES, 3, GL_UNSIGNED_INT, (void*)((size_t)g_pickedFace * 3 * sizeof(unsigned int)));
+            }
+            glDepthFunc(GL_LESS);
+            glDepthMask(GL_TRUE);
+        }
         glBindVertexArray(0);
+        frameRing.end_frame();
 
         glfwSwapBuffers(window);
         glfwPollEvents();
+        if (compareRenderers && comparison.active()) {
+            glFinish();
+            comparison.frameDone(glfwGetTime());
+            if (!comparison.active()) {
+                comparison.print(w, h);
+                g_deferred = savedDeferred;
+                g_usePhong = savedPhong;
+                setPointLights(g_pointLightCount, clusterBuffers);
+                glfwSwapInterval(1);
+            }
+        }
     }
 
-    glDeleteVertexArrays(1, &g_VAO);
-    glDeleteBuffers(1, &g_VBO);
-    glDeleteBuffers(1, &g_EBO);
+    fragmentCounter.release();
+    glDeleteVertexArrays(1, &fullscreenVao);
+    gbuffer.release();
+    materialTable.release();
+    clusterBuffers.release();
+    frameRing.release();
+    shadingBlocks.release();
+    release_mesh(g_mesh);
     glfwTerminate();
     return 0;
 }
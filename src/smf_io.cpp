@@ -0,0 +1,38 @@
+#include "smf_io.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+bool load_smf(const std::string& path, std::vector<glm::vec3>& positions, std::vector<glm::ivec3>& faces) {
+    std::ifstream in(path);
+    if(!in.is_open()) { std::cerr << "Cannot open SMF file: " << path << std::endl; return false; }
+    std::string line; int lineno=0;
+    while(std::getline(in, line)) {
+        lineno++;
+        // trim
+        auto first = line.find_first_not_of(" \t\r\n");
+        if(first==std::string::npos) continue;
+        if(line[first]=='#' || line[first]=='$') continue;
+        std::stringstream ss(line);
+        std::string tag; ss >> tag;
+        if(tag=="v") {
+            glm::vec3 p; if(!(ss >> p.x >> p.y >> p.z)) { continue; }
+            positions.push_back(p);
+        } else if(tag=="f") {
+            std::vector<int> idxs;
+            std::string token;
+            while(ss >> token) {
+                size_t slash = token.find('/');
+                std::string pri = (slash==std::string::npos) ? token : token.substr(0, slash);
+                int id = -1;
+                try { id = std::stoi(pri) - 1; } catch(...) { id = -1; }
+                if(id < 0) { idxs.clear(); break; }
+                idxs.push_back(id);
+            }
+            if(idxs.size() < 3) continue;
+            for(size_t k=1;k+1<idxs.size();++k) faces.push_back(glm::ivec3(idxs[0], idxs[k], idxs[k+1]));
+        }
+    }
+    return !positions.empty() && !faces.empty();
+}
@@ -0,0 +1,9 @@
+#pragma once
+// SMF reader shared by smf_viewer and mesh_bench. Polygons are fan-triangulated.
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <string>
+
+bool load_smf(const std::string& path, std::vector<glm::vec3>& positions, std::vector<glm::ivec3>& faces);
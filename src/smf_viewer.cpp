@@ -12,23 +12,77 @@
 #include <string>
 #include <algorithm>
 #include <cmath>
-
-struct Vertex {
-    glm::vec3 Position;
-    glm::vec3 Normal;
-};
+#include <cstdlib>
+
+#include "vertex_layout.h"
+#include "mesh_clean.h"
+#include "mesh_cache.h"
+#include "mesh_simplify.h"
+#include "mesh_subdivide.h"
+#include "mesh_bounds.h"
+#include "progressive_mesh.h"
+#include "octree_mesh.h"
+#include "mesh_pick.h"
+#include "uniform_table.h"
+#include "gl_ext.h"
+#include "program_cache.h"
+
+using Vertex = VertexPN;
 
 static std::vector<Vertex> vertices;
 static std::vector<unsigned int> indices;
-static GLuint VAO = 0, VBO = 0, EBO = 0, program = 0;
+static GpuMesh mesh;
+static GLuint program = 0;
+static UniformTable uniforms;
+static int uModel = -1, uView = -1, uProjection = -1, uHighlight = -1;
 
 static float cameraAngle = 0.0f;
 static float cameraRadius = 3.0f;
 static float cameraHeight = 0.0f;
 static bool perspectiveProj = true;
 
+// The model is drawn centred on its bounding sphere and scaled to unit radius, so the
+// camera orbits the world origin and the depth range follows from the unit sphere.
 static glm::vec3 modelCentroid(0.0f);
 static float modelScale = 1.0f;
+static float modelRadius = 1.0f;
+static MeshBounds modelBounds;
+static const float kFovY = glm::radians(45.0f);
+
+// Index range of one level of detail inside the shared EBO; level 0 is the full mesh.
+struct LodLevel { GLsizei first_index; GLsizei index_count; float error; };
+static std::vector<LodLevel> lodLevels;
+static bool useLod = false;
+static float lodPixelError = 1.0f;
+
+// Progressive streaming: the base mesh is drawn at once, vertex splits are applied
+// within a per-frame time budget and uploaded as dirty ranges.
+static bool progressiveMesh = false;
+static double progressiveBudgetMs = 2.0;
+static ProgressiveMeshStream progressive;
+
+// Out-of-core rendering: octree chunks stream from disk into a fixed pool of slots in
+// the mesh buffers, so GPU memory stays at outOfCorePoolMB whatever the model size.
+static bool outOfCore = false;
+static size_t outOfCorePoolMB = 256;
+static const size_t kOctreeChunkFaces = 1 << 16;
+static const size_t kOctreeUploadBytes = 16u << 20; // per frame
+static OctreeMeshStream octree;
+
+static bool weldVertices = false;
+static float weldEpsilon = 0.0f; // 0: derived from the bounding box
+static bool cleanMesh = false;
+static bool useMeshCache = true;
+static int cacheCompressBits = 0; // > 0: compressed cache, positions quantised to this many bits
+static bool orientMesh = false;
+static bool cullBackFaces = false;
+static int subdivideLevels = 0;
+static float subdivideMaxEdge = 0.0f; // > 0: adaptive, as a fraction of the bounding-box half-diagonal
+
+// Picking runs against the full-detail triangles; the face index doubles as the
+// offset of the highlighted triangle in the index buffer.
+static MeshPicker picker;
+static uint32_t pickedFace = RayHit::kNone;
 
 void framebuffer_size_callback(GLFWwindow*, int w, int h) {
     glViewport(0, 0, w, h);
@@ -60,68 +114,43 @@ GLuint makeProgramFromFiles(const char* vpath, const char* fpath) {
         std::cerr << "Cannot read shader files\n";
         return 0;
     }
+    uint64_t key = program_cache_key({ vsrc.c_str(), fsrc.c_str() });
+    if(useMeshCache) {
+        if(GLuint prog = load_cached_program(key)) {
+            std::cout << "Program cache hit: " << mesh_cache_path(key, ".glbin") << "\n";
+            return prog;
+        }
+    }
     GLuint vs = compileGLSL(GL_VERTEX_SHADER, vsrc.c_str());
     GLuint fs = compileGLSL(GL_FRAGMENT_SHADER, fsrc.c_str());
     GLuint prog = glCreateProgram();
     glAttachShader(prog, vs);
     glAttachShader(prog, fs);
+    bind_attrib_locations<MeshLayout>(prog);
+    prepare_program_for_cache(prog);
     glLinkProgram(prog);
     GLint ok = 0; glGetProgramiv(prog, GL_LINK_STATUS, &ok);
     if(!ok) {
         char buf[1024]; glGetProgramInfoLog(prog, 1024, NULL, buf);
         std::cerr << "Program link error:\n" << buf << std::endl;
-    }
+    } else if(useMeshCache) save_cached_program(key, prog);
     glDeleteShader(vs); glDeleteShader(fs);
     return prog;
 }
 
-bool load_smf(const std::string& path, std::vector<glm::vec3>& positions, std::vector<glm::ivec3>& faces) {
-    std::ifstream in(path);
-    if(!in.is_open()) { std::cerr << "Cannot open SMF file: " << path << std::endl; return false; }
-    std::string line; int lineno=0;
-    while(std::getline(in, line)) {
-        lineno++;
-        // trim
-        auto first = line.find_first_not_of(" \t\r\n");
-        if(first==std::string::npos) continue;
-        if(line[first]=='#' || line[first]=='$') continue;
-        std::stringstream ss(line);
-        std::string tag; ss >> tag;
-        if(tag=="v") {
-            glm::vec3 p; if(!(ss >> p.x >> p.y >> p.z)) { continue; }
-            positions.push_back(p);
-        } else if(tag=="f") {
-            std::vector<int> idxs;
-            std::string token;
-            while(ss >> token) {
-                size_t slash = token.find('/');
-                std::string pri = (slash==std::string::npos) ? token : token.substr(0, slash);
-                int id = -1;
-                try { id = std::stoi(pri) - 1; } catch(...) { id = -1; }
-                if(id < 0) { idxs.clear(); break; }
-                idxs.push_back(id);
-            }
-            if(idxs.size() < 3) continue;
-            for(size_t k=1;k+1<idxs.size();++k) faces.push_back(glm::ivec3(idxs[0], idxs[k], idxs[k+1]));
-        }
-    }
-    return !positions.empty() && !faces.empty();
+// The clean-up passes selected on the command line.
+MeshPrepareOptions prepare_options() {
+    MeshPrepareOptions o;
+    o.weld = weldVertices;
+    o.weld_epsilon = weldEpsilon;
+    o.clean = cleanMesh;
+    o.use_cache = useMeshCache;
+    o.compress_bits = cacheCompressBits;
+    return o;
 }
 
-bool build_mesh_from_smf(const std::string& filename) {
-    std::vector<glm::vec3> positions;
-    std::vector<glm::ivec3> faces;
-    if(!load_smf(filename, positions, faces)) return false;
-
-    glm::vec3 c(0.0f);
-    for(auto &p: positions) c += p;
-    c /= (float)positions.size();
-    float maxd = 0.0f;
-    for(auto &p: positions) maxd = std::max(maxd, glm::length(p - c));
-    if(maxd <= 0.00001f) maxd = 1.0f;
-    modelCentroid = c;
-    modelScale = 1.0f / maxd; 
-
+// Appends a mesh with smooth vertex normals to vertices/indices and records it as a LOD level.
+void append_smooth_mesh(const std::vector<glm::vec3>& positions, const std::vector<glm::ivec3>& faces, float error) {
     std::vector<glm::vec3> normals(positions.size(), glm::vec3(0.0f));
     for(auto &f: faces) {
         if((size_t)f.x >= positions.size() || (size_t)f.y >= positions.size() || (size_t)f.z >= positions.size()) continue;
@@ -131,45 +160,247 @@ bool build_mesh_from_smf(const std::string& filename) {
         if(glm::length(fn) > 1e-8f) fn = glm::normalize(fn);
         normals[f.x] += fn; normals[f.y] += fn; normals[f.z] += fn;
     }
-    vertices.clear();
-    indices.clear();
-    vertices.resize(positions.size());
+    size_t base = vertices.size();
+    vertices.resize(base + positions.size());
     for(size_t i=0;i<positions.size();++i) {
         Vertex v;
-        v.Position = positions[i];
+        v.position = positions[i];
         glm::vec3 n = normals[i];
-        if(glm::length(n) > 1e-8f) v.Normal = glm::normalize(n);
-        else v.Normal = glm::vec3(0.0f, 0.0f, 1.0f);
-        vertices[i] = v;
+        if(glm::length(n) > 1e-8f) v.normal = glm::normalize(n);
+        else v.normal = glm::vec3(0.0f, 0.0f, 1.0f);
+        vertices[base + i] = v;
     }
+    LodLevel level = { (GLsizei)indices.size(), 0, error };
     for(auto &f: faces) {
-        if((size_t)f.x >= vertices.size() || (size_t)f.y >= vertices.size() || (size_t)f.z >= vertices.size()) continue;
-        indices.push_back((unsigned int)f.x);
-        indices.push_back((unsigned int)f.y);
-        indices.push_back((unsigned int)f.z);
+        if((size_t)f.x >= positions.size() || (size_t)f.y >= positions.size() || (size_t)f.z >= positions.size()) continue;
+        indices.push_back((unsigned int)(base + f.x));
+        indices.push_back((unsigned int)(base + f.y));
+        indices.push_back((unsigned int)(base + f.z));
     }
+    level.index_count = (GLsizei)indices.size() - level.first_index;
+    lodLevels.push_back(level);
+}
 
+bool build_mesh_from_smf(const std::string& filename) {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::ivec3> faces;
+    if(!load_prepared_mesh(filename, prepare_options(), positions, faces)) return false;
+
+    if(orientMesh) {
+        OrientStats os = orient_faces(positions, faces);
+        std::cout << "Orient: " << os.components << " components (" << os.closed_components << " closed), flipped "
+                  << os.flipped_faces << " faces, " << os.inverted_components << " turned outward; "
+                  << os.boundary_edges << " boundary / " << os.nonmanifold_edges << " non-manifold edges, "
+                  << os.conflicts << " conflicts; " << os.ms << " ms\n";
+        cullBackFaces = os.cull_safe();
+    }
+
+    if(subdivideLevels > 0) {
+        float maxEdge = 0.0f;
+        if(subdivideMaxEdge > 0.0f) {
+            glm::vec3 lo = positions[0], hi = positions[0];
+            for(auto &p: positions) { lo = glm::min(lo, p); hi = glm::max(hi, p); }
+            maxEdge = subdivideMaxEdge * 0.5f * glm::length(hi - lo);
+        }
+        SubdivideStats ss = loop_subdivide(positions, faces, subdivideLevels, maxEdge);
+        std::cout << "Subdivide: " << ss.levels << (maxEdge > 0.0f ? " adaptive" : "") << " Loop levels, "
+                  << ss.input_faces << " -> " << faces.size() << " faces (" << ss.ms << " ms)\n";
+        if(faces.empty()) return false;
+    }
+
+    modelBounds = compute_bounds(positions);
+    if(!modelBounds.valid) { std::cerr << "No finite vertex positions\n"; return false; }
+    modelCentroid = modelBounds.sphere.center;
+    modelRadius = std::max(modelBounds.sphere.radius, 1e-5f);
+    modelScale = 1.0f / modelRadius;
+    std::cout << "Bounds: sphere r " << modelBounds.sphere.radius << " (centroid sphere r " << modelBounds.centroid_radius
+              << "), OBB " << 100.0f * modelBounds.obb.volume() / std::max(modelBounds.box.volume(), 1e-30f)
+              << "% of AABB volume; " << modelBounds.ms << " ms\n";
+
+    vertices.clear();
+    indices.clear();
+    lodLevels.clear();
+    append_smooth_mesh(positions, faces, 0.0f);
     std::cout << "✅ Loaded " << positions.size() << " vertices and " << (indices.size()/3) << " faces.\n";
+    std::vector<glm::ivec3> pickFaces(indices.size() / 3);
+    for(size_t i=0;i<pickFaces.size();++i) pickFaces[i] = glm::ivec3(indices[3*i], indices[3*i+1], indices[3*i+2]);
+
+    if(useLod) {
+        SimplifyStats ss;
+        std::vector<MeshLod> chain = build_lod_chain(positions, faces, {0.5f, 0.25f, 0.1f, 0.02f}, &ss);
+        std::cout << "LOD chain: " << ss.collapses << " collapses in " << ss.passes << " passes, " << ss.ms << " ms\n";
+        for(auto &lod: chain) {
+            append_smooth_mesh(lod.positions, lod.faces, lod.error);
+            std::cout << "  " << lod.ratio*100.0f << "%: " << lod.faces.size() << " faces, error " << lod.error << "\n";
+        }
+    }
+    if(!outOfCore) picker.build_async(std::move(positions), std::move(pickFaces));
     return !vertices.empty() && !indices.empty();
 }
 
-void setup_gl_buffers() {
-    if(VAO) { glDeleteVertexArrays(1, &VAO); VAO=0; }
-    if(VBO) { glDeleteBuffers(1, &VBO); VBO=0; }
-    if(EBO) { glDeleteBuffers(1, &EBO); EBO=0; }
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size()*sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size()*sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Position));
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-    glEnableVertexAttribArray(1);
+// Picks the coarsest level whose geometric error, projected at the model's nearest
+// point, stays within lodPixelError pixels.
+// `model` maps file coordinates, like modelCentroid, to world space: no dequantisation.
+size_t select_lod(const glm::mat4& proj, const glm::mat4& view, const glm::mat4& model, int viewportHeight) {
+    glm::vec4 center = view * model * glm::vec4(modelCentroid, 1.0f);
+    float radius = modelRadius * modelScale;
+    bool perspective = proj[2][3] != 0.0f;
+    float dist = std::max(-center.z - radius, 0.01f);
+    float pixelsPerUnit = proj[1][1] * 0.5f * (float)viewportHeight / (perspective ? dist : 1.0f);
+    size_t best = 0;
+    for(size_t i=1;i<lodLevels.size();++i)
+        if(lodLevels[i].error * modelScale * pixelsPerUnit <= lodPixelError) best = i;
+    return best;
+}
+
+// Opens the progressive form of the model, building cache/<key>.pm from the full mesh
+// on first use. Later runs start from the small base without parsing the SMF at all.
+bool open_progressive_mesh(const std::string& filename) {
+    uint64_t key = 0;
+    std::string opts = mesh_prepare_key(prepare_options()) + (orientMesh ? ";orient" : "") + ";pm";
+    if(subdivideLevels > 0) opts += ";loop=" + std::to_string(subdivideLevels) + "," + std::to_string(subdivideMaxEdge);
+    if(!mesh_cache_key(filename, opts, key)) { std::cerr << "Cannot open " << filename << "\n"; return false; }
+    std::string path = mesh_cache_path(key, ".pm");
+    if(!useMeshCache || !progressive.open(path)) {
+        if(!build_mesh_from_smf(filename)) return false;
+        PmBuildStats ps;
+        if(!write_progressive_mesh(path, vertices, indices, 512, &ps)) return false;
+        std::cout << "Progressive mesh: " << ps.splits << " splits over a " << ps.base_faces << "-face base, "
+                  << ps.file_bytes/1024 << " KB, " << ps.ms << " ms -> " << path << "\n";
+        std::vector<Vertex>().swap(vertices);
+        std::vector<unsigned int>().swap(indices);
+        if(!progressive.open(path)) { std::cerr << "Cannot read progressive mesh " << path << "\n"; return false; }
+    } else {
+        std::cout << "Progressive mesh cache hit: " << path << "\n";
+    }
+    // The writer stores the full mesh's bounding sphere, so framing matches the non-streamed path.
+    modelCentroid = progressive.center;
+    modelRadius = progressive.radius;
+    modelScale = 1.0f / progressive.radius;
+    cullBackFaces = orientMesh && progressive.closed;
+    std::cout << "Base mesh: " << progressive.active_vertices() << " vertices, " << progressive.active_indices()/3
+              << " faces (" << progressive.bytes_read()/1024 << " KB)\n";
+    return true;
+}
+
+// Opens the octree-chunked form of the model, building cache/<key>.oct from the full
+// mesh on first use. Later runs only read the chunk table up front.
+bool open_octree_mesh(const std::string& filename) {
+    uint64_t key = 0;
+    std::string opts = mesh_prepare_key(prepare_options()) + (orientMesh ? ";orient" : "") + ";oct=" + std::to_string(kOctreeChunkFaces);
+    if(subdivideLevels > 0) opts += ";loop=" + std::to_string(subdivideLevels) + "," + std::to_string(subdivideMaxEdge);
+    if(!mesh_cache_key(filename, opts, key)) { std::cerr << "Cannot open " << filename << "\n"; return false; }
+    std::string path = mesh_cache_path(key, ".oct");
+    size_t poolBytes = outOfCorePoolMB << 20;
+    if(!useMeshCache || !octree.open(path, poolBytes, MeshLayout::vertex_bytes)) {
+        if(!build_mesh_from_smf(filename)) return false;
+        OctreeBuildStats os;
+        if(!write_octree_mesh(path, vertices, indices, cullBackFaces, kOctreeChunkFaces, &os)) return false;
+        std::cout << "Octree mesh: " << os.chunks << " chunks, depth " << os.max_depth << ", " << os.shared_vertices
+                  << " border vertex copies, " << os.file_bytes/1024 << " KB, " << os.ms << " ms -> " << path << "\n";
+        std::vector<Vertex>().swap(vertices);
+        std::vector<unsigned int>().swap(indices);
+        if(!octree.open(path, poolBytes, MeshLayout::vertex_bytes)) { std::cerr << "Cannot read octree mesh " << path << "\n"; return false; }
+    } else {
+        std::cout << "Octree mesh cache hit: " << path << "\n";
+    }
+    modelCentroid = octree.center;
+    modelRadius = octree.radius;
+    modelScale = 1.0f / octree.radius;
+    cullBackFaces = octree.closed;
+    size_t slotBytes = octree.slot_vertices() * MeshLayout::vertex_bytes + octree.slot_indices() * sizeof(unsigned int);
+    std::cout << "GPU pool: " << octree.slot_count() << " of " << octree.chunk_count() << " chunks resident at once ("
+              << (octree.slot_count() * slotBytes) / (1024*1024) << " MB)\n";
+    return true;
+}
+
+// Uploads the chunks that finished loading into their pool slots and draws the resident visible ones.
+void draw_octree_mesh(const glm::mat4& modelView, const glm::mat4& proj, int viewportHeight) {
+    octree.update(modelView, proj, viewportHeight, kOctreeUploadBytes);
+    for(const OctreeUpload& u: octree.uploads()) {
+        update_mesh_vertices<MeshLayout>(mesh, u.vertices, (size_t)u.slot * octree.slot_vertices(), u.vertex_count);
+        update_mesh_indices(mesh, u.indices, (size_t)u.slot * octree.slot_indices(), u.index_count);
+    }
+    glBindVertexArray(mesh.vao);
+    for(const OctreeDraw& d: octree.draws())
+        glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)d.index_count, GL_UNSIGNED_INT,
+                                 (void*)((size_t)d.slot * octree.slot_indices() * sizeof(unsigned int)),
+                                 (GLint)(d.slot * octree.slot_vertices()));
     glBindVertexArray(0);
+
+    static bool settled = false;
+    bool now = octree.resident_visible_chunks() == octree.visible_chunks();
+    if(now && !settled)
+        std::cout << "Out-of-core: " << octree.visible_chunks() << " visible chunks resident, " << octree.bytes_read()/1024
+                  << " KB read, " << octree.evictions() << " evictions\n";
+    settled = now;
+}
+
+// Applies splits for this frame's budget and uploads what changed.
+void stream_progressive_mesh() {
+    static std::vector<std::pair<size_t, size_t>> ranges;
+    static double startTime = glfwGetTime();
+    progressive.refine(progressiveBudgetMs);
+    size_t vertexFirst = 0, vertexCount = 0;
+    if(progressive.take_dirty(vertexFirst, vertexCount, ranges)) {
+        update_mesh_vertices<MeshLayout>(mesh, progressive.vertices().data() + vertexFirst, vertexFirst, vertexCount);
+        for(auto &r: ranges) update_mesh_indices(mesh, progressive.indices().data() + r.first, r.first, r.second);
+        mesh.index_count = (GLsizei)progressive.active_indices();
+        if(progressive.complete()) {
+            std::cout << "Progressive mesh complete: " << mesh.index_count/3 << " faces, " << progressive.bytes_read()/1024
+                      << " KB streamed in " << (glfwGetTime() - startTime) << " s\n";
+            std::vector<glm::vec3> positions(progressive.active_vertices());
+            std::vector<glm::ivec3> faces(progressive.active_indices() / 3);
+            for(size_t i=0;i<positions.size();++i) positions[i] = progressive.vertices()[i].position;
+            const std::vector<unsigned int>& idx = progressive.indices();
+            for(size_t i=0;i<faces.size();++i) faces[i] = glm::ivec3(idx[3*i], idx[3*i+1], idx[3*i+2]);
+            picker.build_async(std::move(positions), std::move(faces));
+        }
+    }
+}
+
+// Picks the triangle under the cursor; `model` maps the picker's positions to world space.
+void pick_under_cursor(GLFWwindow* window, const glm::mat4& proj, const glm::mat4& view, const glm::mat4& model) {
+    double x, y; glfwGetCursorPos(window, &x, &y);
+    int w, h; glfwGetWindowSize(window, &w, &h);
+    PickResult r;
+    if(outOfCore) { std::cout << "Pick: not available with --out-of-core\n"; return; }
+    if(!picker.pick(cursor_ray(x, y, w, h, proj, view, model), r)) {
+        std::cout << "Pick: " << (progressiveMesh && !progressive.complete() ? "available once the progressive mesh is complete"
+                                                                              : "BVH still building") << "\n";
+        return;
+    }
+    static bool reported = false;
+    if(!reported) {
+        reported = true;
+        const BvhStats& bs = picker.stats();
+        std::cout << "Pick BVH: " << bs.triangles << " triangles, " << bs.nodes << " nodes, depth " << bs.max_depth
+                  << ", built in " << bs.ms << " ms\n";
+    }
+    pickedFace = r.face;
+    if(!r.hit()) { std::cout << "Pick: nothing under the cursor (" << r.ms << " ms)\n"; return; }
+    std::cout << "Pick: face " << r.face << " (" << r.ms << " ms)\n";
+    for(int k=0;k<3;++k)
+        std::cout << "  v" << r.corners[k] << " (" << r.positions[k].x << ", " << r.positions[k].y << ", " << r.positions[k].z << ")\n";
+}
+
+void setup_gl_buffers() {
+    if(outOfCore) {
+        VertexQuant q;
+        q.center = octree.center;
+        q.extent = octree.radius;
+        allocate_mesh<MeshLayout>(octree.slot_count() * octree.slot_vertices(), octree.slot_count() * octree.slot_indices(), q, mesh);
+        return;
+    }
+    if(progressiveMesh) {
+        VertexQuant q;
+        q.center = progressive.center;
+        q.extent = progressive.radius;
+        allocate_mesh<MeshLayout>(progressive.vertices().size(), progressive.indices().size(), q, mesh);
+        lodLevels.assign(1, LodLevel{ 0, 0, 0.0f });
+        return;
+    }
+    upload_mesh<MeshLayout>(vertices, indices, mesh);
 }
 
 void processInput(GLFWwindow* window) {
@@ -186,11 +417,53 @@ void processInput(GLFWwindow* window) {
         pWasPressed = true;
     } else pWasPressed = false;
 
+    static bool tWasPressed = false;
+    if (glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS) {
+        if (!tWasPressed) print_uniform_stats("basic", uniforms.stats);
+        tWasPressed = true;
+    } else tWasPressed = false;
+
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) glfwSetWindowShouldClose(window, true);
 }
 
+// Matches "--name" or "--name=value"; value is left untouched when absent.
+static bool parse_flag(const std::string& arg, const char* name, std::string& value) {
+    size_t n = std::char_traits<char>::length(name);
+    if(arg.compare(0, n, name) != 0) return false;
+    if(arg.size() == n) return true;
+    if(arg[n] != '=') return false;
+    value = arg.substr(n + 1);
+    return true;
+}
+
 int main(int argc, char** argv) {
-    if(argc < 2) { std::cerr << "Usage: ./smf_viewer <models/your.smf>\n"; return 1; }
+    const char* usage = "Usage: ./smf_viewer <models/your.smf> [--weld[=eps]] [--clean] [--no-cache] [--orient] [--lod[=px]] [--progressive[=ms]]\n"
+                        "       [--subdivide[=levels]] [--subdivide-edge=fraction] [--cache-compress[=bits]] [--out-of-core[=MB]]\n";
+    std::string modelPath;
+    for(int i=1;i<argc;++i) {
+        std::string arg = argv[i], val;
+        if(parse_flag(arg, "--weld", val)) { weldVertices = true; if(!val.empty()) weldEpsilon = (float)std::atof(val.c_str()); }
+        else if(arg == "--clean") cleanMesh = true;
+        else if(arg == "--no-cache") useMeshCache = false;
+        else if(parse_flag(arg, "--cache-compress", val)) {
+            // Only cleaned meshes are cached, so compressing the cache implies --clean.
+            cacheCompressBits = val.empty() ? 16 : std::min(std::max(std::atoi(val.c_str()), 8), 24);
+            cleanMesh = true;
+        }
+        else if(arg == "--orient") orientMesh = true;
+        else if(parse_flag(arg, "--lod", val)) { useLod = true; if(!val.empty()) lodPixelError = (float)std::atof(val.c_str()); }
+        else if(parse_flag(arg, "--subdivide-edge", val)) subdivideMaxEdge = (float)std::atof(val.c_str());
+        else if(parse_flag(arg, "--subdivide", val)) subdivideLevels = val.empty() ? 1 : std::atoi(val.c_str());
+        else if(parse_flag(arg, "--out-of-core", val)) { outOfCore = true; if(!val.empty()) outOfCorePoolMB = (size_t)std::max(1, std::atoi(val.c_str())); }
+        else if(parse_flag(arg, "--progressive", val)) { progressiveMesh = true; if(!val.empty()) progressiveBudgetMs = std::atof(val.c_str()); }
+        else if(arg.rfind("--", 0) == 0) { std::cerr << "Unknown option " << arg << "\n" << usage; return 1; }
+        else modelPath = arg;
+    }
+    if(modelPath.empty()) { std::cerr << usage; return 1; }
+    if(subdivideMaxEdge > 0.0f && subdivideLevels == 0) subdivideLevels = 8;
+    if(outOfCore && progressiveMesh) { std::cout << "--out-of-core replaces --progressive; ignoring --progressive\n"; progressiveMesh = false; }
+    if(outOfCore && useLod) { std::cout << "--out-of-core replaces --lod; ignoring --lod\n"; useLod = false; }
+    if(progressiveMesh && useLod) { std::cout << "--progressive replaces --lod; ignoring --lod\n"; useLod = false; }
 
     glfwSetErrorCallback([](int e, const char* desc){ std::cerr << "GLFW err " << e << ": " << desc << std::endl; });
     if(!glfwInit()) { std::cerr << "glfwInit failed\n"; return 1; }
@@ -211,20 +484,36 @@ int main(int argc, char** argv) {
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 
     if(!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) { std::cerr << "gladLoadGLLoader failed\n"; glfwTerminate(); return 1; }
+    load_gl_extensions((GLADloadproc)glfwGetProcAddress);
 
-    if(!build_mesh_from_smf(argv[1])) { std::cerr << "Failed to build mesh\n"; glfwTerminate(); return 1; }
+    bool opened = outOfCore ? open_octree_mesh(modelPath) : progressiveMesh ? open_progressive_mesh(modelPath) : build_mesh_from_smf(modelPath);
+    if(!opened) { std::cerr << "Failed to build mesh\n"; glfwTerminate(); return 1; }
 
     program = makeProgramFromFiles("shaders/basic.vert", "shaders/basic.frag");
     if(!program) { std::cerr << "Failed to create program\n"; glfwTerminate(); return 1; }
+    uniforms.reflect(program);
+    uModel = uniforms.find("model");
+    uView = uniforms.find("view");
+    uProjection = uniforms.find("projection");
+    uHighlight = uniforms.find("highlight");
 
     setup_gl_buffers();
     glEnable(GL_DEPTH_TEST);
+    if(cullBackFaces) {
+        glEnable(GL_CULL_FACE);
+        glCullFace(GL_BACK);
+        std::cout << "Back-face culling enabled (closed, consistently wound mesh)\n";
+    }
 
     glm::mat4 modelTranslate = glm::translate(glm::mat4(1.0f), -modelCentroid);
     glm::mat4 modelScaleM = glm::scale(glm::mat4(1.0f), glm::vec3(modelScale));
-    glm::mat4 modelBase = modelScaleM * modelTranslate;
+    glm::mat4 pickModel = modelScaleM * modelTranslate;
+    glm::mat4 modelBase = pickModel * mesh.dequant;
+
+    int fbw = 0, fbh = 0; glfwGetFramebufferSize(window, &fbw, &fbh);
+    cameraRadius = framing_distance(1.0f, kFovY, (fbw > 0 && fbh > 0) ? (float)fbw/(float)fbh : 900.0f/700.0f);
 
-    std::cout << "Controls: A/D rotate, W/S zoom, Q/E height, P toggle projection, ESC exit\n";
+    std::cout << "Controls: A/D rotate, W/S zoom, Q/E height, P toggle projection, left click pick, T uniform stats, ESC exit\n";
 
     while(!glfwWindowShouldClose(window)) {
         processInput(window);
@@ -236,22 +525,61 @@ int main(int argc, char** argv) {
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         glm::vec3 camPos;
-        camPos.x = modelCentroid.x + cameraRadius * cos(cameraAngle);
-        camPos.y = modelCentroid.y + cameraHeight;
-        camPos.z = modelCentroid.z + cameraRadius * sin(cameraAngle);
+        camPos.x = cameraRadius * cos(cameraAngle);
+        camPos.y = cameraHeight;
+        camPos.z = cameraRadius * sin(cameraAngle);
 
-        glm::mat4 view = glm::lookAt(camPos, modelCentroid, glm::vec3(0.0f,1.0f,0.0f));
-        glm::mat4 proj = perspectiveProj ? glm::perspective(glm::radians(45.0f), aspect, 0.01f, 100.0f)
-                                         : glm::ortho(-1.5f*aspect, 1.5f*aspect, -1.5f, 1.5f, -10.0f, 10.0f);
+        glm::mat4 view = glm::lookAt(camPos, glm::vec3(0.0f), glm::vec3(0.0f,1.0f,0.0f));
+        float zNear, zFar;
+        sphere_depth_range(glm::length(camPos), 1.0f, zNear, zFar);
+        glm::mat4 proj = perspectiveProj ? glm::perspective(kFovY, aspect, zNear, zFar)
+                                         : glm::ortho(-1.5f*aspect, 1.5f*aspect, -1.5f, 1.5f, glm::length(camPos) - 1.01f, zFar);
 
-        glUseProgram(program);
         glm::mat4 model = modelBase;
-        glUniformMatrix4fv(glGetUniformLocation(program,"model"), 1, GL_FALSE, glm::value_ptr(model));
-        glUniformMatrix4fv(glGetUniformLocation(program,"view"),  1, GL_FALSE, glm::value_ptr(view));
-        glUniformMatrix4fv(glGetUniformLocation(program,"projection"), 1, GL_FALSE, glm::value_ptr(proj));
+        static bool clickWasPressed = false;
+        bool click = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+        if(click && !clickWasPressed) pick_under_cursor(window, proj, view, pickModel);
+        clickWasPressed = click;
+        if(progressiveMesh) {
+            stream_progressive_mesh();
+            lodLevels[0].index_count = mesh.index_count;
+        }
+        size_t lod = useLod ? select_lod(proj, view, pickModel, h) : 0;
+        static size_t shownLod = 0;
+        if(lod != shownLod) {
+            shownLod = lod;
+            std::cout << "LOD " << lod << ": " << lodLevels[lod].index_count/3 << " faces\n";
+        }
 
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, (GLsizei)indices.size(), GL_UNSIGNED_INT, 0);
+        glUseProgram(program);
+        double uniformStart = glfwGetTime();
+        uniforms.set(uModel, model);
+        uniforms.set(uView, view);
+        uniforms.set(uProjection, proj);
+        uniforms.set(uHighlight, glm::vec4(0.0f));
+        uniforms.stats.ms += 1000.0 * (glfwGetTime() - uniformStart);
+        ++uniforms.stats.frames;
+
+        if(outOfCore) {
+            draw_octree_mesh(view * pickModel, proj, h);
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+            continue;
+        }
+        glBindVertexArray(mesh.vao);
+        glDrawElements(GL_TRIANGLES, lodLevels[lod].index_count, GL_UNSIGNED_INT, (void*)(lodLevels[lod].first_index*sizeof(unsigned int)));
+        if(pickedFace != RayHit::kNone) {
+            // The picked face is always a level-0 triangle. At level 0 it is the same
+            // geometry through the same shader, so LEQUAL lets it land on top of itself;
+            // a coarser level's surface can pass in front of it or fall behind it by up to
+            // that level's error, so there the highlight is drawn without depth testing.
+            uniforms.set(uHighlight, glm::vec4(1.0f, 0.85f, 0.1f, 1.0f));
+            if(lod == 0) glDepthFunc(GL_LEQUAL);
+            else glDisable(GL_DEPTH_TEST);
+            glDrawElements(GL_TRIANGLES, 3, GL_UNSIGNED_INT, (void*)((size_t)pickedFace*3*sizeof(unsigned int)));
+            glEnable(GL_DEPTH_TEST);
+            glDepthFunc(GL_LESS);
+        }
         glBindVertexArray(0);
 
         glfwSwapBuffers(window);
@@ -259,9 +587,8 @@ int main(int argc, char** argv) {
     }
 
     glDeleteProgram(program);
-    if(VAO) glDeleteVertexArrays(1, &VAO);
-    if(VBO) glDeleteBuffers(1, &VBO);
-    if(EBO) glDeleteBuffers(1, &EBO);
+    octree.close();
+    release_mesh(mesh);
     glfwTerminate();
     return 0;
 }
@@ -0,0 +1,172 @@
+#pragma once
+// Ring buffer for per-frame dynamic data (uniform blocks, transforms, light lists).
+//
+// With buffer storage the buffer holds `frames` regions and stays mapped for its
+// whole life (persistent, coherent). Each frame writes into the next region; a
+// glFenceSync placed after the frame's draws tells a later begin_frame() when the GPU
+// is done with that region, and waiting on a fence that has not signalled yet counts
+// as a stall. Without buffer storage (e.g. a plain 3.3 context) the buffer is one
+// region that is orphaned and re-mapped every frame, leaving the driver to keep the
+// old storage alive until the GPU is done with it.
+//
+// Per frame: begin_frame(), allocate() and write, commit(), draw, end_frame().
+//
+// The ring owns a buffer, its mapping and fences: call release() while the context is
+// current. The destructor releases as a fallback, which is only safe if the ring dies
+// before the context does, not after glfwTerminate() on an early-return path.
+
+#include "gl_ext.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+
+struct StreamRingStats {
+    size_t frames = 0;
+    size_t stalls = 0;      // begin_frame() found the region still in use by the GPU
+    double stall_ms = 0.0;  // CPU time spent waiting for it
+    size_t orphans = 0;     // fallback path: buffer storage replaced
+    size_t bytes = 0;       // allocated
+    size_t overflows = 0;   // allocate() calls that did not fit the region
+};
+
+class StreamRing {
+public:
+    StreamRing() = default;
+    StreamRing(const StreamRing&) = delete;
+    StreamRing& operator=(const StreamRing&) = delete;
+    ~StreamRing() { release(); }
+
+    // `region_bytes` per frame; `frames` regions (at most kMaxRegions) when persistent
+    // mapping is available.
+    bool create(GLenum buffer_target, size_t region_bytes, int frames = 3) {
+        release();
+        target = buffer_target;
+        region = region_bytes;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(target, buffer);
+        if(gl_ext.buffer_storage) {
+            regions = std::min(std::max(frames, 1), kMaxRegions); // one fence each
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            gl_ext.BufferStorage(target, (GLsizeiptr)(region * regions), nullptr, flags);
+            mapped = (uint8_t*)glMapBufferRange(target, 0, (GLsizeiptr)(region * regions), flags);
+            if(!mapped) {
+                std::cerr << "Ring buffer: persistent mapping failed, falling back to orphaning" << std::endl;
+                glBindBuffer(target, 0);
+                glDeleteBuffers(1, &buffer);
+                glGenBuffers(1, &buffer);
+                glBindBuffer(target, buffer);
+            }
+        }
+        if(!mapped) {
+            regions = 1;
+            glBufferData(target, (GLsizeiptr)region, nullptr, GL_STREAM_DRAW);
+        }
+        glBindBuffer(target, 0);
+        persistent_map = mapped != nullptr;
+        for(GLsync& f: fences) f = nullptr;
+        current = 0;
+        return true;
+    }
+
+    void release() {
+        for(GLsync& f: fences) { if(f) glDeleteSync(f); f = nullptr; }
+        if(buffer) {
+            if(persistent_map) { glBindBuffer(target, buffer); glUnmapBuffer(target); glBindBuffer(target, 0); }
+            glDeleteBuffers(1, &buffer);
+        }
+        buffer = 0;
+        mapped = nullptr;
+        persistent_map = false;
+    }
+
+    // Makes the next region writable, waiting for the GPU if it still reads it.
+    void begin_frame() {
+        if(!buffer) return;
+        ++stats.frames;
+        head = 0;
+        if(persistent_map) {
+            current = (current + 1) % regions;
+            GLsync& f = fences[current];
+            if(f) {
+                GLenum r = glClientWaitSync(f, 0, 0);
+                if(r == GL_TIMEOUT_EXPIRED) {
+                    auto t0 = std::chrono::steady_clock::now();
+                    ++stats.stalls;
+                    do r = glClientWaitSync(f, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+                    while(r == GL_TIMEOUT_EXPIRED);
+                    stats.stall_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+                }
+                glDeleteSync(f);
+                f = nullptr;
+            }
+            frame_base = mapped + current * region;
+        } else {
+            glBindBuffer(target, buffer);
+            glBufferData(target, (GLsizeiptr)region, nullptr, GL_STREAM_DRAW); // orphan
+            frame_base = (uint8_t*)glMapBufferRange(target, 0, (GLsizeiptr)region, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            glBindBuffer(target, 0);
+            ++stats.orphans;
+        }
+    }
+
+    // Reserves `size` bytes aligned to `align` (a power of two) in this frame's region.
+    // Returns the write pointer and the offset to bind or draw from, or null when full.
+    void* allocate(size_t size, size_t align, size_t& offset) {
+        if(!frame_base) return nullptr;
+        size_t start = (head + align - 1) & ~(align - 1);
+        if(start + size > region) { ++stats.overflows; return nullptr; }
+        head = start + size;
+        stats.bytes += size;
+        offset = (persistent_map ? current * region : 0) + start;
+        return frame_base + start;
+    }
+
+    // Ends CPU writes for the frame; the data may be used by draws from here on.
+    void commit() {
+        if(!persistent_map && frame_base) {
+            glBindBuffer(target, buffer);
+            glUnmapBuffer(target);
+            glBindBuffer(target, 0);
+        }
+        if(!persistent_map) frame_base = nullptr;
+    }
+
+    // Call after the frame's last draw that reads the ring.
+    void end_frame() {
+        if(persistent_map) fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        frame_base = nullptr;
+    }
+
+    GLuint id() const { return buffer; }
+    bool persistent() const { return persistent_map; }
+    size_t region_bytes() const { return region; }
+
+    StreamRingStats stats;
+
+private:
+    static constexpr int kMaxRegions = 4;
+    GLenum target = GL_ARRAY_BUFFER;
+    GLuint buffer = 0;
+    size_t region = 0;
+    int regions = 1;
+    int current = 0;
+    size_t head = 0;
+    uint8_t* mapped = nullptr;     // whole buffer, persistent path only
+    uint8_t* frame_base = nullptr; // this frame's region while writable
+    bool persistent_map = false;
+    GLsync fences[kMaxRegions] = {};
+};
+
+inline void print_ring_stats(const char* label, StreamRingStats& s) {
+    if(!s.frames) return;
+    std::cout << "Ring buffer (" << label << "): " << s.stalls << " stalls (" << s.stall_ms << " ms waited), "
+              << s.orphans << " orphans, " << (double)s.bytes / s.frames << " bytes per frame";
+    if(s.overflows) std::cout << ", " << s.overflows << " allocations did not fit";
+    std::cout << " over " << s.frames << " frames\n";
+    s = StreamRingStats();
+}
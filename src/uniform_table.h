@@ -0,0 +1,232 @@
+#pragma once
+// Per-program uniform tables and shared std140 uniform buffers.
+//
+// reflect() enumerates a linked program's active uniforms once, so lookups never go
+// back to glGetUniformLocation. Each uniform keeps a shadow copy of the last value
+// sent; set() compares against it and only calls glUniform* when the value changed.
+// Uniform values are per-program GL state, so the shadows stay valid across
+// glUseProgram switches. set() uploads to the currently bound program, which must be
+// the table's own.
+//
+// UniformBuffer packs several uniform blocks into one UBO at aligned offsets, bound to
+// consecutive binding points once. Blocks are written into a CPU mirror; flush()
+// sends the span that actually changed with a single glBufferSubData, and programs
+// that share the binding points see the data without any per-program uploads.
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <iostream>
+
+struct UniformStats {
+    size_t uploads = 0; // glUniform* or glBufferSubData calls made
+    size_t skipped = 0; // sets or block writes that matched the shadow value
+    size_t bytes = 0;   // buffer bytes sent (uniform buffers only)
+    size_t frames = 0;
+    double ms = 0.0;    // CPU time spent setting uniforms
+};
+
+class UniformTable {
+public:
+    // Rebuilds the table from the program's active uniforms; arrays are not supported
+    // beyond their first element.
+    void reflect(GLuint prog) {
+        entries.clear();
+        shadow.clear();
+        GLint count = 0, longest = 0;
+        glGetProgramiv(prog, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(prog, GL_ACTIVE_UNIFORM_MAX_LENGTH, &longest);
+        std::vector<char> name((size_t)std::max(longest, 1));
+        for(GLint i=0;i<count;++i) {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(prog, (GLuint)i, (GLsizei)name.size(), &length, &size, &type, name.data());
+            Entry e;
+            e.name.assign(name.data(), (size_t)length);
+            if(e.name.size() > 3 && e.name.compare(e.name.size() - 3, 3, "[0]") == 0) e.name.resize(e.name.size() - 3);
+            e.location = glGetUniformLocation(prog, e.name.c_str());
+            if(e.location < 0) continue; // block members live in buffers, not here
+            e.type = type;
+            e.words = words_of(type);
+            if(!e.words) continue;
+            e.offset = shadow.size();
+            shadow.resize(shadow.size() + e.words, 0u);
+            entries.push_back(e);
+        }
+    }
+
+    // Handle for set(); -1 when the program has no such active uniform (set() ignores -1).
+    int find(const char* name) const {
+        for(size_t i=0;i<entries.size();++i) if(entries[i].name == name) return (int)i;
+        return -1;
+    }
+    GLint location(int handle) const { return handle >= 0 ? entries[(size_t)handle].location : -1; }
+    size_t size() const { return entries.size(); }
+
+    void set(int handle, float v)               { store(handle, GL_FLOAT, &v); }
+    void set(int handle, const glm::vec2& v)    { store(handle, GL_FLOAT_VEC2, glm::value_ptr(v)); }
+    void set(int handle, const glm::vec3& v)    { store(handle, GL_FLOAT_VEC3, glm::value_ptr(v)); }
+    void set(int handle, const glm::vec4& v)    { store(handle, GL_FLOAT_VEC4, glm::value_ptr(v)); }
+    void set(int handle, const glm::mat4& v)    { store(handle, GL_FLOAT_MAT4, glm::value_ptr(v)); }
+    void set(int handle, int v)                 { store(handle, GL_INT, &v); }
+
+    // Forgets the shadows, e.g. after something else changed the program's uniforms.
+    void invalidate() { for(Entry& e: entries) e.valid = false; }
+
+    UniformStats stats;
+
+private:
+    struct Entry {
+        std::string name;
+        GLint location = -1;
+        GLenum type = 0;
+        size_t words = 0;  // 32-bit words in the shadow
+        size_t offset = 0;
+        bool valid = false;
+        bool warned = false;
+    };
+
+    static size_t words_of(GLenum type) {
+        switch(type) {
+        case GL_FLOAT: case GL_INT: case GL_BOOL:
+        case GL_SAMPLER_1D: case GL_SAMPLER_2D: case GL_SAMPLER_3D: case GL_SAMPLER_CUBE:
+        case GL_SAMPLER_2D_SHADOW: case GL_SAMPLER_BUFFER: case GL_INT_SAMPLER_BUFFER: case GL_UNSIGNED_INT_SAMPLER_BUFFER:
+        case GL_SAMPLER_2D_ARRAY: case GL_SAMPLER_2D_MULTISAMPLE:
+        case GL_INT_SAMPLER_2D: case GL_UNSIGNED_INT_SAMPLER_2D:
+            return 1;
+        case GL_FLOAT_VEC2: return 2;
+        case GL_FLOAT_VEC3: return 3;
+        case GL_FLOAT_VEC4: return 4;
+        case GL_FLOAT_MAT4: return 16;
+        default: return 0;
+        }
+    }
+
+    // `type` is what the caller passes: GL_INT also covers samplers and bools.
+    void store(int handle, GLenum type, const void* data) {
+        if(handle < 0) return;
+        Entry& e = entries[(size_t)handle];
+        bool int_like = e.type != GL_FLOAT && words_of(e.type) == 1;
+        if(type != e.type && !(type == GL_INT && int_like)) {
+            if(!e.warned) std::cerr << "Uniform " << e.name << ": value does not match its GLSL type" << std::endl;
+            e.warned = true;
+            return;
+        }
+        uint32_t* slot = shadow.data() + e.offset;
+        size_t bytes = e.words * sizeof(uint32_t);
+        if(e.valid && std::memcmp(slot, data, bytes) == 0) { ++stats.skipped; return; }
+        std::memcpy(slot, data, bytes);
+        e.valid = true;
+        ++stats.uploads;
+        const float* f = (const float*)data;
+        switch(type) {
+        case GL_FLOAT:      glUniform1fv(e.location, 1, f); break;
+        case GL_FLOAT_VEC2: glUniform2fv(e.location, 1, f); break;
+        case GL_FLOAT_VEC3: glUniform3fv(e.location, 1, f); break;
+        case GL_FLOAT_VEC4: glUniform4fv(e.location, 1, f); break;
+        case GL_FLOAT_MAT4: glUniformMatrix4fv(e.location, 1, GL_FALSE, f); break;
+        default:            glUniform1iv(e.location, 1, (const GLint*)data); break;
+        }
+    }
+
+    std::vector<Entry> entries;
+    std::vector<uint32_t> shadow;
+};
+
+// Binds the named block of `prog` to `binding`; false when the program has no such block.
+inline bool bind_uniform_block(GLuint prog, const char* name, GLuint binding) {
+    GLuint index = glGetUniformBlockIndex(prog, name);
+    if(index == GL_INVALID_INDEX) return false;
+    glUniformBlockBinding(prog, index, binding);
+    return true;
+}
+
+// Owns a GL buffer. Call release() while its context is current: the destructor
+// releases as a fallback, which is only safe if the object dies before the context
+// does, not after glfwTerminate() on an early-return path.
+class UniformBuffer {
+public:
+    UniformBuffer() = default;
+    UniformBuffer(const UniformBuffer&) = delete;
+    UniformBuffer& operator=(const UniformBuffer&) = delete;
+    ~UniformBuffer() { release(); }
+
+    // One block per entry of `sizes`; block i is bound to binding point first_binding + i.
+    void create(const std::vector<size_t>& sizes, GLuint first_binding = 0) {
+        release();
+        GLint align = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align);
+        align = std::max(align, 16);
+        size_t total = 0;
+        for(size_t size: sizes) {
+            blocks.push_back(Block{ total, size });
+            total += (size + (size_t)align - 1) / (size_t)align * (size_t)align;
+        }
+        mirror.assign(total, 0);
+        glGenBuffers(1, &ubo);
+        glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+        glBufferData(GL_UNIFORM_BUFFER, (GLsizeiptr)total, nullptr, GL_DYNAMIC_DRAW);
+        for(size_t i=0;i<blocks.size();++i)
+            glBindBufferRange(GL_UNIFORM_BUFFER, first_binding + (GLuint)i, ubo, (GLintptr)blocks[i].offset, (GLsizeiptr)blocks[i].size);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        dirty_lo = 0;
+        dirty_hi = total;
+    }
+
+    void release() {
+        if(ubo) glDeleteBuffers(1, &ubo);
+        ubo = 0;
+        blocks.clear();
+        mirror.clear();
+    }
+
+    // Copies a block's std140 image into the mirror; unchanged data leaves it clean.
+    template<class T> void write(size_t block, const T& data) {
+        const Block& b = blocks[block];
+        if(sizeof(T) != b.size) { std::cerr << "Uniform block " << block << ": size mismatch" << std::endl; return; }
+        uint8_t* dst = mirror.data() + b.offset;
+        if(std::memcmp(dst, &data, sizeof(T)) == 0) { ++stats.skipped; return; }
+        std::memcpy(dst, &data, sizeof(T));
+        dirty_lo = std::min(dirty_lo, b.offset);
+        dirty_hi = std::max(dirty_hi, b.offset + b.size);
+    }
+
+    // Uploads the dirty span, if any, in one call.
+    void flush() {
+        if(dirty_lo >= dirty_hi) return;
+        glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+        glBufferSubData(GL_UNIFORM_BUFFER, (GLintptr)dirty_lo, (GLsizeiptr)(dirty_hi - dirty_lo), mirror.data() + dirty_lo);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        ++stats.uploads;
+        stats.bytes += dirty_hi - dirty_lo;
+        dirty_lo = mirror.size();
+        dirty_hi = 0;
+    }
+
+    UniformStats stats;
+
+private:
+    struct Block { size_t offset, size; };
+    GLuint ubo = 0;
+    std::vector<Block> blocks;
+    std::vector<uint8_t> mirror;
+    size_t dirty_lo = 0, dirty_hi = 0;
+};
+
+// One line per report: average uploads and skips per frame and the CPU time behind them.
+inline void print_uniform_stats(const char* label, UniformStats& s) {
+    if(!s.frames) return;
+    std::cout << "Uniforms (" << label << "): " << (double)s.uploads / s.frames << " uploads";
+    if(s.bytes) std::cout << " (" << (double)s.bytes / s.frames << " bytes)";
+    std::cout << " and " << (double)s.skipped / s.frames << " skipped per frame, " << 1000.0 * s.ms / s.frames
+              << " us CPU per frame over " << s.frames << " frames\n";
+    s = UniformStats();
+}
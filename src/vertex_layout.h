@@ -0,0 +1,387 @@
+#pragma once
+// Compile-time vertex layout descriptors.
+//
+// A vertex type lists its attributes once, in a vertex_traits<> specialisation.
+// Stride, packing, glVertexAttribPointer calls and attribute-name bindings are all
+// generated from that list. A VertexLayout<Streams...> groups vertex types into
+// buffer streams, so interleaved, quantised and split-stream layouts are swapped
+// by changing a type (or by building with -DMESH_LAYOUT=<layout>).
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_precision.hpp>
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <type_traits>
+#include <tuple>
+
+struct VertexAttrib {
+    GLuint location;
+    const char* name;
+    GLint components;
+    GLenum type;
+    GLboolean normalized;
+    size_t offset;
+};
+
+template<class T> struct gl_scalar;
+template<> struct gl_scalar<float>    { static constexpr GLenum type = GL_FLOAT; };
+template<> struct gl_scalar<int8_t>   { static constexpr GLenum type = GL_BYTE; };
+template<> struct gl_scalar<uint8_t>  { static constexpr GLenum type = GL_UNSIGNED_BYTE; };
+template<> struct gl_scalar<int16_t>  { static constexpr GLenum type = GL_SHORT; };
+template<> struct gl_scalar<uint16_t> { static constexpr GLenum type = GL_UNSIGNED_SHORT; };
+template<> struct gl_scalar<int32_t>  { static constexpr GLenum type = GL_INT; };
+template<> struct gl_scalar<uint32_t> { static constexpr GLenum type = GL_UNSIGNED_INT; };
+
+// Component count / GL type of a member: scalars count as 1, glm vectors as length().
+template<class M, class = void> struct gl_member {
+    static constexpr GLint components = 1;
+    static constexpr GLenum type = gl_scalar<M>::type;
+};
+template<class M> struct gl_member<M, std::void_t<typename M::value_type>> {
+    static constexpr GLint components = (GLint)M::length();
+    static constexpr GLenum type = gl_scalar<typename M::value_type>::type;
+};
+
+#define VERTEX_ATTRIB(V, member, location, name, normalized) \
+    VertexAttrib{ location, name, gl_member<decltype(V::member)>::components, \
+                  gl_member<decltype(V::member)>::type, normalized, offsetof(V, member) }
+
+// Canonical CPU-side vertex. Every GPU layout is packed from an array of these.
+struct VertexPN { glm::vec3 position; glm::vec3 normal; };
+
+// Maps model positions into [-1,1] for the SNORM layouts; dequant() undoes it in the model matrix.
+struct VertexQuant {
+    glm::vec3 center = glm::vec3(0.0f);
+    float extent = 1.0f;
+    glm::mat4 dequant() const {
+        return glm::scale(glm::translate(glm::mat4(1.0f), center), glm::vec3(extent));
+    }
+};
+
+inline VertexQuant compute_vertex_quant(const std::vector<VertexPN>& src) {
+    VertexQuant q;
+    if(src.empty()) return q;
+    glm::vec3 lo = src[0].position, hi = src[0].position;
+    for(auto &v: src) { lo = glm::min(lo, v.position); hi = glm::max(hi, v.position); }
+    glm::vec3 half = (hi - lo) * 0.5f;
+    q.center = (lo + hi) * 0.5f;
+    q.extent = std::max(std::max(half.x, half.y), std::max(half.z, 1e-8f));
+    return q;
+}
+
+inline int16_t pack_snorm16(float v) { return (int16_t)std::lround(std::min(std::max(v, -1.0f), 1.0f) * 32767.0f); }
+inline int8_t  pack_snorm8(float v)  { return (int8_t)std::lround(std::min(std::max(v, -1.0f), 1.0f) * 127.0f); }
+
+// Each vertex type declares: attribs[], whether it needs a VertexQuant, and how to pack itself.
+template<class V> struct vertex_traits;
+
+// Full-float interleaved, 24 bytes.
+template<> struct vertex_traits<VertexPN> {
+    static constexpr VertexAttrib attribs[] = {
+        VERTEX_ATTRIB(VertexPN, position, 0, "aPos", GL_FALSE),
+        VERTEX_ATTRIB(VertexPN, normal, 1, "aNormal", GL_FALSE),
+    };
+    static constexpr bool quantised = false;
+    static VertexPN pack(const VertexPN& v, const VertexQuant&) { return v; }
+};
+
+// Quantised interleaved, 12 bytes: SNORM16 position (w is padding) and SNORM8 normal.
+struct VertexPNQ { glm::i16vec4 position; glm::i8vec4 normal; };
+template<> struct vertex_traits<VertexPNQ> {
+    static constexpr VertexAttrib attribs[] = {
+        VERTEX_ATTRIB(VertexPNQ, position, 0, "aPos", GL_TRUE),
+        VERTEX_ATTRIB(VertexPNQ, normal, 1, "aNormal", GL_TRUE),
+    };
+    static constexpr bool quantised = true;
+    static VertexPNQ pack(const VertexPN& v, const VertexQuant& q) {
+        glm::vec3 p = (v.position - q.center) / q.extent;
+        VertexPNQ o;
+        o.position = glm::i16vec4(pack_snorm16(p.x), pack_snorm16(p.y), pack_snorm16(p.z), 0);
+        o.normal = glm::i8vec4(pack_snorm8(v.normal.x), pack_snorm8(v.normal.y), pack_snorm8(v.normal.z), 0);
+        return o;
+    }
+};
+
+// Split streams: positions and normals live in separate buffers.
+struct StreamPosition { glm::vec3 position; };
+template<> struct vertex_traits<StreamPosition> {
+    static constexpr VertexAttrib attribs[] = { VERTEX_ATTRIB(StreamPosition, position, 0, "aPos", GL_FALSE) };
+    static constexpr bool quantised = false;
+    static StreamPosition pack(const VertexPN& v, const VertexQuant&) { return { v.position }; }
+};
+
+// Quantised position alone, 8 bytes (w is padding); the depth-only stream of quantised layouts.
+struct StreamPositionQ { glm::i16vec4 position; };
+template<> struct vertex_traits<StreamPositionQ> {
+    static constexpr VertexAttrib attribs[] = { VERTEX_ATTRIB(StreamPositionQ, position, 0, "aPos", GL_TRUE) };
+    static constexpr bool quantised = true;
+    static StreamPositionQ pack(const VertexPN& v, const VertexQuant& q) {
+        glm::vec3 p = (v.position - q.center) / q.extent;
+        return { glm::i16vec4(pack_snorm16(p.x), pack_snorm16(p.y), pack_snorm16(p.z), 0) };
+    }
+};
+
+struct StreamNormal { glm::vec3 normal; };
+template<> struct vertex_traits<StreamNormal> {
+    static constexpr VertexAttrib attribs[] = { VERTEX_ATTRIB(StreamNormal, normal, 1, "aNormal", GL_FALSE) };
+    static constexpr bool quantised = false;
+    static StreamNormal pack(const VertexPN& v, const VertexQuant&) { return { v.normal }; }
+};
+
+// Optional baked ambient occlusion, attached as an extra stream after the layout's
+// own. 0 is unoccluded, which is also what shaders read when no stream is attached.
+struct StreamOcclusion { uint8_t occlusion; };
+template<> struct vertex_traits<StreamOcclusion> {
+    static constexpr VertexAttrib attribs[] = { VERTEX_ATTRIB(StreamOcclusion, occlusion, 2, "aOcclusion", GL_TRUE) };
+    static constexpr bool quantised = false;
+};
+
+// Per-instance data for instanced draws, advancing once per instance: the rows of an
+// affine placement applied after the frame's model matrix, and a material table index.
+struct InstanceData { glm::vec4 row0, row1, row2; float material; };
+template<> struct vertex_traits<InstanceData> {
+    static constexpr VertexAttrib attribs[] = {
+        VERTEX_ATTRIB(InstanceData, row0, 3, "aInstanceRow0", GL_FALSE),
+        VERTEX_ATTRIB(InstanceData, row1, 4, "aInstanceRow1", GL_FALSE),
+        VERTEX_ATTRIB(InstanceData, row2, 5, "aInstanceRow2", GL_FALSE),
+        VERTEX_ATTRIB(InstanceData, material, 6, "aInstanceMaterial", GL_FALSE),
+    };
+    static constexpr bool quantised = false;
+};
+
+template<class... Streams> struct VertexLayout {
+    static constexpr int stream_count = (int)sizeof...(Streams);
+    static constexpr size_t vertex_bytes = (sizeof(Streams) + ...);
+    static constexpr bool quantised = (vertex_traits<Streams>::quantised || ...);
+    // Packed positions for depth-only passes, in the same space as the layout's own.
+    using DepthStream = std::conditional_t<quantised, StreamPositionQ, StreamPosition>;
+    // A layout whose first stream already is DepthStream lends it to the depth VAO.
+    static constexpr bool shares_depth_stream = std::is_same_v<std::tuple_element_t<0, std::tuple<Streams...>>, DepthStream>;
+};
+
+using LayoutInterleavedF32 = VertexLayout<VertexPN>;
+using LayoutQuantised      = VertexLayout<VertexPNQ>;
+using LayoutSplitF32       = VertexLayout<StreamPosition, StreamNormal>;
+
+#ifndef MESH_LAYOUT
+#define MESH_LAYOUT LayoutInterleavedF32
+#endif
+using MeshLayout = MESH_LAYOUT;
+
+static constexpr int kMaxVertexStreams = 4;
+
+struct GpuMesh {
+    GLuint vao = 0, ebo = 0;
+    GLuint vbo[kMaxVertexStreams] = {0, 0, 0, 0};
+    int vbo_count = 0;
+    // Optional position-only VAO over the same EBO for depth-only passes; depth_vbo is 0
+    // when the layout's own position stream is reused.
+    GLuint depth_vao = 0, depth_vbo = 0;
+    GLuint instance_vbo = 0; // one of vbo[], set by attach_instances
+    GLsizei index_count = 0;
+    glm::mat4 dequant = glm::mat4(1.0f); // fold into the model matrix
+    VertexQuant quant;                    // kept for incremental updates
+};
+
+template<class V> void apply_vertex_attribs() {
+    for(const VertexAttrib &a: vertex_traits<V>::attribs) {
+        glEnableVertexAttribArray(a.location);
+        glVertexAttribPointer(a.location, a.components, a.type, a.normalized, (GLsizei)sizeof(V), (void*)a.offset);
+    }
+}
+
+template<class V> GLuint upload_vertex_stream(const std::vector<VertexPN>& src, const VertexQuant& q) {
+    std::vector<V> packed(src.size());
+    for(size_t i=0;i<src.size();++i) packed[i] = vertex_traits<V>::pack(src[i], q);
+    GLuint vbo = 0;
+    glGenBuffers(1, &vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, packed.size()*sizeof(V), packed.data(), GL_STATIC_DRAW);
+    apply_vertex_attribs<V>();
+    return vbo;
+}
+
+// Dynamic streams: storage for `capacity` vertices, filled later with update_vertex_stream.
+template<class V> GLuint allocate_vertex_stream(size_t capacity) {
+    GLuint vbo = 0;
+    glGenBuffers(1, &vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, capacity*sizeof(V), nullptr, GL_DYNAMIC_DRAW);
+    apply_vertex_attribs<V>();
+    return vbo;
+}
+
+template<class V> void update_vertex_stream(GLuint vbo, const VertexPN* src, size_t first, size_t count, const VertexQuant& q) {
+    std::vector<V> packed(count);
+    for(size_t i=0;i<count;++i) packed[i] = vertex_traits<V>::pack(src[i], q);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)(first*sizeof(V)), (GLsizeiptr)(count*sizeof(V)), packed.data());
+}
+
+inline void release_mesh(GpuMesh& m) {
+    if(m.depth_vao) glDeleteVertexArrays(1, &m.depth_vao);
+    if(m.depth_vbo) glDeleteBuffers(1, &m.depth_vbo);
+    if(m.vao) glDeleteVertexArrays(1, &m.vao);
+    if(m.vbo_count) glDeleteBuffers(m.vbo_count, m.vbo);
+    if(m.ebo) glDeleteBuffers(1, &m.ebo);
+    m = GpuMesh();
+}
+
+template<class... Streams> struct layout_uploader;
+template<class... Streams> struct layout_uploader<VertexLayout<Streams...>> {
+    static_assert(sizeof...(Streams) <= kMaxVertexStreams, "too many vertex streams");
+    static void upload(const std::vector<VertexPN>& src, const VertexQuant& q, GpuMesh& m) {
+        ((m.vbo[m.vbo_count++] = upload_vertex_stream<Streams>(src, q)), ...);
+    }
+    static void allocate(size_t capacity, GpuMesh& m) {
+        ((m.vbo[m.vbo_count++] = allocate_vertex_stream<Streams>(capacity)), ...);
+    }
+    static void update(const GpuMesh& m, const VertexPN* src, size_t first, size_t count) {
+        int i = 0;
+        (update_vertex_stream<Streams>(m.vbo[i++], src, first, count, m.quant), ...);
+    }
+    static void bind_locations(GLuint prog) {
+        auto bind = [&](const VertexAttrib& a){ glBindAttribLocation(prog, a.location, a.name); };
+        (std::for_each(std::begin(vertex_traits<Streams>::attribs), std::end(vertex_traits<Streams>::attribs), bind), ...);
+    }
+};
+
+// Builds m.depth_vao: the layout's position stream when it is already separate,
+// otherwise a packed copy (`src` null: allocated for `count` vertices, filled by updates).
+template<class Layout>
+void create_depth_stream(const VertexPN* src, size_t count, GpuMesh& m) {
+    using D = typename Layout::DepthStream;
+    glGenVertexArrays(1, &m.depth_vao);
+    glBindVertexArray(m.depth_vao);
+    if(Layout::shares_depth_stream) {
+        glBindBuffer(GL_ARRAY_BUFFER, m.vbo[0]);
+        apply_vertex_attribs<D>();
+    } else if(src) {
+        std::vector<D> packed(count);
+        for(size_t i=0;i<count;++i) packed[i] = vertex_traits<D>::pack(src[i], m.quant);
+        glGenBuffers(1, &m.depth_vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, m.depth_vbo);
+        glBufferData(GL_ARRAY_BUFFER, packed.size()*sizeof(D), packed.data(), GL_STATIC_DRAW);
+        apply_vertex_attribs<D>();
+    } else {
+        m.depth_vbo = allocate_vertex_stream<D>(count);
+    }
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m.ebo);
+    glBindVertexArray(0);
+}
+
+// Creates VAO, one VBO per stream and the EBO for the given layout. With `depth_stream`
+// it also builds m.depth_vao, which fetches positions only.
+template<class Layout>
+bool upload_mesh(const std::vector<VertexPN>& src, const std::vector<unsigned int>& indices, GpuMesh& m, bool depth_stream = false) {
+    release_mesh(m);
+    if(src.empty() || indices.empty()) return false;
+    VertexQuant q;
+    if(Layout::quantised) q = compute_vertex_quant(src);
+    glGenVertexArrays(1, &m.vao);
+    glBindVertexArray(m.vao);
+    layout_uploader<Layout>::upload(src, q, m);
+    glGenBuffers(1, &m.ebo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m.ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size()*sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+    glBindVertexArray(0);
+    m.index_count = (GLsizei)indices.size();
+    m.dequant = Layout::quantised ? q.dequant() : glm::mat4(1.0f);
+    m.quant = q;
+    if(depth_stream) create_depth_stream<Layout>(src.data(), src.size(), m);
+    return true;
+}
+
+// Creates empty buffers for a mesh that grows in place (progressive streaming).
+// Quantised layouts need the final bounds up front, passed as `q`.
+template<class Layout>
+void allocate_mesh(size_t vertex_capacity, size_t index_capacity, const VertexQuant& q, GpuMesh& m, bool depth_stream = false) {
+    release_mesh(m);
+    glGenVertexArrays(1, &m.vao);
+    glBindVertexArray(m.vao);
+    layout_uploader<Layout>::allocate(vertex_capacity, m);
+    glGenBuffers(1, &m.ebo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m.ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_capacity*sizeof(unsigned int), nullptr, GL_DYNAMIC_DRAW);
+    glBindVertexArray(0);
+    m.index_count = 0;
+    m.quant = Layout::quantised ? q : VertexQuant();
+    m.dequant = m.quant.dequant();
+    if(depth_stream) create_depth_stream<Layout>(nullptr, vertex_capacity, m);
+}
+
+template<class Layout>
+void update_mesh_vertices(const GpuMesh& m, const VertexPN* src, size_t first, size_t count) {
+    if(!count) return;
+    layout_uploader<Layout>::update(m, src, first, count);
+    if(m.depth_vbo) update_vertex_stream<typename Layout::DepthStream>(m.depth_vbo, src, first, count, m.quant);
+}
+
+// The EBO is VAO state, so bind the VAO rather than touching GL_ELEMENT_ARRAY_BUFFER alone.
+inline void update_mesh_indices(const GpuMesh& m, const unsigned int* src, size_t first, size_t count) {
+    if(!count) return;
+    glBindVertexArray(m.vao);
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, (GLintptr)(first*sizeof(unsigned int)), (GLsizeiptr)(count*sizeof(unsigned int)), src);
+    glBindVertexArray(0);
+}
+
+// Call before glLinkProgram so shaders without layout qualifiers match the layout.
+template<class Layout> void bind_attrib_locations(GLuint prog) {
+    layout_uploader<Layout>::bind_locations(prog);
+    for(const VertexAttrib &a: vertex_traits<StreamOcclusion>::attribs) glBindAttribLocation(prog, a.location, a.name);
+    for(const VertexAttrib &a: vertex_traits<InstanceData>::attribs) glBindAttribLocation(prog, a.location, a.name);
+}
+
+// Adds the per-vertex occlusion (0..1, one per mesh vertex) as a UNORM8 stream of the mesh's VAO.
+inline bool attach_occlusion(GpuMesh& m, const std::vector<float>& occlusion) {
+    if(!m.vao || occlusion.empty() || m.vbo_count >= kMaxVertexStreams) return false;
+    std::vector<StreamOcclusion> packed(occlusion.size());
+    for(size_t i=0;i<occlusion.size();++i)
+        packed[i].occlusion = (uint8_t)std::lround(std::min(std::max(occlusion[i], 0.0f), 1.0f) * 255.0f);
+    GLuint vbo = 0;
+    glGenBuffers(1, &vbo);
+    glBindVertexArray(m.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, packed.size()*sizeof(StreamOcclusion), packed.data(), GL_STATIC_DRAW);
+    apply_vertex_attribs<StreamOcclusion>();
+    glBindVertexArray(0);
+    m.vbo[m.vbo_count++] = vbo;
+    return true;
+}
+
+// Adds per-instance data as a stream of the mesh's VAO and, when present, its depth VAO.
+// Needs glVertexAttribDivisor (GL 3.3 or GL_ARB_instanced_arrays).
+inline bool attach_instances(GpuMesh& m, const std::vector<InstanceData>& instances) {
+    if(!m.vao || instances.empty() || m.vbo_count >= kMaxVertexStreams || !glVertexAttribDivisor) return false;
+    GLuint vbo = 0;
+    glGenBuffers(1, &vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, instances.size()*sizeof(InstanceData), instances.data(), GL_STREAM_DRAW);
+    for(GLuint vao: { m.vao, m.depth_vao }) {
+        if(!vao) continue;
+        glBindVertexArray(vao);
+        apply_vertex_attribs<InstanceData>();
+        for(const VertexAttrib &a: vertex_traits<InstanceData>::attribs) glVertexAttribDivisor(a.location, 1);
+    }
+    glBindVertexArray(0);
+    m.vbo[m.vbo_count++] = vbo;
+    m.instance_vbo = vbo;
+    return true;
+}
+
+// Replaces the instance stream with `count` instances, e.g. the ones that survived culling.
+// The buffer is re-specified rather than overwritten so the driver can orphan the copy
+// still in use by the previous frame.
+inline void update_instances(const GpuMesh& m, const InstanceData* instances, size_t count) {
+    if(!m.instance_vbo || !count) return;
+    glBindBuffer(GL_ARRAY_BUFFER, m.instance_vbo);
+    glBufferData(GL_ARRAY_BUFFER, count*sizeof(InstanceData), instances, GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}